@@ -0,0 +1,48 @@
+#include "AppOptions.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+
+// Dynamic resolution and the overlay divide by the budget, so it has to be a positive number.
+static double ParseBudgetMs(const char* text) {
+	char* end = nullptr;
+	double budgetMs = strtod(text, &end);
+	if (end == text || *end != '\0' || !std::isfinite(budgetMs) || budgetMs <= 0.0) {
+		throw std::runtime_error(std::string("Invalid GPU budget: ") + text + ", it has to be a positive number of milliseconds!");
+	}
+	return budgetMs;
+}
+
+
+AppOptions ParseOptions(int argc, char** argv) {
+	AppOptions options;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--bench-dispatch")) options.benchmarkDispatch = true;
+		else if (!strcmp(argv[i], "--bench-debug-sink")) options.benchmarkDebugSink = true;
+		else if (!strcmp(argv[i], "--bench-jobs")) options.benchmarkJobs = true;
+		else if (!strcmp(argv[i], "--bench-scene")) options.benchmarkScene = true;
+		else if (!strcmp(argv[i], "--bench-lights")) options.benchmarkLights = true;
+		else if (!strcmp(argv[i], "--mesh-report")) options.meshReport = true;
+		else if (!strcmp(argv[i], "--float-vertices")) options.quantizedVertices = false;
+		else if (!strcmp(argv[i], "--no-occlusion-culling")) options.occlusionCulling = false;
+		else if (!strcmp(argv[i], "--compare-occlusion-culling")) options.compareOcclusionCulling = true;
+		else if (!strcmp(argv[i], "--fixed-resolution")) options.dynamicResolution = false;
+		else if (!strcmp(argv[i], "--no-overlay")) options.overlay = false;
+		else if (!strcmp(argv[i], "--gpu-budget") && i + 1 < argc) options.gpuBudgetMs = ParseBudgetMs(argv[++i]);
+		else if (!strcmp(argv[i], "--lights") && i + 1 < argc) options.lightCount = static_cast<uint32_t>(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "--capture") && i + 1 < argc) options.captureFile = argv[++i];
+		else if (!strcmp(argv[i], "--replay") && i + 1 < argc) options.replayFile = argv[++i];
+		else if (!strcmp(argv[i], "--replay-realtime")) options.replayRealtime = true;
+		else if (!strcmp(argv[i], "--bench-suite") && i + 1 < argc) options.benchmarkSuite = argv[++i];
+		else if (!strcmp(argv[i], "--bench-output") && i + 1 < argc) options.benchmarkOutput = argv[++i];
+		else throw std::runtime_error(std::string("Unknown option: ") + argv[i]);
+	}
+	if (!options.benchmarkSuite.empty() && options.benchmarkOutput.empty()) options.benchmarkOutput = "bench_" + options.benchmarkSuite + ".json";
+
+	return options;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+// Command line switches. Without any, the application just renders.
+struct AppOptions {
+	bool benchmarkDispatch = false;
+	bool benchmarkDebugSink = false;
+	bool benchmarkJobs = false;
+	bool benchmarkScene = false;
+	bool benchmarkLights = false;
+	bool meshReport = false;
+	bool quantizedVertices = true;
+	bool dynamicResolution = true;
+	bool occlusionCulling = true;
+	bool compareOcclusionCulling = false;
+	// Draws frame times, GPU pass timings, memory use and queue depths over the frame; F1 hides it.
+	bool overlay = true;
+	double gpuBudgetMs = 1000.0 / 60.0;
+	// Dynamic lights in the live scene.
+	uint32_t lightCount = 1024;
+	// Writes every frame's work to a trace while rendering.
+	std::string captureFile;
+	// Replays a trace without a window instead of rendering the live scene, as fast as
+	// possible or, with replayRealtime, at the pace it was captured.
+	std::string replayFile;
+	bool replayRealtime = false;
+	// Renders one of the benchmark suite's scenes without a window and writes its
+	// timings and memory use to benchmarkOutput.
+	std::string benchmarkSuite;
+	std::string benchmarkOutput;
+};
+
+AppOptions ParseOptions(int argc, char** argv);
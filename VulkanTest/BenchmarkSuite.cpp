@@ -0,0 +1,125 @@
+#include "BenchmarkSuite.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+// Keep the names in sync with Benchmarks/run_suite.py.
+static const std::vector<SuiteScene> suiteScenes = {
+	{ "triangle", "A single triangle, the fixed cost of a frame", 1, -1, false, 0, 0, 600 },
+	{ "instanced-100k", "100k static instances of a 20 triangle mesh", 100000, 0, false, 0, 0, 300 },
+	{ "upload-heavy", "16k instances that all move every frame", 16384, 1, true, 0, 0, 300 },
+	{ "resize-storm", "The solar system scene, resized every 4 frames", 0, 3, false, 4, 1024, 300 },
+	{ "lights-16k", "The solar system scene lit by 16k moving lights", 0, 3, false, 0, 16384, 300 }
+};
+
+static const uint32_t suiteResizeExtents[][2] = {
+	{ 1280, 720 }, { 640, 480 }, { 1920, 1080 }, { 333, 197 }, { 1024, 768 }, { 800, 600 }
+};
+
+
+FrameTimeStats SummarizeFrameTimes(std::vector<double> timesMs) {
+	timesMs.erase(std::remove_if(timesMs.begin(), timesMs.end(), [](double ms) { return ms < 0.0; }), timesMs.end());
+
+	FrameTimeStats stats;
+	if (timesMs.empty()) return stats;
+
+	std::sort(timesMs.begin(), timesMs.end());
+	stats.count = static_cast<int>(timesMs.size());
+	for (double ms : timesMs) stats.averageMs += ms;
+	stats.averageMs /= timesMs.size();
+	stats.medianMs = timesMs[timesMs.size() / 2];
+	stats.p95Ms = timesMs[std::min(timesMs.size() - 1, timesMs.size() * 95 / 100)];
+	stats.p99Ms = timesMs[std::min(timesMs.size() - 1, timesMs.size() * 99 / 100)];
+	stats.maxMs = timesMs.back();
+
+	return stats;
+}
+
+
+const std::vector<SuiteScene>& SuiteScenes() {
+	return suiteScenes;
+}
+
+const SuiteScene* FindSuiteScene(const std::string& name) {
+	for (const SuiteScene& scene : suiteScenes) {
+		if (name == scene.name) return &scene;
+	}
+
+	return nullptr;
+}
+
+void SuiteResizeExtent(int index, uint32_t& width, uint32_t& height) {
+	const int count = sizeof(suiteResizeExtents) / sizeof(suiteResizeExtents[0]);
+	width = suiteResizeExtents[index % count][0];
+	height = suiteResizeExtents[index % count][1];
+}
+
+
+// Device names are the only strings that don't come from this file.
+static void WriteJsonString(FILE* file, const char* text) {
+	fputc('"', file);
+	for (const char* c = text; *c; ++c) {
+		if (*c == '"' || *c == '\\') fprintf(file, "\\%c", *c);
+		else if (static_cast<unsigned char>(*c) < 0x20) fprintf(file, "\\u%04x", *c);
+		else fputc(*c, file);
+	}
+	fputc('"', file);
+}
+
+static void WriteJsonStats(FILE* file, const char* name, const FrameTimeStats& stats) {
+	fprintf(file, "\t\"%s\": { \"count\": %d, \"average\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+		name, stats.count, stats.averageMs, stats.medianMs, stats.p95Ms, stats.p99Ms, stats.maxMs);
+}
+
+void WriteSuiteResult(const std::string& filename, const SuiteResult& result) {
+	FILE* file = fopen(filename.c_str(), "w");
+	if (!file) throw std::runtime_error("Failed to write benchmark result!");
+
+	fputs("{\n\t\"scene\": ", file);
+	WriteJsonString(file, result.scene->name);
+	fputs(",\n\t\"description\": ", file);
+	WriteJsonString(file, result.scene->description);
+	fputs(",\n\t\"device\": ", file);
+	WriteJsonString(file, result.device.c_str());
+	fprintf(file, ",\n\t\"validation\": %s,\n", result.validation ? "true" : "false");
+	fprintf(file, "\t\"frames\": %d,\n\t\"warmup_frames\": %d,\n", result.scene->frames, SUITE_WARMUP_FRAMES);
+	fprintf(file, "\t\"startup_ms\": %.4f,\n", result.startupMs);
+	WriteJsonStats(file, "cpu_ms", result.cpu);
+	WriteJsonStats(file, "gpu_ms", result.gpu);
+	WriteJsonStats(file, "overlay_gpu_ms", result.overlayGpu);
+	fprintf(file, "\t\"memory\": { \"process_peak_bytes\": %llu, \"device_peak_bytes\": %llu },\n",
+		static_cast<unsigned long long>(result.processPeakBytes), static_cast<unsigned long long>(result.devicePeakBytes));
+	fprintf(file, "\t\"light_overflow\": { \"clusters\": %u, \"dropped_lights\": %u }\n}\n", result.overflowedClusters, result.droppedLights);
+
+	if (fclose(file) != 0) throw std::runtime_error("Failed to write benchmark result!");
+}
+
+
+uint64_t PeakProcessMemoryBytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters = { };
+	counters.cb = sizeof(counters);
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+	// Linux reports kilobytes.
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "GpuProfiler.h"
+
+
+// What one headless frame cost: the CPU time of DrawFrame and the GPU time of the
+// frame and of each of its passes, which are negative if the frame wasn't timed.
+struct FrameTiming {
+	FrameTiming() { for (double& ms : passMs) ms = -1.0; }
+
+	double cpuMs = 0.0;
+	double gpuMs = -1.0;
+	double passMs[GPU_PASS_COUNT];
+};
+
+struct FrameTimeStats {
+	int count = 0;
+	double averageMs = 0.0;
+	double medianMs = 0.0;
+	double p95Ms = 0.0;
+	double p99Ms = 0.0;
+	double maxMs = 0.0;
+};
+
+// The most GPU time the performance overlay should take.
+const double OVERLAY_TARGET_MS = 0.1;
+
+// Negative times are left out.
+FrameTimeStats SummarizeFrameTimes(std::vector<double> timesMs);
+
+
+// A deterministic scene for --bench-suite. Scenes animate by frame number rather than
+// by the clock, so every run renders the same frames.
+struct SuiteScene {
+	const char* name;
+	const char* description;
+	// Instances laid out in a grid that fills the view, or 0 for the solar system scene.
+	uint32_t gridInstances;
+	// Icosphere subdivisions of the mesh every instance is drawn with, or -1 for a single triangle.
+	int meshSubdivisions;
+	// Every instance moves every frame, so the whole instance buffer is uploaded each frame.
+	bool moveAll;
+	// Resizes the render targets every this many frames, or never if 0.
+	int resizeInterval;
+	// Dynamic lights the scene is lit by.
+	uint32_t lightCount;
+	int frames;
+};
+
+// The frames at the start of a scene that are rendered but left out of its statistics,
+// while pipelines, caches and the driver settle.
+const int SUITE_WARMUP_FRAMES = 30;
+
+const std::vector<SuiteScene>& SuiteScenes();
+// nullptr if there is no such scene.
+const SuiteScene* FindSuiteScene(const std::string& name);
+// The extent the resize storm switches to at its index-th resize.
+void SuiteResizeExtent(int index, uint32_t& width, uint32_t& height);
+
+struct SuiteResult {
+	const SuiteScene* scene = nullptr;
+	std::string device;
+	bool validation = false;
+	double startupMs = 0.0;
+	FrameTimeStats cpu;
+	FrameTimeStats gpu;
+	// The GPU time of the performance overlay's pass alone.
+	FrameTimeStats overlayGpu;
+	uint64_t processPeakBytes = 0;
+	uint64_t devicePeakBytes = 0;
+	// The most clusters that dropped lights in one frame, and the most lights dropped.
+	// Timings of a scene that dropped any aren't valid, since it shaded less than it should.
+	uint32_t overflowedClusters = 0;
+	uint32_t droppedLights = 0;
+};
+
+// Writes one scene's result as JSON, which Benchmarks/run_suite.py collects and
+// compares against a baseline.
+void WriteSuiteResult(const std::string& filename, const SuiteResult& result);
+
+// The most memory the process ever had resident, or 0 where that isn't known.
+uint64_t PeakProcessMemoryBytes();
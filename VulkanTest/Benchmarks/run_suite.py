@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""Runs the benchmark suite and compares it against a baseline.
+
+Every scene runs headless in its own process (VulkanTest --bench-suite <scene>),
+which writes its frame-time distribution, startup time and memory high-water marks
+as JSON. The results are collected into one file and, given a baseline, every metric
+is compared against it. A metric regresses when it is worse than the baseline by
+more than its tolerance, a fraction of the baseline value. Tolerances come from
+--tolerance, then the baseline file, then the defaults below.
+
+Pass --icd with a driver manifest (e.g. lavapipe's lvp_icd.x86_64.json or
+SwiftShader's vk_swiftshader_icd.json) to run on a software implementation, which
+makes the numbers comparable between machines without the same GPU. Baselines are
+only meaningful for the device and build they were recorded with, so record one
+with --update-baseline on the machine that runs the comparison.
+
+Exits with 1 if any metric regressed, and fails if a scene dropped lights from
+clusters that were full, since its timings don't count all of its lighting.
+"""
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+
+PROJECT_DIR = os.path.abspath(os.path.join(os.path.dirname(os.path.abspath(__file__)), os.pardir))
+SOLUTION_DIR = os.path.dirname(PROJECT_DIR)
+
+# Keep in sync with the scenes in BenchmarkSuite.cpp.
+SCENES = ["triangle", "instanced-100k", "upload-heavy", "resize-storm", "lights-16k"]
+
+# Metric and default tolerance. Lower is better for all of them.
+METRICS = [
+    ("startup_ms", 0.25),
+    ("cpu_ms.median", 0.10),
+    ("cpu_ms.p95", 0.20),
+    ("cpu_ms.p99", 0.30),
+    ("gpu_ms.median", 0.10),
+    ("gpu_ms.p95", 0.20),
+    ("gpu_ms.p99", 0.30),
+    ("overlay_gpu_ms.median", 0.25),
+    ("memory.process_peak_bytes", 0.05),
+    ("memory.device_peak_bytes", 0.01),
+]
+
+# The most GPU time the performance overlay should take, as in BenchmarkSuite.h.
+OVERLAY_TARGET_MS = 0.1
+
+# Where Visual Studio puts the executable, best first.
+EXECUTABLES = [
+    os.path.join(SOLUTION_DIR, "x64", "Release", "VulkanTest.exe"),
+    os.path.join(SOLUTION_DIR, "Release", "VulkanTest.exe"),
+    os.path.join(SOLUTION_DIR, "x64", "Debug", "VulkanTest.exe"),
+    os.path.join(SOLUTION_DIR, "Debug", "VulkanTest.exe"),
+]
+
+
+def find_executable():
+    for path in EXECUTABLES:
+        if os.path.isfile(path):
+            return path
+    sys.exit("run_suite.py: VulkanTest not found, build it or pass --exe")
+
+
+def run_scene(exe, scene, env, work_dir):
+    output = os.path.join(work_dir, "bench_%s.json" % scene)
+    # The executable finds the shader bundle relative to the project directory. Debug
+    # builds wait for a key before exiting, so stdin gets one.
+    result = subprocess.run([exe, "--bench-suite", scene, "--bench-output", output], cwd=PROJECT_DIR, env=env,
+                            input="\n", stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    if result.returncode != 0 or not os.path.isfile(output):
+        sys.exit("run_suite.py: scene %s failed\n%s" % (scene, result.stdout))
+    with open(output) as f:
+        scene_result = json.load(f)
+    # A scene that dropped lights from full clusters shaded less than it should have.
+    overflow = scene_result.get("light_overflow", {})
+    if overflow.get("clusters", 0) > 0:
+        sys.exit("run_suite.py: scene %s dropped %d lights in %d full clusters, its timings are invalid" % (
+            scene, overflow["dropped_lights"], overflow["clusters"]))
+    return scene_result
+
+
+def metric(result, name):
+    value = result
+    for key in name.split("."):
+        value = value[key]
+    return value
+
+
+def set_metric(result, name, value):
+    keys = name.split(".")
+    for key in keys[:-1]:
+        result = result[key]
+    result[keys[-1]] = value
+
+
+def combine_runs(runs):
+    """The first run with every metric replaced by its median over all runs."""
+    combined = runs[0]
+    for name, _ in METRICS:
+        set_metric(combined, name, statistics.median(metric(run, name) for run in runs))
+    return combined
+
+
+def parse_tolerances(values):
+    tolerances = {}
+    for value in values:
+        name, _, fraction = value.partition("=")
+        if name != "*" and name not in dict(METRICS):
+            sys.exit("run_suite.py: unknown metric %s, the metrics are %s" % (name, ", ".join(n for n, _ in METRICS)))
+        try:
+            tolerances[name] = float(fraction)
+        except ValueError:
+            sys.exit("run_suite.py: tolerance %s is not metric=fraction" % value)
+    return tolerances
+
+
+def tolerance(name, baseline, overrides):
+    for source in (overrides, baseline.get("tolerances", {})):
+        if name in source:
+            return source[name]
+        if "*" in source:
+            return source["*"]
+    return dict(METRICS)[name]
+
+
+def format_value(name, value):
+    if name.endswith("_bytes"):
+        return "%.1f MB" % (value / (1024.0 * 1024.0))
+    return "%.3f ms" % value
+
+
+def compare(current, baseline, overrides, min_delta_ms):
+    """Prints every metric against the baseline and returns the number of regressions."""
+    regressions = 0
+    for setting in ("device", "validation"):
+        if current.get(setting) != baseline.get(setting):
+            print("Warning: baseline %s was %s, now %s" % (setting, baseline.get(setting), current.get(setting)))
+
+    for scene, result in current["scenes"].items():
+        base = baseline["scenes"].get(scene)
+        if base is None:
+            print("%s: not in the baseline" % scene)
+            continue
+
+        print(scene)
+        overlay_ms = metric(result, "overlay_gpu_ms.median")
+        if overlay_ms > OVERLAY_TARGET_MS:
+            print("  overlay takes %.3f ms, more than its %.1f ms target" % (overlay_ms, OVERLAY_TARGET_MS))
+
+        for name, _ in METRICS:
+            value = metric(result, name)
+            try:
+                base_value = metric(base, name)
+            except KeyError:
+                print("  %-26s not in the baseline" % name)
+                continue
+            allowed = tolerance(name, baseline, overrides)
+            change = (value - base_value) / base_value if base_value > 0 else 0.0
+            # Times of a few microseconds are mostly noise, however large the relative change.
+            slack = 0.0 if name.endswith("_bytes") else min_delta_ms
+            regressed = change > allowed and value - base_value > slack
+            regressions += regressed
+            print("  %-26s %12s -> %12s  %+7.1f%% (tolerance %.0f%%)%s" % (
+                name, format_value(name, base_value), format_value(name, value), 100.0 * change, 100.0 * allowed,
+                "  REGRESSION" if regressed else ""))
+
+    for scene in baseline["scenes"]:
+        if scene not in current["scenes"]:
+            print("%s: in the baseline but not run" % scene)
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Runs the benchmark suite and compares it against a baseline.")
+    parser.add_argument("--exe", help="the VulkanTest executable, found in the build directories by default")
+    parser.add_argument("--icd", help="a Vulkan driver manifest to run on instead of the installed drivers")
+    parser.add_argument("--scenes", nargs="+", choices=SCENES, default=SCENES, help="the scenes to run")
+    parser.add_argument("--runs", type=int, default=1, help="runs per scene, the median of every metric is kept")
+    parser.add_argument("--output", default="benchmark_results.json", help="where to write the results")
+    parser.add_argument("--baseline", help="results to compare against")
+    parser.add_argument("--update-baseline", action="store_true", help="write the results to --baseline instead of comparing")
+    parser.add_argument("--tolerance", action="append", default=[], metavar="METRIC=FRACTION",
+                        help="allowed regression of a metric, or of every metric with *, e.g. gpu_ms.p95=0.15")
+    parser.add_argument("--min-delta-ms", type=float, default=0.05, help="time regressions smaller than this are ignored")
+    args = parser.parse_args()
+
+    if args.update_baseline and not args.baseline:
+        parser.error("--update-baseline needs --baseline")
+    if args.runs < 1:
+        parser.error("--runs has to be at least 1")
+    overrides = parse_tolerances(args.tolerance)
+
+    exe = os.path.abspath(args.exe) if args.exe else find_executable()
+    env = dict(os.environ)
+    if args.icd:
+        # Older loaders read the first, newer ones the second.
+        env["VK_ICD_FILENAMES"] = os.path.abspath(args.icd)
+        env["VK_DRIVER_FILES"] = os.path.abspath(args.icd)
+
+    current = {"scenes": {}}
+    with tempfile.TemporaryDirectory() as work_dir:
+        for scene in args.scenes:
+            runs = []
+            for run in range(args.runs):
+                print("Running %s (%d/%d)" % (scene, run + 1, args.runs), flush=True)
+                runs.append(run_scene(exe, scene, env, work_dir))
+            result = combine_runs(runs)
+            current["device"] = result["device"]
+            current["validation"] = result["validation"]
+            current["scenes"][scene] = result
+
+    with open(args.output, "w") as f:
+        json.dump(current, f, indent=4)
+    print("Results written to %s" % args.output)
+
+    if args.update_baseline:
+        # The tolerances in use are stored with the baseline, so they can be tuned per machine.
+        current["tolerances"] = {name: tolerance(name, {}, overrides) for name, _ in METRICS}
+        with open(args.baseline, "w") as f:
+            json.dump(current, f, indent=4)
+        print("Baseline written to %s" % args.baseline)
+        return
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        regressions = compare(current, baseline, overrides, args.min_delta_ms)
+        if regressions:
+            sys.exit("%d metrics regressed" % regressions)
+        print("No regressions")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,11 @@
+#include "Camera.h"
+
+
+Camera CreateOrthographicCamera(float halfWidth, float halfHeight, float nearZ, float farZ) {
+	Camera camera = { };
+	camera.scale[0] = 1.0f / halfWidth;
+	camera.scale[1] = 1.0f / halfHeight;
+	camera.scale[2] = 1.0f / (farZ - nearZ);
+	camera.offset[2] = -nearZ / (farZ - nearZ);
+	return camera;
+}
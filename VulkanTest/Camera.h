@@ -0,0 +1,12 @@
+#pragma once
+
+
+// An orthographic view down the -z axis. Clip space is world * scale + offset,
+// with depth 0 at nearZ and 1 at farZ, so nearer means smaller depth. The vertex
+// and cull shaders share it through push constants.
+struct Camera {
+	float scale[4];
+	float offset[4];
+};
+
+Camera CreateOrthographicCamera(float halfWidth, float halfHeight, float nearZ, float farZ);
@@ -0,0 +1,253 @@
+#include "ClusteredLighting.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+
+struct BinParams {
+	Camera camera;
+	uint32_t lightCount;
+};
+
+static const float LIGHT_RADIUS = 0.25f;
+
+
+static uint32_t GroupCount(uint32_t size, uint32_t groupSize) {
+	return (size + groupSize - 1) / groupSize;
+}
+
+
+void ClusteredLighting::Init(const GpuContext& context, const ShaderCode& binCode, int slotCount) {
+	context_ = context;
+	const DeviceDispatch& vk = *context_.dispatch;
+	VkDeviceSize lightsSize = MAX_LIGHTS * sizeof(GpuLight);
+
+	lights_ = CreateBuffer(context_, lightsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	clusters_ = CreateBuffer(context_, CLUSTER_COUNT * (1 + MAX_LIGHTS_PER_CLUSTER) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	counters_ = CreateBuffer(context_, sizeof(ClusterOverflow), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	slots_.resize(slotCount);
+	for (Slot& slot : slots_) {
+		slot.staging = CreateBuffer(context_, lightsSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		slot.readback = CreateBuffer(context_, sizeof(ClusterOverflow), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+
+	// The binning writes the clusters and the fragment shader reads both; the counters are the binning's alone.
+	VkDescriptorSetLayoutBinding bindings[3] = { };
+	for (uint32_t i = 0; i < 3; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = i < 2 ? VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT : VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = { };
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = nullptr;
+	layoutInfo.flags = 0;
+	layoutInfo.bindingCount = 3;
+	layoutInfo.pBindings = bindings;
+
+	VkResult result = vk.CreateDescriptorSetLayout(context_.device, &layoutInfo, nullptr, &setLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create light descriptor set layout!");
+
+	VkPushConstantRange pushConstantRange = { };
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(BinParams);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = { };
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.pNext = nullptr;
+	pipelineLayoutInfo.flags = 0;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &setLayout_;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	result = vk.CreatePipelineLayout(context_.device, &pipelineLayoutInfo, nullptr, &pipelineLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create light binning pipeline layout!");
+
+	binPipeline_ = CreateComputePipeline(context_, pipelineLayout_, binCode);
+
+	VkDescriptorPoolSize poolSize = { };
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = 3;
+
+	VkDescriptorPoolCreateInfo poolInfo = { };
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.pNext = nullptr;
+	poolInfo.flags = 0;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	result = vk.CreateDescriptorPool(context_.device, &poolInfo, nullptr, &descriptorPool_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create light descriptor pool!");
+
+	VkDescriptorSetAllocateInfo allocateInfo = { };
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.pNext = nullptr;
+	allocateInfo.descriptorPool = descriptorPool_;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &setLayout_;
+
+	result = vk.AllocateDescriptorSets(context_.device, &allocateInfo, &set_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to allocate light descriptor set!");
+
+	VkDescriptorBufferInfo bufferInfos[3] = { };
+	bufferInfos[0].buffer = lights_.buffer;
+	bufferInfos[1].buffer = clusters_.buffer;
+	bufferInfos[2].buffer = counters_.buffer;
+	for (VkDescriptorBufferInfo& bufferInfo : bufferInfos) {
+		bufferInfo.offset = 0;
+		bufferInfo.range = VK_WHOLE_SIZE;
+	}
+
+	VkWriteDescriptorSet write = { };
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = nullptr;
+	write.dstSet = set_;
+	write.dstBinding = 0;
+	write.dstArrayElement = 0;
+	write.descriptorCount = 3;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pImageInfo = nullptr;
+	write.pBufferInfo = bufferInfos;
+	write.pTexelBufferView = nullptr;
+	vk.UpdateDescriptorSets(context_.device, 1, &write, 0, nullptr);
+}
+
+void ClusteredLighting::Destroy() {
+	const DeviceDispatch& vk = *context_.dispatch;
+
+	vk.DestroyDescriptorPool(context_.device, descriptorPool_, nullptr);
+	vk.DestroyPipeline(context_.device, binPipeline_, nullptr);
+	vk.DestroyPipelineLayout(context_.device, pipelineLayout_, nullptr);
+	vk.DestroyDescriptorSetLayout(context_.device, setLayout_, nullptr);
+	for (Slot& slot : slots_) {
+		DestroyBuffer(context_, slot.readback);
+		DestroyBuffer(context_, slot.staging);
+	}
+	DestroyBuffer(context_, counters_);
+	DestroyBuffer(context_, clusters_);
+	DestroyBuffer(context_, lights_);
+}
+
+void ClusteredLighting::SetLights(uint32_t count, const float boundsMin[3], const float boundsMax[3]) {
+	count = std::min(count, MAX_LIGHTS);
+
+	// What the slots binned so far was for the old lights.
+	for (Slot& slot : slots_) slot.binned = false;
+	maxOverflow_ = { };
+	overflowReported_ = false;
+
+	std::mt19937 random(4242);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	sources_.resize(count);
+	for (LightSource& source : sources_) {
+		for (int k = 0; k < 3; ++k) source.center[k] = boundsMin[k] + unit(random) * (boundsMax[k] - boundsMin[k]);
+		source.orbitRadius = LIGHT_RADIUS * (0.5f + unit(random));
+		source.speed = (unit(random) < 0.5f ? -1.0f : 1.0f) * (0.5f + 1.5f * unit(random));
+		source.phase = 6.2831853f * unit(random);
+
+		// Random colors at full brightness: one channel is always 1.
+		for (int k = 0; k < 3; ++k) source.color[k] = unit(random);
+		source.color[static_cast<int>(unit(random) * 2.999f)] = 1.0f;
+	}
+}
+
+void ClusteredLighting::Update(int slotIndex, float time, JobSystem& jobs) {
+	Slot& slot = slots_[slotIndex];
+	GpuLight* staged = static_cast<GpuLight*>(slot.staging.mapped);
+
+	if (slot.binned) {
+		ClusterOverflow overflow;
+		memcpy(&overflow, slot.readback.mapped, sizeof(overflow));
+		maxOverflow_.clusters = std::max(maxOverflow_.clusters, overflow.clusters);
+		maxOverflow_.droppedLights = std::max(maxOverflow_.droppedLights, overflow.droppedLights);
+
+		if (overflow.clusters > 0 && !overflowReported_) {
+			printf("Lights: %u clusters hold more than %u lights, %u lights dropped; their bounds will show\n", overflow.clusters, MAX_LIGHTS_PER_CLUSTER, overflow.droppedLights);
+			overflowReported_ = true;
+		}
+	}
+
+	slot.count = this->LightCount();
+
+	auto update = [this, staged, time](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			const LightSource& source = sources_[i];
+			float angle = source.speed * time + source.phase;
+
+			GpuLight& light = staged[i];
+			light.positionRadius[0] = source.center[0] + source.orbitRadius * std::cos(angle);
+			light.positionRadius[1] = source.center[1] + source.orbitRadius * std::sin(angle);
+			light.positionRadius[2] = source.center[2];
+			light.positionRadius[3] = LIGHT_RADIUS;
+			for (int k = 0; k < 3; ++k) light.color[k] = source.color[k];
+			light.color[3] = 1.0f;
+		}
+	};
+
+	if (slot.count <= UPDATE_BATCH_SIZE) {
+		update(0, slot.count);
+		return;
+	}
+
+	JobCounter updated;
+	jobs.ParallelFor(slot.count, UPDATE_BATCH_SIZE, update, updated);
+	jobs.Wait(updated);
+}
+
+void ClusteredLighting::Record(VkCommandBuffer commandBuffer, int slotIndex, const Camera& camera) {
+	const DeviceDispatch& vk = *context_.dispatch;
+	Slot& slot = slots_[slotIndex];
+	slot.binned = true;
+
+	// The previous frame's binning, shading and readback have to be done with the buffers
+	// before they are overwritten, and its writes ordered before this frame's.
+	VkMemoryBarrier barrier = { };
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	ClusterOverflow counters = { };
+	vk.CmdUpdateBuffer(commandBuffer, counters_.buffer, 0, sizeof(counters), &counters);
+	if (slot.count > 0) {
+		VkBufferCopy copy = { 0, 0, slot.count * sizeof(GpuLight) };
+		vk.CmdCopyBuffer(commandBuffer, slot.staging.buffer, lights_.buffer, 1, &copy);
+	}
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	BinParams params = { };
+	params.camera = camera;
+	params.lightCount = slot.count;
+
+	vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, binPipeline_);
+	vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &set_, 0, nullptr);
+	vk.CmdPushConstants(commandBuffer, pipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+	vk.CmdDispatch(commandBuffer, GroupCount(CLUSTER_COUNT, 64), 1, 1);
+
+	// The scene's fragment shader reads the clusters, and the counters are copied for Update.
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	VkBufferCopy copy = { 0, 0, sizeof(ClusterOverflow) };
+	vk.CmdCopyBuffer(commandBuffer, counters_.buffer, slot.readback.buffer, 1, &copy);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+
+#include "Camera.h"
+#include "GpuResources.h"
+#include "JobSystem.h"
+
+
+// Layout of one light in the shaders' std430 light array.
+struct GpuLight {
+	float positionRadius[4];
+	float color[4];
+};
+
+// What one frame's binning counted of the clusters that had more lights than they keep.
+struct ClusterOverflow {
+	uint32_t clusters;
+	uint32_t droppedLights;
+};
+
+// Clustered forward shading of many dynamic point lights. The view volume is split
+// into a grid of clusters, boxes of the same size everywhere since the camera is
+// orthographic. Every frame a compute pass bins the lights into the clusters their
+// spheres touch, and the scene's fragment shader only loops over the lights of the
+// fragment's cluster, so its cost follows how many lights overlap it rather than
+// how many there are. A cluster only keeps so many lights; the binning counts the
+// clusters that had more and the lights they dropped, since the lighting shows a
+// seam at the bounds of such a cluster.
+//
+// The lights move every frame. They are staged into the frame slot's host visible
+// buffer and copied into one device local buffer at the start of the slot's lights
+// pass; that buffer and the clusters are shared by the slots, like the occlusion
+// culler's, since the graphics queue runs the slots' scene passes in order.
+class ClusteredLighting {
+public:
+	// Keep in sync with lightbin.comp and shader.frag.
+	static const uint32_t CLUSTERS_X = 16;
+	static const uint32_t CLUSTERS_Y = 16;
+	static const uint32_t CLUSTERS_Z = 32;
+	static const uint32_t CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+	// A cluster drops any lights past these, which bounds what a fragment can cost.
+	// The lights it keeps are the first ones in light order. At the light radius a
+	// cluster touches about one in 70 of the lights and the fullest about one in 56,
+	// so up to 16k lights fit with room to spare.
+	static const uint32_t MAX_LIGHTS_PER_CLUSTER = 512;
+	static const uint32_t MAX_LIGHTS = 65536;
+
+	void Init(const GpuContext& context, const ShaderCode& binCode, int slotCount);
+	void Destroy();
+
+	// Replaces the lights with count new ones that wander around inside the box from
+	// boundsMin to boundsMax. The same count always makes the same lights.
+	void SetLights(uint32_t count, const float boundsMin[3], const float boundsMax[3]);
+	// Stages the lights where they are at time seconds and reads back what the slot's
+	// previous binning counted. The slot's previous frame has to be finished.
+	void Update(int slot, float time, JobSystem& jobs);
+	// Before the scene render pass: uploads what the slot staged and bins it for camera.
+	void Record(VkCommandBuffer commandBuffer, int slot, const Camera& camera);
+
+	uint32_t LightCount() const { return static_cast<uint32_t>(sources_.size()); }
+	// The most clusters that overflowed in one frame since SetLights, and the most lights one frame dropped.
+	const ClusterOverflow& MaxOverflow() const { return maxOverflow_; }
+	// The lights and the clusters, for the scene's fragment shader.
+	VkDescriptorSetLayout SetLayout() const { return setLayout_; }
+	VkDescriptorSet Set() const { return set_; }
+
+private:
+	static const uint32_t UPDATE_BATCH_SIZE = 4096;
+
+	// Where a light circles and how fast.
+	struct LightSource {
+		float center[3];
+		float orbitRadius;
+		float speed;
+		float phase;
+		float color[3];
+	};
+
+	struct Slot {
+		GpuBuffer staging;
+		GpuBuffer readback;
+		uint32_t count = 0;
+		bool binned = false;
+	};
+
+private:
+	GpuContext context_;
+	std::vector<LightSource> sources_;
+	std::vector<Slot> slots_;
+	ClusterOverflow maxOverflow_ = { };
+	bool overflowReported_ = false;
+
+	GpuBuffer lights_;
+	// The light count of every cluster, then MAX_LIGHTS_PER_CLUSTER light indices per cluster.
+	GpuBuffer clusters_;
+	// The binning's ClusterOverflow, reset every frame.
+	GpuBuffer counters_;
+
+	VkDescriptorSetLayout setLayout_ = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+	VkPipeline binPipeline_ = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+	VkDescriptorSet set_ = VK_NULL_HANDLE;
+};
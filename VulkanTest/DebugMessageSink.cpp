@@ -0,0 +1,260 @@
+#include "DebugMessageSink.h"
+
+#include <cstring>
+
+
+// A message code on an object is written at most once per window; repeats in between are only counted.
+static const double REPEAT_WINDOW_MS = 1000.0;
+// Across all messages, at most this many lines are written per window.
+static const uint32_t MAX_LINES_PER_WINDOW = 200;
+static const std::chrono::milliseconds IDLE_SLEEP(2);
+
+
+static void CopyString(char* dst, const char* src, size_t capacity) {
+	size_t length = src ? strnlen(src, capacity - 1) : 0;
+	if (length) memcpy(dst, src, length);
+	dst[length] = '\0';
+}
+
+static void WriteJsonString(FILE* file, const char* text) {
+	fputc('"', file);
+	for (const char* c = text; *c; ++c) {
+		switch (*c) {
+		case '"': fputs("\\\"", file); break;
+		case '\\': fputs("\\\\", file); break;
+		case '\n': fputs("\\n", file); break;
+		case '\r': fputs("\\r", file); break;
+		case '\t': fputs("\\t", file); break;
+		default:
+			if (static_cast<unsigned char>(*c) < 0x20) fprintf(file, "\\u%04x", *c);
+			else fputc(*c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+static const char* Severity(VkDebugReportFlagsEXT flags) {
+	if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT) return "error";
+	if (flags & (VK_DEBUG_REPORT_WARNING_BIT_EXT | VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT)) return "warning";
+	if (flags & VK_DEBUG_REPORT_INFORMATION_BIT_EXT) return "info";
+	return "debug";
+}
+
+
+DebugMessageSink::DebugMessageSink() : enqueuePos_(0), dropped_(0), running_(false) {
+	for (uint32_t i = 0; i < CAPACITY; ++i) cells_[i].sequence.store(i, std::memory_order_relaxed);
+	start_ = std::chrono::steady_clock::now();
+}
+
+DebugMessageSink::~DebugMessageSink() {
+	this->Stop();
+}
+
+void DebugMessageSink::Start(const char* logPath) {
+	if (running_) return;
+
+	logPath_ = logPath;
+	log_ = fopen(logPath, "w");
+	if (!log_) printf("Failed to open debug log %s, messages are only echoed!\n", logPath);
+
+	running_ = true;
+	thread_ = std::thread(&DebugMessageSink::Run, this);
+}
+
+void DebugMessageSink::Stop() {
+	if (!running_) return;
+
+	running_ = false;
+	thread_.join();
+
+	// Flush the counts of repeats that were never followed by a written occurrence.
+	for (const auto& entry : keys_) this->WriteSummary(entry.first, entry.second);
+
+	uint64_t dropped = dropped_.load();
+	if (written_ + suppressed_ + dropped > 0) {
+		printf("Debug log: %llu written, %llu suppressed, %llu dropped -> %s\n", static_cast<unsigned long long>(written_), static_cast<unsigned long long>(suppressed_), static_cast<unsigned long long>(dropped), logPath_.c_str());
+	}
+
+	if (log_) fclose(log_);
+	log_ = nullptr;
+	keys_.clear();
+}
+
+void DebugMessageSink::PushReport(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objectType, uint64_t object, int32_t code, const char* layerPrefix, const char* text) {
+	Cell* cell = this->BeginPush();
+	if (!cell) return;
+
+	Message* message = &cell->message;
+	message->source = Source::Validation;
+	message->flags = flags;
+	message->objectType = static_cast<int32_t>(objectType);
+	message->object = object;
+	message->code = code;
+	message->call = nullptr;
+	CopyString(message->layer, layerPrefix, MAX_LAYER);
+	CopyString(message->text, text, MAX_TEXT);
+	this->EndPush(cell);
+}
+
+void DebugMessageSink::PushResult(const char* call, VkResult result, uint64_t index) {
+	Cell* cell = this->BeginPush();
+	if (!cell) return;
+
+	Message* message = &cell->message;
+	message->source = Source::Result;
+	message->flags = result < 0 ? VK_DEBUG_REPORT_ERROR_BIT_EXT : VK_DEBUG_REPORT_INFORMATION_BIT_EXT;
+	message->objectType = 0;
+	message->object = index;
+	message->code = static_cast<int32_t>(result);
+	message->call = call;
+	message->layer[0] = '\0';
+	message->text[0] = '\0';
+	this->EndPush(cell);
+}
+
+
+// Bounded multi-producer ring after Vyukov: a cell's sequence tells producers and
+// the consumer whose turn it is, so claiming a cell is a single compare-exchange.
+DebugMessageSink::Cell* DebugMessageSink::BeginPush() {
+	uint64_t pos = enqueuePos_.load(std::memory_order_relaxed);
+
+	for (;;) {
+		Cell& cell = cells_[pos % CAPACITY];
+		uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+		int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+
+		if (diff == 0) {
+			if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				cell.message.timeMs = this->ElapsedMs();
+				return &cell;
+			}
+		} else if (diff < 0) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		} else {
+			pos = enqueuePos_.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void DebugMessageSink::EndPush(Cell* cell) {
+	// Nobody else touches a claimed cell, so its sequence is still the position it was claimed at.
+	cell->sequence.store(cell->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+bool DebugMessageSink::Pop(Message& message) {
+	Cell& cell = cells_[dequeuePos_ % CAPACITY];
+	uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+	if (sequence != dequeuePos_ + 1) return false;
+
+	message = cell.message;
+	cell.sequence.store(dequeuePos_ + CAPACITY, std::memory_order_release);
+	++dequeuePos_;
+	return true;
+}
+
+void DebugMessageSink::Run() {
+	Message message;
+
+	for (;;) {
+		bool stopping = !running_.load();
+
+		bool any = false;
+		while (this->Pop(message)) {
+			this->Process(message);
+			any = true;
+		}
+
+		if (stopping) break;
+		if (!any) {
+			if (log_) fflush(log_);
+			std::this_thread::sleep_for(IDLE_SLEEP);
+		}
+	}
+
+	if (log_) fflush(log_);
+}
+
+void DebugMessageSink::Process(const Message& message) {
+	if (message.timeMs - windowStartMs_ >= REPEAT_WINDOW_MS) {
+		windowStartMs_ = message.timeMs;
+		windowLines_ = 0;
+		this->Prune(message.timeMs);
+	}
+
+	KeyState& state = keys_[Key(static_cast<int>(message.source), message.code, message.object, message.call)];
+	++state.count;
+	state.lastSeenMs = message.timeMs;
+
+	bool repeat = message.timeMs - state.lastWrittenMs < REPEAT_WINDOW_MS;
+	if (repeat || windowLines_ >= MAX_LINES_PER_WINDOW) {
+		++state.suppressed;
+		++suppressed_;
+		return;
+	}
+
+	this->Write(message, state.suppressed);
+	state.lastWrittenMs = message.timeMs;
+	state.suppressed = 0;
+	++windowLines_;
+	++written_;
+}
+
+// Objects come and go, so keys that weren't seen for a whole window are dropped. They
+// can't suppress anything anymore; what they suppressed since last written is summarized.
+void DebugMessageSink::Prune(double nowMs) {
+	for (auto it = keys_.begin(); it != keys_.end(); ) {
+		if (nowMs - it->second.lastSeenMs < REPEAT_WINDOW_MS) {
+			++it;
+			continue;
+		}
+
+		this->WriteSummary(it->first, it->second);
+		it = keys_.erase(it);
+	}
+}
+
+void DebugMessageSink::Write(const Message& message, uint64_t suppressed) {
+	bool isError = (message.flags & VK_DEBUG_REPORT_ERROR_BIT_EXT) != 0;
+
+	// Informational reports, such as the subsystems' statistics, only go to the log.
+	if (message.source == Source::Validation) {
+		if (!(message.flags & VK_DEBUG_REPORT_INFORMATION_BIT_EXT)) printf("Validation layer: %s\n", message.text);
+	} else if (isError) {
+		printf("%s failed: %d\n", message.call, message.code);
+	}
+
+	if (!log_) return;
+
+	fprintf(log_, "{\"timeMs\":%.3f,\"severity\":\"%s\",", message.timeMs, Severity(message.flags));
+	if (message.source == Source::Validation) {
+		fprintf(log_, "\"source\":\"validation\",\"code\":%d,\"objectType\":%d,\"object\":%llu,\"layer\":", message.code, message.objectType, static_cast<unsigned long long>(message.object));
+		WriteJsonString(log_, message.layer);
+		fputs(",\"message\":", log_);
+		WriteJsonString(log_, message.text);
+	} else {
+		fputs("\"source\":\"result\",\"call\":", log_);
+		WriteJsonString(log_, message.call);
+		fprintf(log_, ",\"index\":%llu,\"result\":%d", static_cast<unsigned long long>(message.object), message.code);
+	}
+	fprintf(log_, ",\"suppressed\":%llu}\n", static_cast<unsigned long long>(suppressed));
+}
+
+void DebugMessageSink::WriteSummary(const Key& key, const KeyState& state) {
+	if (state.suppressed == 0 || !log_) return;
+
+	const char* call = std::get<3>(key);
+	fputs("{\"source\":\"summary\",\"call\":", log_);
+	WriteJsonString(log_, call ? call : "");
+	fprintf(log_, ",\"code\":%d,\"object\":%llu,\"count\":%llu,\"suppressed\":%llu}\n", std::get<1>(key), static_cast<unsigned long long>(std::get<2>(key)), static_cast<unsigned long long>(state.count), static_cast<unsigned long long>(state.suppressed));
+}
+
+double DebugMessageSink::ElapsedMs() const {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+}
+
+
+DebugMessageSink& GetDebugSink() {
+	static DebugMessageSink sink;
+	return sink;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vulkan\vulkan.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+#include <tuple>
+
+
+// Collects validation messages and API results from any thread without
+// blocking it. Producers copy a fixed-size record into a lock-free bounded
+// ring; a background thread drains it, collapses repeats of the same message
+// code and object, rate-limits and writes one JSON object per line to a log.
+// Records pushed while the ring is full are dropped and counted.
+class DebugMessageSink {
+public:
+	DebugMessageSink();
+	~DebugMessageSink();
+
+	void Start(const char* logPath);
+	void Stop();
+
+	// Safe to call from any thread, including the driver's callback threads.
+	void PushReport(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objectType, uint64_t object, int32_t code, const char* layerPrefix, const char* text);
+	void PushResult(const char* call, VkResult result, uint64_t index);
+
+private:
+	static const uint32_t CAPACITY = 1024;
+	static const uint32_t MAX_TEXT = 512;
+	static const uint32_t MAX_LAYER = 32;
+
+	enum class Source {
+		Validation,
+		Result
+	};
+
+	struct Message {
+		Source source;
+		VkDebugReportFlagsEXT flags;
+		int32_t objectType;
+		uint64_t object;
+		int32_t code;
+		// Static string, only set for results.
+		const char* call;
+		double timeMs;
+		char layer[MAX_LAYER];
+		char text[MAX_TEXT];
+	};
+
+	struct Cell {
+		std::atomic<uint64_t> sequence;
+		Message message;
+	};
+
+	typedef std::tuple<int, int32_t, uint64_t, const char*> Key;
+
+	struct KeyState {
+		uint64_t count = 0;
+		uint64_t suppressed = 0;
+		double lastWrittenMs = -1e9;
+		double lastSeenMs = 0.0;
+	};
+
+private:
+	Cell* BeginPush();
+	void EndPush(Cell* cell);
+	bool Pop(Message& message);
+	void Run();
+	void Process(const Message& message);
+	void Prune(double nowMs);
+	void Write(const Message& message, uint64_t suppressed);
+	void WriteSummary(const Key& key, const KeyState& state);
+	double ElapsedMs() const;
+
+private:
+	Cell cells_[CAPACITY];
+	std::atomic<uint64_t> enqueuePos_;
+	uint64_t dequeuePos_ = 0;
+	std::atomic<uint64_t> dropped_;
+	std::chrono::steady_clock::time_point start_;
+
+	std::atomic<bool> running_;
+	std::thread thread_;
+	FILE* log_ = nullptr;
+	std::string logPath_;
+
+	// Only touched by the background thread.
+	std::map<Key, KeyState> keys_;
+	double windowStartMs_ = 0.0;
+	uint32_t windowLines_ = 0;
+	uint64_t written_ = 0;
+	uint64_t suppressed_ = 0;
+};
+
+// The process-wide sink; the debug callback and every subsystem report to it.
+DebugMessageSink& GetDebugSink();
+
+// Replaces printf("vkX result: %d") diagnostics. Failures are also echoed to the console.
+inline void LogResult(const char* call, VkResult result, uint64_t index = 0) {
+	GetDebugSink().PushResult(call, result, index);
+}
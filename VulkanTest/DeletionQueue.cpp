@@ -0,0 +1,91 @@
+#include "DeletionQueue.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "DebugMessageSink.h"
+
+
+void DeletionQueue::Init(const GpuContext& context, GpuScheduler* scheduler) {
+	context_ = context;
+	scheduler_ = scheduler;
+}
+
+void DeletionQueue::Flush(size_t maxCount) {
+	GpuTicket completed = scheduler_->CompletedTicket();
+
+	// Entries are released in submission order, so the first one still in use ends the flush.
+	for (size_t count = 0; count < maxCount && !entries_.empty() && entries_.front().ticket <= completed; ++count) {
+		this->Destroy(entries_.front());
+		entries_.pop_front();
+	}
+
+	if (++reportFlushes_ == REPORT_INTERVAL) this->Report();
+}
+
+void DeletionQueue::FlushAll() {
+	for (Entry& entry : entries_) this->Destroy(entry);
+	entries_.clear();
+}
+
+void DeletionQueue::DestroyFramebuffer(VkFramebuffer framebuffer) {
+	this->Push(scheduler_->LastSubmitted(), [this, framebuffer]() { context_.dispatch->DestroyFramebuffer(context_.device, framebuffer, nullptr); });
+}
+
+void DeletionQueue::DestroyImageView(VkImageView view) {
+	this->Push(scheduler_->LastSubmitted(), [this, view]() { context_.dispatch->DestroyImageView(context_.device, view, nullptr); });
+}
+
+void DeletionQueue::DestroyDescriptorPool(VkDescriptorPool pool) {
+	this->Push(scheduler_->LastSubmitted(), [this, pool]() { context_.dispatch->DestroyDescriptorPool(context_.device, pool, nullptr); });
+}
+
+void DeletionQueue::DestroySwapchainKHR(VkSwapchainKHR swapchain, GpuTicket afterPresent) {
+	// Entries have to stay in submission order for Flush.
+	this->Push(std::max(afterPresent, scheduler_->LastSubmitted()), [this, swapchain]() { context_.dispatch->DestroySwapchainKHR(context_.device, swapchain, nullptr); });
+}
+
+void DeletionQueue::DestroyImage(GpuImage& image) {
+	if (image.image == VK_NULL_HANDLE) return;
+
+	GpuImage released = image;
+	image = GpuImage();
+	this->Push(scheduler_->LastSubmitted(), [this, released]() mutable { ::DestroyImage(context_, released); });
+}
+
+void DeletionQueue::DestroyBuffer(GpuBuffer& buffer) {
+	if (buffer.buffer == VK_NULL_HANDLE) return;
+
+	GpuBuffer released = buffer;
+	buffer = GpuBuffer();
+	this->Push(scheduler_->LastSubmitted(), [this, released]() mutable { ::DestroyBuffer(context_, released); });
+}
+
+
+void DeletionQueue::Push(GpuTicket ticket, std::function<void()> destroy) {
+	entries_.push_back({ ticket, std::chrono::steady_clock::now(), std::move(destroy) });
+	maxDepth_ = std::max(maxDepth_, entries_.size());
+}
+
+void DeletionQueue::Destroy(Entry& entry) {
+	entry.destroy();
+
+	double latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - entry.released).count();
+	totalLatencyMs_ += latencyMs;
+	maxLatencyMs_ = std::max(maxLatencyMs_, latencyMs);
+	++destroyed_;
+}
+
+void DeletionQueue::Report() {
+	if (destroyed_ > 0) {
+		char text[128];
+		snprintf(text, sizeof(text), "Deletion queue: %llu destroyed, depth %d (max %d), latency avg %.2f ms (max %.2f ms)", static_cast<unsigned long long>(destroyed_), static_cast<int>(entries_.size()), static_cast<int>(maxDepth_), totalLatencyMs_ / destroyed_, maxLatencyMs_);
+		GetDebugSink().PushReport(VK_DEBUG_REPORT_INFORMATION_BIT_EXT, VK_DEBUG_REPORT_OBJECT_TYPE_UNKNOWN_EXT, 0, 0, "DeletionQueue", text);
+	}
+
+	reportFlushes_ = 0;
+	destroyed_ = 0;
+	maxDepth_ = entries_.size();
+	totalLatencyMs_ = 0.0;
+	maxLatencyMs_ = 0.0;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+
+#include "GpuResources.h"
+#include "GpuScheduler.h"
+
+
+// Defers destroying Vulkan objects until the GPU has finished every submission
+// that was made before they were released, so replacing resources (resizes,
+// pipeline swaps, streaming) never has to wait for the device to go idle.
+class DeletionQueue {
+public:
+	void Init(const GpuContext& context, GpuScheduler* scheduler);
+
+	// Destroys what the GPU is done with, at most maxCount objects per call so
+	// that releasing a lot at once is spread over several frames.
+	void Flush(size_t maxCount = MAX_DESTROYS_PER_FLUSH);
+	// Destroys everything; only call once the device is idle.
+	void FlushAll();
+
+	void DestroyFramebuffer(VkFramebuffer framebuffer);
+	void DestroyImageView(VkImageView view);
+	void DestroyDescriptorPool(VkDescriptorPool pool);
+	// Presents have no ticket, so afterPresent has to be a submission that is ordered
+	// after the swap chain's last present.
+	void DestroySwapchainKHR(VkSwapchainKHR swapchain, GpuTicket afterPresent);
+	// Take over the resource and clear it. Images and buffers have no owning wrapper, so
+	// whoever holds one releases it through these.
+	void DestroyImage(GpuImage& image);
+	void DestroyBuffer(GpuBuffer& buffer);
+
+	size_t Depth() const { return entries_.size(); }
+
+private:
+	static const size_t MAX_DESTROYS_PER_FLUSH = 64;
+	static const int REPORT_INTERVAL = 300;
+
+	struct Entry {
+		GpuTicket ticket;
+		std::chrono::steady_clock::time_point released;
+		std::function<void()> destroy;
+	};
+
+private:
+	void Push(GpuTicket ticket, std::function<void()> destroy);
+	void Destroy(Entry& entry);
+	void Report();
+
+private:
+	GpuContext context_;
+	GpuScheduler* scheduler_ = nullptr;
+	std::deque<Entry> entries_;
+
+	int reportFlushes_ = 0;
+	uint64_t destroyed_ = 0;
+	size_t maxDepth_ = 0;
+	double totalLatencyMs_ = 0.0;
+	double maxLatencyMs_ = 0.0;
+};
+
+
+// Owns a handle and hands it to the deletion queue when it is reset, replaced or goes out of scope.
+template <typename T, void (DeletionQueue::*Destroy)(T)>
+class UniqueHandle {
+public:
+	UniqueHandle() = default;
+	UniqueHandle(DeletionQueue& queue, T handle) : queue_(&queue), handle_(handle) { }
+	UniqueHandle(UniqueHandle&& other) : queue_(other.queue_), handle_(other.Release()) { }
+	UniqueHandle(const UniqueHandle&) = delete;
+	~UniqueHandle() { this->Reset(); }
+
+	UniqueHandle& operator=(UniqueHandle&& other) {
+		if (this != &other) {
+			this->Reset();
+			queue_ = other.queue_;
+			handle_ = other.Release();
+		}
+		return *this;
+	}
+	UniqueHandle& operator=(const UniqueHandle&) = delete;
+
+	T Get() const { return handle_; }
+
+	T Release() {
+		T handle = handle_;
+		handle_ = VK_NULL_HANDLE;
+		return handle;
+	}
+
+	void Reset() {
+		if (handle_ != VK_NULL_HANDLE) (queue_->*Destroy)(handle_);
+		handle_ = VK_NULL_HANDLE;
+	}
+
+private:
+	DeletionQueue* queue_ = nullptr;
+	T handle_ = VK_NULL_HANDLE;
+};
+
+typedef UniqueHandle<VkFramebuffer, &DeletionQueue::DestroyFramebuffer> UniqueFramebuffer;
+typedef UniqueHandle<VkImageView, &DeletionQueue::DestroyImageView> UniqueImageView;
+typedef UniqueHandle<VkDescriptorPool, &DeletionQueue::DestroyDescriptorPool> UniqueDescriptorPool;
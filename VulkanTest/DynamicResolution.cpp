@@ -0,0 +1,62 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+
+static const float MIN_SCALE = 0.5f;
+static const float MAX_SCALE = 1.0f;
+// Dropping resolution has to be quick to save the next frames; raising it again can be slow.
+static const float MAX_STEP_DOWN = 0.1f;
+static const float MAX_STEP_UP = 0.02f;
+// The scale holds while the frame time is within this band of the budget, so it doesn't oscillate.
+static const double LOWER_UTILIZATION = 0.8;
+static const double UPPER_UTILIZATION = 0.95;
+static const double TARGET_UTILIZATION = 0.875;
+static const double SMOOTHING = 0.2;
+// Extents are rounded to the compute group size of the post-processing.
+static const uint32_t EXTENT_GRANULARITY = 8;
+
+
+void DynamicResolution::Configure(bool enabled, double budgetMs) {
+	enabled_ = enabled;
+	budgetMs_ = budgetMs;
+	scale_ = MAX_SCALE;
+	smoothedMs_ = 0.0;
+}
+
+void DynamicResolution::SetMaxExtent(VkExtent2D maxExtent) {
+	maxExtent_ = maxExtent;
+}
+
+void DynamicResolution::Update(double gpuMs) {
+	if (!enabled_ || gpuMs <= 0.0) return;
+
+	smoothedMs_ = smoothedMs_ > 0.0 ? smoothedMs_ + SMOOTHING * (gpuMs - smoothedMs_) : gpuMs;
+
+	double utilization = smoothedMs_ / budgetMs_;
+	if (utilization < LOWER_UTILIZATION || utilization > UPPER_UTILIZATION) {
+		// The cost of the scaled passes goes with the pixel count, which is quadratic in the scale.
+		float target = scale_ * static_cast<float>(std::sqrt(TARGET_UTILIZATION / utilization));
+		target = std::min(scale_ + MAX_STEP_UP, std::max(scale_ - MAX_STEP_DOWN, target));
+		scale_ = std::min(MAX_SCALE, std::max(MIN_SCALE, target));
+	}
+
+	if (++reportFrames_ == REPORT_INTERVAL) {
+		VkExtent2D extent = this->RenderExtent();
+		printf("Render scale: %.2f (%ux%u), GPU %.2f ms of %.2f ms budget\n", scale_, extent.width, extent.height, smoothedMs_, budgetMs_);
+		reportFrames_ = 0;
+	}
+}
+
+VkExtent2D DynamicResolution::RenderExtent() const {
+	if (!enabled_ || scale_ >= MAX_SCALE) return maxExtent_;
+
+	auto scaled = [this](uint32_t size) {
+		uint32_t rounded = static_cast<uint32_t>(size * scale_) / EXTENT_GRANULARITY * EXTENT_GRANULARITY;
+		return std::min(size, std::max(EXTENT_GRANULARITY, rounded));
+	};
+
+	return { scaled(maxExtent_.width), scaled(maxExtent_.height) };
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vulkan\vulkan.h>
+
+
+// Picks the resolution the scene is rendered at so that the measured GPU frame
+// time stays within a budget. Render targets are allocated at the maximum
+// extent once and only a corner of them is used, so scaling never allocates.
+class DynamicResolution {
+public:
+	void Configure(bool enabled, double budgetMs);
+	void SetMaxExtent(VkExtent2D maxExtent);
+
+	// Feeds the GPU time of a finished frame.
+	void Update(double gpuMs);
+
+	VkExtent2D RenderExtent() const;
+	float Scale() const { return scale_; }
+
+private:
+	static const int REPORT_INTERVAL = 300;
+
+private:
+	bool enabled_ = true;
+	double budgetMs_ = 0.0;
+	VkExtent2D maxExtent_ = { 0, 0 };
+	float scale_ = 1.0f;
+	double smoothedMs_ = 0.0;
+	int reportFrames_ = 0;
+};
@@ -0,0 +1,164 @@
+#include "FrameTrace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+static const char TRACE_MAGIC[4] = { 'V', 'K', 'T', 'R' };
+static const uint32_t TRACE_VERSION = 2;
+
+static const uint32_t TRACE_OCCLUSION_CULLING = 1;
+static const uint32_t TRACE_COMPARE_OCCLUSION_CULLING = 2;
+
+// The header is followed by the frames, each a TraceFrameHeader, its ranges and then
+// the instances of all ranges. Instances are stored raw, so their size is checked.
+struct TraceHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t instanceSize;
+	uint32_t width;
+	uint32_t height;
+	uint32_t vertexFormat;
+	uint32_t flags;
+	uint32_t instanceCapacity;
+	uint32_t indexCount;
+	uint32_t lightCount;
+	uint32_t frameCount;
+};
+
+struct TraceFrameHeader {
+	double timeMs;
+	float sceneTime;
+	uint32_t width;
+	uint32_t height;
+	Camera camera;
+	uint32_t instanceCount;
+	uint32_t rangeCount;
+};
+
+
+void TraceWriter::Open(const std::string& filename, const TraceSettings& settings) {
+	this->Close();
+
+	file_ = fopen(filename.c_str(), "wb");
+	if (!file_) throw std::runtime_error("Failed to open trace for writing!");
+	settings_ = settings;
+	settings_.frameCount = 0;
+	bytes_ = 0;
+
+	if (!this->WriteHeader()) throw std::runtime_error("Failed to write trace!");
+}
+
+void TraceWriter::Write(const TraceFrame& frame) {
+	if (!file_) return;
+
+	TraceFrameHeader header = { };
+	header.timeMs = frame.timeMs;
+	header.sceneTime = frame.sceneTime;
+	header.width = frame.renderExtent.width;
+	header.height = frame.renderExtent.height;
+	header.camera = frame.camera;
+	header.instanceCount = frame.instanceCount;
+	header.rangeCount = static_cast<uint32_t>(frame.ranges.size());
+
+	bool written = fwrite(&header, sizeof(header), 1, file_) == 1;
+	if (!frame.ranges.empty()) written = written && fwrite(frame.ranges.data(), sizeof(SceneRange), frame.ranges.size(), file_) == frame.ranges.size();
+	if (!frame.instances.empty()) written = written && fwrite(frame.instances.data(), sizeof(InstanceData), frame.instances.size(), file_) == frame.instances.size();
+	if (!written) throw std::runtime_error("Failed to write trace!");
+
+	bytes_ += sizeof(header) + frame.ranges.size() * sizeof(SceneRange) + frame.instances.size() * sizeof(InstanceData);
+	settings_.extent.width = std::max(settings_.extent.width, frame.renderExtent.width);
+	settings_.extent.height = std::max(settings_.extent.height, frame.renderExtent.height);
+	++settings_.frameCount;
+}
+
+void TraceWriter::Close() {
+	if (!file_) return;
+
+	// Also called from the destructor, so a failure is only reported.
+	bool finished = fseek(file_, 0, SEEK_SET) == 0 && this->WriteHeader();
+	finished = fclose(file_) == 0 && finished;
+	file_ = nullptr;
+
+	if (!finished) puts("Failed to finish trace, it can't be replayed!");
+	else printf("Captured %u frames, %.1f KB per frame\n", settings_.frameCount, settings_.frameCount ? bytes_ / 1024.0 / settings_.frameCount : 0.0);
+}
+
+bool TraceWriter::WriteHeader() {
+	TraceHeader header = { };
+	memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	header.version = TRACE_VERSION;
+	header.instanceSize = sizeof(InstanceData);
+	header.width = settings_.extent.width;
+	header.height = settings_.extent.height;
+	header.vertexFormat = static_cast<uint32_t>(settings_.vertexFormat);
+	header.flags = (settings_.occlusionCulling ? TRACE_OCCLUSION_CULLING : 0) | (settings_.compareOcclusionCulling ? TRACE_COMPARE_OCCLUSION_CULLING : 0);
+	header.instanceCapacity = settings_.instanceCapacity;
+	header.indexCount = settings_.indexCount;
+	header.lightCount = settings_.lightCount;
+	header.frameCount = settings_.frameCount;
+
+	return fwrite(&header, sizeof(header), 1, file_) == 1;
+}
+
+
+void ReadTrace(const std::string& filename, TraceSettings& settings, std::vector<TraceFrame>& frames) {
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (!file) throw std::runtime_error("Failed to open trace!");
+
+	auto read = [file](void* data, size_t size, size_t count) {
+		if (count && fread(data, size, count, file) != count) {
+			fclose(file);
+			throw std::runtime_error("Trace is truncated!");
+		}
+	};
+
+	TraceHeader header;
+	read(&header, sizeof(header), 1);
+	if (memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 || header.version != TRACE_VERSION || header.instanceSize != sizeof(InstanceData) ||
+		header.vertexFormat >= static_cast<uint32_t>(VERTEX_FORMAT_COUNT) || header.width == 0 || header.height == 0) {
+		fclose(file);
+		throw std::runtime_error("Invalid trace, or one captured by an incompatible build!");
+	}
+
+	settings.extent = { header.width, header.height };
+	settings.vertexFormat = static_cast<VertexFormat>(header.vertexFormat);
+	settings.occlusionCulling = (header.flags & TRACE_OCCLUSION_CULLING) != 0;
+	settings.compareOcclusionCulling = (header.flags & TRACE_COMPARE_OCCLUSION_CULLING) != 0;
+	settings.instanceCapacity = header.instanceCapacity;
+	settings.indexCount = header.indexCount;
+	settings.lightCount = header.lightCount;
+	settings.frameCount = header.frameCount;
+
+	// Frames are added as they are read, so a corrupt count fails as a truncated trace.
+	frames.clear();
+	for (uint32_t i = 0; i < header.frameCount; ++i) {
+		frames.emplace_back();
+		TraceFrame& frame = frames.back();
+		TraceFrameHeader frameHeader;
+		read(&frameHeader, sizeof(frameHeader), 1);
+
+		frame.timeMs = frameHeader.timeMs;
+		frame.sceneTime = frameHeader.sceneTime;
+		frame.renderExtent = { std::min(frameHeader.width, header.width), std::min(frameHeader.height, header.height) };
+		frame.camera = frameHeader.camera;
+		frame.instanceCount = std::min(frameHeader.instanceCount, header.instanceCapacity);
+
+		frame.ranges.resize(frameHeader.rangeCount);
+		read(frame.ranges.data(), sizeof(SceneRange), frame.ranges.size());
+
+		size_t instanceCount = 0;
+		for (const SceneRange& range : frame.ranges) {
+			if (range.first > header.instanceCapacity || range.count > header.instanceCapacity - range.first) {
+				fclose(file);
+				throw std::runtime_error("Invalid trace, or one captured by an incompatible build!");
+			}
+			instanceCount += range.count;
+		}
+		frame.instances.resize(instanceCount);
+		read(frame.instances.data(), sizeof(InstanceData), frame.instances.size());
+	}
+
+	fclose(file);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+#include "InstanceBuffer.h"
+#include "Mesh.h"
+
+
+// What the renderer was set up with when a trace was captured. Replay creates the
+// same pipelines and resources from it and refuses traces whose scene doesn't match.
+struct TraceSettings {
+	// The largest extent any frame was rendered at; replay allocates its targets at this size.
+	VkExtent2D extent = { 0, 0 };
+	VertexFormat vertexFormat = VertexFormat::Quantized;
+	bool occlusionCulling = true;
+	bool compareOcclusionCulling = false;
+	uint32_t instanceCapacity = 0;
+	uint32_t indexCount = 0;
+	uint32_t lightCount = 0;
+	uint32_t frameCount = 0;
+};
+
+// Everything that varies between frames: the instance uploads and the draw parameters.
+// Pipelines, meshes and the descriptor layout follow from the settings.
+struct TraceFrame {
+	// When the frame started, relative to the first captured frame.
+	double timeMs = 0.0;
+	// The time the scene was animated to, in seconds, which places the lights.
+	float sceneTime = 0.0f;
+	VkExtent2D renderExtent = { 0, 0 };
+	Camera camera;
+	uint32_t instanceCount = 0;
+	std::vector<SceneRange> ranges;
+	// The instances of every range, back to back.
+	std::vector<InstanceData> instances;
+};
+
+// Streams frames to a binary trace. The header is rewritten on Close, once the frame
+// count and largest extent are known.
+class TraceWriter {
+public:
+	TraceWriter() = default;
+	TraceWriter(const TraceWriter&) = delete;
+	TraceWriter& operator=(const TraceWriter&) = delete;
+	~TraceWriter() { this->Close(); }
+
+	void Open(const std::string& filename, const TraceSettings& settings);
+	void Write(const TraceFrame& frame);
+	void Close();
+
+	bool IsOpen() const { return file_ != nullptr; }
+
+private:
+	bool WriteHeader();
+
+private:
+	FILE* file_ = nullptr;
+	TraceSettings settings_;
+	uint64_t bytes_ = 0;
+};
+
+// Loads a whole trace up front, so replay never waits on the disk.
+void ReadTrace(const std::string& filename, TraceSettings& settings, std::vector<TraceFrame>& frames);
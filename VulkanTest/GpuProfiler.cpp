@@ -0,0 +1,123 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+
+static const char* passNames[GPU_PASS_COUNT] = { "lights", "scene", "post", "composite", "overlay" };
+
+
+const char* GpuPassName(GpuPass pass) {
+	return passNames[static_cast<int>(pass)];
+}
+
+
+double GpuFrameTimings::DurationMs(GpuPass pass) const {
+	int i = static_cast<int>(pass);
+	return valid[i] ? endMs[i] - beginMs[i] : 0.0;
+}
+
+double GpuFrameTimings::TotalMs() const {
+	double total = 0.0;
+	for (int i = 0; i < GPU_PASS_COUNT; ++i) total += this->DurationMs(static_cast<GpuPass>(i));
+	return total;
+}
+
+
+void GpuProfiler::Init(const GpuContext& context, float timestampPeriod, uint32_t graphicsTimestampBits, uint32_t computeTimestampBits, int slotCount) {
+	context_ = context;
+	timestampPeriodMs_ = timestampPeriod / 1e6;
+	graphicsMask_ = graphicsTimestampBits >= 64 ? ~0ull : (1ull << graphicsTimestampBits) - 1;
+	computeMask_ = computeTimestampBits >= 64 ? ~0ull : (1ull << computeTimestampBits) - 1;
+	slots_.resize(slotCount);
+
+	VkQueryPoolCreateInfo queryPoolInfo = { };
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.pNext = nullptr;
+	queryPoolInfo.flags = 0;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = 2 * GPU_PASS_COUNT;
+	queryPoolInfo.pipelineStatistics = 0;
+
+	for (Slot& slot : slots_) {
+		VkResult result = context_.dispatch->CreateQueryPool(context_.device, &queryPoolInfo, nullptr, &slot.queryPool);
+		if (result != VK_SUCCESS) throw std::runtime_error("Failed to create timestamp query pool!");
+	}
+}
+
+void GpuProfiler::Destroy() {
+	for (Slot& slot : slots_) context_.dispatch->DestroyQueryPool(context_.device, slot.queryPool, nullptr);
+	slots_.clear();
+}
+
+void GpuProfiler::Begin(VkCommandBuffer commandBuffer, int slot, GpuPass pass) {
+	if (!this->Supported(pass)) return;
+
+	uint32_t query = 2 * static_cast<uint32_t>(pass);
+	context_.dispatch->CmdResetQueryPool(commandBuffer, slots_[slot].queryPool, query, 2);
+	context_.dispatch->CmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slots_[slot].queryPool, query);
+}
+
+void GpuProfiler::End(VkCommandBuffer commandBuffer, int slot, GpuPass pass) {
+	if (!this->Supported(pass)) return;
+
+	uint32_t query = 2 * static_cast<uint32_t>(pass) + 1;
+	context_.dispatch->CmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slots_[slot].queryPool, query);
+	slots_[slot].written[static_cast<int>(pass)] = true;
+}
+
+bool GpuProfiler::Resolve(int slot) {
+	GpuFrameTimings timings;
+	bool any = false;
+
+	for (int i = 0; i < GPU_PASS_COUNT; ++i) {
+		if (!slots_[slot].written[i]) continue;
+		slots_[slot].written[i] = false;
+
+		// Pairs of (timestamp, availability).
+		uint64_t data[4] = { };
+		VkResult result = context_.dispatch->GetQueryPoolResults(context_.device, slots_[slot].queryPool, 2 * i, 2, sizeof(data), data, 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		if (result != VK_SUCCESS || !data[1] || !data[3]) continue;
+
+		uint64_t mask = static_cast<GpuPass>(i) == GpuPass::PostProcess ? computeMask_ : graphicsMask_;
+		timings.valid[i] = true;
+		timings.beginMs[i] = (data[0] & mask) * timestampPeriodMs_;
+		timings.endMs[i] = (data[2] & mask) * timestampPeriodMs_;
+		any = true;
+	}
+
+	if (!any) return false;
+
+	// The previous frame's post-processing was submitted to run alongside this frame's scene pass.
+	int post = static_cast<int>(GpuPass::PostProcess);
+	int scene = static_cast<int>(GpuPass::Scene);
+	lastOverlapMs_ = 0.0;
+	if (lastFrame_.valid[post] && timings.valid[scene]) {
+		lastOverlapMs_ = std::max(0.0, std::min(lastFrame_.endMs[post], timings.endMs[scene]) - std::max(lastFrame_.beginMs[post], timings.beginMs[scene]));
+	}
+	lastFrame_ = timings;
+
+	for (int i = 0; i < GPU_PASS_COUNT; ++i) passTotalMs_[i] += timings.DurationMs(static_cast<GpuPass>(i));
+	overlapTotalMs_ += lastOverlapMs_;
+	if (++reportFrames_ == REPORT_INTERVAL) this->Report();
+
+	return true;
+}
+
+
+bool GpuProfiler::Supported(GpuPass pass) const {
+	return (pass == GpuPass::PostProcess ? computeMask_ : graphicsMask_) != 0;
+}
+
+void GpuProfiler::Report() {
+	printf("GPU (avg of %d frames):", reportFrames_);
+	for (int i = 0; i < GPU_PASS_COUNT; ++i) printf(" %s %.3f ms,", passNames[i], passTotalMs_[i] / reportFrames_);
+
+	double postMs = passTotalMs_[static_cast<int>(GpuPass::PostProcess)];
+	printf(" async overlap %.3f ms (%.0f%% of post)\n", overlapTotalMs_ / reportFrames_, postMs > 0.0 ? 100.0 * overlapTotalMs_ / postMs : 0.0);
+
+	reportFrames_ = 0;
+	overlapTotalMs_ = 0.0;
+	for (int i = 0; i < GPU_PASS_COUNT; ++i) passTotalMs_[i] = 0.0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "GpuResources.h"
+
+
+enum class GpuPass {
+	Lights,
+	Scene,
+	PostProcess,
+	Composite,
+	Overlay,
+	Count
+};
+
+const int GPU_PASS_COUNT = static_cast<int>(GpuPass::Count);
+
+const char* GpuPassName(GpuPass pass);
+
+// Begin and end timestamps of each pass of one frame, in milliseconds on the
+// device's timestamp clock, which all queues share.
+struct GpuFrameTimings {
+	bool valid[GPU_PASS_COUNT] = { };
+	double beginMs[GPU_PASS_COUNT] = { };
+	double endMs[GPU_PASS_COUNT] = { };
+
+	double DurationMs(GpuPass pass) const;
+	double TotalMs() const;
+};
+
+// Timestamps every pass of a frame slot and reads them back once the slot's
+// ticket has completed, so reading never stalls. Prints running averages,
+// including how much of the async post-processing ran under the next frame's
+// scene pass.
+class GpuProfiler {
+public:
+	void Init(const GpuContext& context, float timestampPeriod, uint32_t graphicsTimestampBits, uint32_t computeTimestampBits, int slotCount);
+	void Destroy();
+
+	void Begin(VkCommandBuffer commandBuffer, int slot, GpuPass pass);
+	void End(VkCommandBuffer commandBuffer, int slot, GpuPass pass);
+	// Returns whether the slot had finished timings to read.
+	bool Resolve(int slot);
+
+	const GpuFrameTimings& LastFrame() const { return lastFrame_; }
+	double LastOverlapMs() const { return lastOverlapMs_; }
+
+private:
+	static const int REPORT_INTERVAL = 300;
+
+	struct Slot {
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		bool written[GPU_PASS_COUNT] = { };
+	};
+
+private:
+	bool Supported(GpuPass pass) const;
+	void Report();
+
+private:
+	GpuContext context_;
+	double timestampPeriodMs_ = 0.0;
+	uint64_t graphicsMask_ = 0;
+	uint64_t computeMask_ = 0;
+	std::vector<Slot> slots_;
+
+	GpuFrameTimings lastFrame_;
+	double lastOverlapMs_ = 0.0;
+	int reportFrames_ = 0;
+	double passTotalMs_[GPU_PASS_COUNT] = { };
+	double overlapTotalMs_ = 0.0;
+};
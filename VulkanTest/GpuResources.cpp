@@ -0,0 +1,227 @@
+#include "GpuResources.h"
+
+#include "DebugMessageSink.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+
+static std::atomic<uint64_t> allocatedBytes(0);
+static std::atomic<uint64_t> peakAllocatedBytes(0);
+
+static void TrackAllocation(VkDeviceSize size) {
+	uint64_t current = allocatedBytes += size;
+	uint64_t peak = peakAllocatedBytes.load();
+	while (current > peak && !peakAllocatedBytes.compare_exchange_weak(peak, current)) { }
+}
+
+static void TrackFree(VkDeviceSize size) {
+	allocatedBytes -= size;
+}
+
+uint32_t FindMemoryType(const GpuContext& context, uint32_t typeBits, VkMemoryPropertyFlags properties) {
+	for (uint32_t i = 0; i < context.memoryProperties.memoryTypeCount; ++i) {
+		if ((typeBits & (1 << i)) && (context.memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) return i;
+	}
+
+	throw std::runtime_error("Failed to find suitable memory type!");
+}
+
+GpuImage CreateImage2D(const GpuContext& context, VkFormat format, VkExtent2D extent, uint32_t mipLevels, VkImageUsageFlags usage, VkImageAspectFlags aspect) {
+	const DeviceDispatch& vk = *context.dispatch;
+	GpuImage image;
+	image.format = format;
+	image.extent = extent;
+	image.mipLevels = mipLevels;
+
+	VkImageCreateInfo imageInfo = { };
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.pNext = nullptr;
+	imageInfo.flags = 0;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = format;
+	imageInfo.extent = { extent.width, extent.height, 1 };
+	imageInfo.mipLevels = mipLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = usage;
+	if (context.queueFamilies.size() > 1) {
+		imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(context.queueFamilies.size());
+		imageInfo.pQueueFamilyIndices = context.queueFamilies.data();
+	} else {
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.queueFamilyIndexCount = 0;
+		imageInfo.pQueueFamilyIndices = nullptr;
+	}
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkResult result = vk.CreateImage(context.device, &imageInfo, nullptr, &image.image);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create image!");
+
+	VkMemoryRequirements memoryRequirements;
+	vk.GetImageMemoryRequirements(context.device, image.image, &memoryRequirements);
+
+	VkMemoryAllocateInfo allocateInfo = { };
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.pNext = nullptr;
+	allocateInfo.allocationSize = memoryRequirements.size;
+	allocateInfo.memoryTypeIndex = FindMemoryType(context, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	result = vk.AllocateMemory(context.device, &allocateInfo, nullptr, &image.memory);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to allocate image memory!");
+	image.memorySize = allocateInfo.allocationSize;
+	TrackAllocation(image.memorySize);
+	vk.BindImageMemory(context.device, image.image, image.memory, 0);
+
+	image.view = CreateImageView(context, image.image, format, 0, mipLevels, aspect);
+	return image;
+}
+
+VkImageView CreateImageView(const GpuContext& context, VkImage image, VkFormat format, uint32_t baseMipLevel, uint32_t levelCount, VkImageAspectFlags aspect) {
+	VkImageViewCreateInfo viewInfo = { };
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.pNext = nullptr;
+	viewInfo.flags = 0;
+	viewInfo.image = image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.subresourceRange.aspectMask = aspect;
+	viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+	viewInfo.subresourceRange.levelCount = levelCount;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	VkImageView view;
+	VkResult result = context.dispatch->CreateImageView(context.device, &viewInfo, nullptr, &view);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create image view!");
+
+	return view;
+}
+
+void DestroyImage(const GpuContext& context, GpuImage& image) {
+	const DeviceDispatch& vk = *context.dispatch;
+
+	if (image.view != VK_NULL_HANDLE) vk.DestroyImageView(context.device, image.view, nullptr);
+	if (image.image != VK_NULL_HANDLE) vk.DestroyImage(context.device, image.image, nullptr);
+	if (image.memory != VK_NULL_HANDLE) {
+		vk.FreeMemory(context.device, image.memory, nullptr);
+		TrackFree(image.memorySize);
+	}
+	image = GpuImage();
+}
+
+GpuBuffer CreateBuffer(const GpuContext& context, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+	const DeviceDispatch& vk = *context.dispatch;
+	GpuBuffer buffer;
+	buffer.size = size;
+
+	VkBufferCreateInfo bufferInfo = { };
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.pNext = nullptr;
+	bufferInfo.flags = 0;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	if (context.queueFamilies.size() > 1) {
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(context.queueFamilies.size());
+		bufferInfo.pQueueFamilyIndices = context.queueFamilies.data();
+	} else {
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		bufferInfo.queueFamilyIndexCount = 0;
+		bufferInfo.pQueueFamilyIndices = nullptr;
+	}
+
+	VkResult result = vk.CreateBuffer(context.device, &bufferInfo, nullptr, &buffer.buffer);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create buffer!");
+
+	VkMemoryRequirements memoryRequirements;
+	vk.GetBufferMemoryRequirements(context.device, buffer.buffer, &memoryRequirements);
+
+	VkMemoryAllocateInfo allocateInfo = { };
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.pNext = nullptr;
+	allocateInfo.allocationSize = memoryRequirements.size;
+	allocateInfo.memoryTypeIndex = FindMemoryType(context, memoryRequirements.memoryTypeBits, properties);
+
+	result = vk.AllocateMemory(context.device, &allocateInfo, nullptr, &buffer.memory);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to allocate buffer memory!");
+	buffer.memorySize = allocateInfo.allocationSize;
+	TrackAllocation(buffer.memorySize);
+	vk.BindBufferMemory(context.device, buffer.buffer, buffer.memory, 0);
+
+	if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		result = vk.MapMemory(context.device, buffer.memory, 0, VK_WHOLE_SIZE, 0, &buffer.mapped);
+		if (result != VK_SUCCESS) throw std::runtime_error("Failed to map buffer memory!");
+	}
+
+	return buffer;
+}
+
+void DestroyBuffer(const GpuContext& context, GpuBuffer& buffer) {
+	const DeviceDispatch& vk = *context.dispatch;
+
+	if (buffer.buffer != VK_NULL_HANDLE) vk.DestroyBuffer(context.device, buffer.buffer, nullptr);
+	if (buffer.memory != VK_NULL_HANDLE) {
+		vk.FreeMemory(context.device, buffer.memory, nullptr);
+		TrackFree(buffer.memorySize);
+	}
+	buffer = GpuBuffer();
+}
+
+DeviceMemoryUsage GetDeviceMemoryUsage() {
+	DeviceMemoryUsage usage;
+	usage.currentBytes = allocatedBytes.load();
+	usage.peakBytes = peakAllocatedBytes.load();
+	return usage;
+}
+
+VkShaderModule CreateShaderModule(const GpuContext& context, const ShaderCode& code) {
+	VkShaderModuleCreateInfo createInfo = { };
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.pNext = nullptr;
+	createInfo.flags = 0;
+	createInfo.codeSize = code.size;
+	createInfo.pCode = code.words;
+
+	VkShaderModule shaderModule;
+	VkResult result = context.dispatch->CreateShaderModule(context.device, &createInfo, nullptr, &shaderModule);
+	LogResult("vkCreateShaderModule", result);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create shader module!");
+
+	return shaderModule;
+}
+
+VkPipeline CreateComputePipeline(const GpuContext& context, VkPipelineLayout layout, const ShaderCode& code) {
+	VkShaderModule shaderModule = CreateShaderModule(context, code);
+
+	VkComputePipelineCreateInfo pipelineInfo = { };
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext = nullptr;
+	pipelineInfo.flags = 0;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.pNext = nullptr;
+	pipelineInfo.stage.flags = 0;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.stage.pSpecializationInfo = nullptr;
+	pipelineInfo.layout = layout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	VkPipeline pipeline;
+	VkResult result = context.dispatch->CreateComputePipelines(context.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+	LogResult("vkCreateComputePipelines", result);
+	context.dispatch->DestroyShaderModule(context.device, shaderModule, nullptr);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create compute pipeline!");
+
+	return pipeline;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include "VulkanDispatch.h"
+
+
+class DeletionQueue;
+
+// What a subsystem needs to create and destroy its own GPU resources.
+struct GpuContext {
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	const DeviceDispatch* dispatch = nullptr;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	// Every queue family that touches shared resources; more than one makes them concurrent.
+	std::vector<uint32_t> queueFamilies;
+	// Where resources that in-flight frames may still use are released to.
+	DeletionQueue* deletionQueue = nullptr;
+};
+
+struct GpuImage {
+	VkImage image = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent = { 0, 0 };
+	uint32_t mipLevels = 0;
+	VkDeviceSize memorySize = 0;
+};
+
+struct GpuBuffer {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	VkDeviceSize memorySize = 0;
+	void* mapped = nullptr;
+};
+
+// SPIR-V that is already 4 byte aligned, usually in place in the mapped shader bundle.
+struct ShaderCode {
+	const uint32_t* words = nullptr;
+	size_t size = 0;
+};
+
+
+uint32_t FindMemoryType(const GpuContext& context, uint32_t typeBits, VkMemoryPropertyFlags properties);
+
+GpuImage CreateImage2D(const GpuContext& context, VkFormat format, VkExtent2D extent, uint32_t mipLevels, VkImageUsageFlags usage, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+VkImageView CreateImageView(const GpuContext& context, VkImage image, VkFormat format, uint32_t baseMipLevel, uint32_t levelCount, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+void DestroyImage(const GpuContext& context, GpuImage& image);
+
+// Host visible buffers stay mapped for their whole lifetime.
+GpuBuffer CreateBuffer(const GpuContext& context, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+void DestroyBuffer(const GpuContext& context, GpuBuffer& buffer);
+
+// Device memory allocated through CreateImage2D and CreateBuffer, and the most that was
+// ever allocated at once. Swapchain images are the driver's and not counted.
+struct DeviceMemoryUsage {
+	uint64_t currentBytes = 0;
+	uint64_t peakBytes = 0;
+};
+
+DeviceMemoryUsage GetDeviceMemoryUsage();
+
+VkShaderModule CreateShaderModule(const GpuContext& context, const ShaderCode& code);
+VkPipeline CreateComputePipeline(const GpuContext& context, VkPipelineLayout layout, const ShaderCode& code);
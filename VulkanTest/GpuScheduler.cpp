@@ -0,0 +1,186 @@
+#include "GpuScheduler.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+
+void GpuScheduler::Init(VkDevice device, const DeviceDispatch* dispatch, VkQueue graphicsQueue, VkQueue computeQueue, VkQueue transferQueue) {
+	device_ = device;
+	dispatch_ = dispatch;
+	lanes_[static_cast<int>(QueueType::Graphics)].queue = graphicsQueue;
+	lanes_[static_cast<int>(QueueType::Compute)].queue = computeQueue;
+	lanes_[static_cast<int>(QueueType::Transfer)].queue = transferQueue;
+}
+
+void GpuScheduler::Destroy() {
+	this->WaitIdle();
+
+	for (VkFence fence : freeFences_) dispatch_->DestroyFence(device_, fence, nullptr);
+	for (VkSemaphore semaphore : freeSemaphores_) dispatch_->DestroySemaphore(device_, semaphore, nullptr);
+	freeFences_.clear();
+	freeSemaphores_.clear();
+}
+
+GpuTicket GpuScheduler::Submit(QueueType queueType, const SubmitBatch& batch) {
+	if (batch.ticketWaitCount > MAX_TICKET_WAITS) throw std::runtime_error("Too many ticket waits in one submission!");
+
+	this->Poll();
+
+	InFlight entry = { };
+	entry.ticket = nextTicket_;
+	entry.fence = this->AcquireFence();
+	entry.signalSemaphore = batch.crossQueueSignal ? this->AcquireSemaphore() : VK_NULL_HANDLE;
+	entry.signalClaimed = false;
+	entry.claimedCount = 0;
+
+	waitSemaphores_.assign(batch.pWaitSemaphores, batch.pWaitSemaphores + batch.waitSemaphoreCount);
+	waitStages_.assign(batch.pWaitDstStageMask, batch.pWaitDstStageMask + batch.waitSemaphoreCount);
+	signalSemaphores_.assign(batch.pSignalSemaphores, batch.pSignalSemaphores + batch.signalSemaphoreCount);
+	if (entry.signalSemaphore != VK_NULL_HANDLE) signalSemaphores_.push_back(entry.signalSemaphore);
+
+	// A ticket that already finished needs no wait. One still in flight is waited on
+	// through its semaphore, which the first waiter takes over and recycles once its
+	// own submission has retired.
+	for (uint32_t i = 0; i < batch.ticketWaitCount; ++i) {
+		InFlight* producer = this->Find(batch.pTicketWaits[i].ticket);
+		if (!producer) continue;
+
+		if (producer->signalSemaphore == VK_NULL_HANDLE || producer->signalClaimed) {
+			// Nothing left to wait on from the GPU side, so fall back to the CPU.
+			this->Wait(producer->ticket);
+			continue;
+		}
+
+		producer->signalClaimed = true;
+		waitSemaphores_.push_back(producer->signalSemaphore);
+		waitStages_.push_back(batch.pTicketWaits[i].stageMask);
+		entry.claimedSemaphores[entry.claimedCount++] = producer->signalSemaphore;
+	}
+
+	VkSubmitInfo submitInfo = { };
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = nullptr;
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores_.size());
+	submitInfo.pWaitSemaphores = waitSemaphores_.data();
+	submitInfo.pWaitDstStageMask = waitStages_.data();
+	submitInfo.commandBufferCount = batch.commandBufferCount;
+	submitInfo.pCommandBuffers = batch.pCommandBuffers;
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores_.size());
+	submitInfo.pSignalSemaphores = signalSemaphores_.data();
+
+	Lane& lane = lanes_[static_cast<int>(queueType)];
+	VkResult result = dispatch_->QueueSubmit(lane.queue, 1, &submitInfo, entry.fence);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to submit command buffers!");
+
+	lane.inFlight.push_back(entry);
+	return nextTicket_++;
+}
+
+bool GpuScheduler::IsComplete(GpuTicket ticket) {
+	if (ticket >= nextTicket_) return false;
+
+	this->Poll();
+	return this->Find(ticket) == nullptr;
+}
+
+void GpuScheduler::Wait(GpuTicket ticket) {
+	if (ticket >= nextTicket_) throw std::runtime_error("Waiting for a ticket that was never submitted!");
+
+	InFlight* entry = this->Find(ticket);
+	if (!entry) return;
+
+	VkResult result = dispatch_->WaitForFences(device_, 1, &entry->fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to wait for ticket!");
+
+	this->Poll();
+}
+
+void GpuScheduler::WaitIdle() {
+	for (Lane& lane : lanes_) {
+		if (!lane.inFlight.empty()) this->Wait(lane.inFlight.back().ticket);
+	}
+}
+
+GpuTicket GpuScheduler::CompletedTicket() {
+	this->Poll();
+
+	GpuTicket completed = this->LastSubmitted();
+	for (const Lane& lane : lanes_) {
+		if (!lane.inFlight.empty()) completed = std::min(completed, lane.inFlight.front().ticket - 1);
+	}
+
+	return completed;
+}
+
+
+void GpuScheduler::Poll() {
+	// Submissions on one queue finish in order, so only the oldest fences need checking.
+	for (Lane& lane : lanes_) {
+		while (!lane.inFlight.empty() && dispatch_->GetFenceStatus(device_, lane.inFlight.front().fence) == VK_SUCCESS) {
+			this->Retire(lane.inFlight.front());
+			lane.inFlight.pop_front();
+		}
+	}
+}
+
+void GpuScheduler::Retire(InFlight& entry) {
+	dispatch_->ResetFences(device_, 1, &entry.fence);
+	freeFences_.push_back(entry.fence);
+
+	// Semaphores this submission waited on are unsignaled again and can be reused.
+	for (uint32_t i = 0; i < entry.claimedCount; ++i) freeSemaphores_.push_back(entry.claimedSemaphores[i]);
+
+	// A signaled semaphore nobody waited on can't be signaled again, only destroyed.
+	// Later waiters find the ticket complete and skip it.
+	if (entry.signalSemaphore != VK_NULL_HANDLE && !entry.signalClaimed) dispatch_->DestroySemaphore(device_, entry.signalSemaphore, nullptr);
+}
+
+GpuScheduler::InFlight* GpuScheduler::Find(GpuTicket ticket) {
+	for (Lane& lane : lanes_) {
+		if (lane.inFlight.empty() || ticket < lane.inFlight.front().ticket || ticket > lane.inFlight.back().ticket) continue;
+
+		auto it = std::lower_bound(lane.inFlight.begin(), lane.inFlight.end(), ticket, [](const InFlight& entry, GpuTicket t) { return entry.ticket < t; });
+		if (it != lane.inFlight.end() && it->ticket == ticket) return &*it;
+	}
+
+	return nullptr;
+}
+
+VkFence GpuScheduler::AcquireFence() {
+	if (!freeFences_.empty()) {
+		VkFence fence = freeFences_.back();
+		freeFences_.pop_back();
+		return fence;
+	}
+
+	VkFenceCreateInfo fenceInfo = { };
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.pNext = nullptr;
+	fenceInfo.flags = 0;
+
+	VkFence fence;
+	VkResult result = dispatch_->CreateFence(device_, &fenceInfo, nullptr, &fence);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create ticket fence!");
+
+	return fence;
+}
+
+VkSemaphore GpuScheduler::AcquireSemaphore() {
+	if (!freeSemaphores_.empty()) {
+		VkSemaphore semaphore = freeSemaphores_.back();
+		freeSemaphores_.pop_back();
+		return semaphore;
+	}
+
+	VkSemaphoreCreateInfo semaphoreInfo = { };
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = nullptr;
+	semaphoreInfo.flags = 0;
+
+	VkSemaphore semaphore;
+	VkResult result = dispatch_->CreateSemaphore(device_, &semaphoreInfo, nullptr, &semaphore);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create ticket semaphore!");
+
+	return semaphore;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "VulkanDispatch.h"
+
+
+// Every submission gets a ticket from one counter shared by all queues, so a
+// later ticket is always a later submission. Work that has to wait for the GPU
+// (reusing a frame's resources, reading results back, destroying objects)
+// waits for a ticket instead of a fence of its own or an idle device.
+typedef uint64_t GpuTicket;
+
+enum class QueueType {
+	Graphics,
+	Compute,
+	Transfer,
+	Count
+};
+
+// Makes a submission wait until ticket has finished on whichever queue it ran on.
+struct TicketWait {
+	GpuTicket ticket;
+	VkPipelineStageFlags stageMask;
+};
+
+// Mirrors VkSubmitInfo. Binary semaphores are still needed for the swap chain.
+struct SubmitBatch {
+	uint32_t commandBufferCount = 0;
+	const VkCommandBuffer* pCommandBuffers = nullptr;
+	uint32_t waitSemaphoreCount = 0;
+	const VkSemaphore* pWaitSemaphores = nullptr;
+	const VkPipelineStageFlags* pWaitDstStageMask = nullptr;
+	uint32_t signalSemaphoreCount = 0;
+	const VkSemaphore* pSignalSemaphores = nullptr;
+	uint32_t ticketWaitCount = 0;
+	const TicketWait* pTicketWaits = nullptr;
+	// Set when a submission on another queue will wait on this ticket.
+	bool crossQueueSignal = false;
+};
+
+// The SDK this project builds against predates VK_KHR_timeline_semaphore, so a
+// ticket is backed by a pooled fence, and cross-queue waits by a pooled binary
+// semaphore that is handed to the first waiter. Only call from one thread.
+class GpuScheduler {
+public:
+	void Init(VkDevice device, const DeviceDispatch* dispatch, VkQueue graphicsQueue, VkQueue computeQueue, VkQueue transferQueue);
+	void Destroy();
+
+	GpuTicket Submit(QueueType queueType, const SubmitBatch& batch);
+	bool IsComplete(GpuTicket ticket);
+	void Wait(GpuTicket ticket);
+	void WaitIdle();
+
+	GpuTicket LastSubmitted() const { return nextTicket_ - 1; }
+	// Submissions to the queue that weren't yet seen to finish.
+	uint32_t InFlightCount(QueueType queueType) const { return static_cast<uint32_t>(lanes_[static_cast<int>(queueType)].inFlight.size()); }
+	GpuTicket CompletedTicket();
+
+private:
+	static const uint32_t MAX_TICKET_WAITS = 4;
+
+	struct InFlight {
+		GpuTicket ticket;
+		VkFence fence;
+		VkSemaphore signalSemaphore;
+		bool signalClaimed;
+		uint32_t claimedCount;
+		VkSemaphore claimedSemaphores[MAX_TICKET_WAITS];
+	};
+
+	struct Lane {
+		VkQueue queue = VK_NULL_HANDLE;
+		std::deque<InFlight> inFlight;
+	};
+
+private:
+	void Poll();
+	void Retire(InFlight& entry);
+	InFlight* Find(GpuTicket ticket);
+	VkFence AcquireFence();
+	VkSemaphore AcquireSemaphore();
+
+private:
+	VkDevice device_ = VK_NULL_HANDLE;
+	const DeviceDispatch* dispatch_ = nullptr;
+	Lane lanes_[static_cast<int>(QueueType::Count)];
+	GpuTicket nextTicket_ = 1;
+
+	std::vector<VkFence> freeFences_;
+	std::vector<VkSemaphore> freeSemaphores_;
+	std::vector<VkSemaphore> waitSemaphores_;
+	std::vector<VkPipelineStageFlags> waitStages_;
+	std::vector<VkSemaphore> signalSemaphores_;
+};
@@ -2,76 +2,286 @@
 
 #include <set>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
 
 
-void HelloTriangleApplication::Run() {
-	this->InitWindow();
-	this->InitVulkan();
-	this->MainLoop();
+// The vertex shader's push constants: how to reconstruct the mesh's positions, the
+// camera, and where the phase's draw list starts.
+struct SceneDrawParams {
+	float positionOffset[4];
+	float positionScale[4];
+	Camera camera;
+	uint32_t listOffset;
+};
+
+// The box the lights wander through: the solar system and the wall behind it.
+static const float SCENE_LIGHT_BOUNDS[2][3] = { { -1.0f, -1.0f, -3.0f }, { 1.0f, 1.0f, 0.6f } };
+
+
+static void PrintFrameTimes(const char* name, const FrameTimeStats& stats) {
+	printf("  %s ms: average %7.3f, median %7.3f, 95%% %7.3f, 99%% %7.3f, max %7.3f over %d frames\n", name, stats.averageMs, stats.medianMs, stats.p95Ms, stats.p99Ms, stats.maxMs, stats.count);
+}
+
+
+void HelloTriangleApplication::Run(const AppOptions& options) {
+	startupTimeline_.Start();
+	GetDebugSink().Start("debug_log.jsonl");
+
+	if (options.benchmarkDebugSink) {
+		this->BenchmarkDebugSink();
+		GetDebugSink().Stop();
+		return;
+	}
+	if (options.benchmarkJobs) {
+		this->BenchmarkJobs();
+		GetDebugSink().Stop();
+		return;
+	}
+	if (options.benchmarkScene) {
+		this->BenchmarkScene();
+		GetDebugSink().Stop();
+		return;
+	}
+	if (options.meshReport) {
+		this->ReportMeshOptimization();
+		GetDebugSink().Stop();
+		return;
+	}
+
+	// The main thread is worker 0; it runs jobs whenever it waits for them.
+	jobs_.Start();
+
+	if (!options.replayFile.empty()) {
+		this->LoadReplay(options.replayFile);
+	} else if (!options.benchmarkSuite.empty()) {
+		this->LoadSuiteScene(options.benchmarkSuite);
+	} else {
+		dynamicResolution_.Configure(options.dynamicResolution, options.gpuBudgetMs);
+		vertexFormat_ = options.quantizedVertices ? VertexFormat::Quantized : VertexFormat::Float;
+		occlusion_.Configure(options.occlusionCulling, options.compareOcclusionCulling);
+		lightCount_ = options.lightCount;
+		// The sweep renders the live scene, but at a fixed size and without a window.
+		if (options.benchmarkLights) this->StartHeadless({ WIDTH, HEIGHT });
+	}
+	// The suite draws the overlay too, without presenting it, so its cost is measured.
+	showOverlay_ = options.overlay && (!headless_ || suiteScene_);
+	gpuBudgetMs_ = options.gpuBudgetMs;
+	this->Init();
+	if (!options.captureFile.empty()) this->StartCapture(options);
+
+	if (options.benchmarkDispatch) this->BenchmarkDispatch();
+	else if (options.benchmarkLights) this->BenchmarkLights();
+	else if (suiteScene_) this->RunSuiteScene(options.benchmarkOutput);
+	else if (headless_) this->Replay(options.replayFile, options.replayRealtime);
+	else this->MainLoop();
+
+	capture_.Close();
 	this->Cleanup();
 }
 
 
+void HelloTriangleApplication::Init() {
+	if (!headless_) startupTimeline_.Measure("glfwInit", []() { if (!glfwInit()) throw std::runtime_error("Failed to initialize GLFW!"); });
+
+	// Neither the instance nor the SPIR-V depend on the window, so both are prepared
+	// as jobs while the main thread, which GLFW requires, opens the window.
+	JobCounter startupJobs;
+	jobs_.Run([this]() {
+		startupTimeline_.Measure("CreateInstance", [this]() { this->CreateInstance(); });
+		startupTimeline_.Measure("SetupDebugCallback", [this]() { this->SetupDebugCallback(); });
+	}, startupJobs);
+	jobs_.Run([this]() {
+		startupTimeline_.Measure("LoadShaders", [this]() { this->LoadShaders(); });
+	}, startupJobs);
+
+	if (!headless_) startupTimeline_.Measure("InitWindow", [this]() { this->InitWindow(); });
+	jobs_.Wait(startupJobs);
+
+	this->InitVulkan();
+}
+
 void HelloTriangleApplication::InitWindow() {
-	glfwInit();
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 	window_ = glfwCreateWindow(WIDTH, HEIGHT, "VulkanTest", nullptr, nullptr);
+	if (!window_) throw std::runtime_error("Failed to create window!");
 	glfwSetWindowUserPointer(window_, this);
 	glfwSetWindowSizeCallback(window_, HelloTriangleApplication::OnWindowResized);
+	glfwSetKeyCallback(window_, HelloTriangleApplication::OnKey);
 }
 
 void HelloTriangleApplication::InitVulkan() {
-	this->CreateInstance();
-	this->SetupDebugCallback();
-	this->CreateSurface();
-	this->PickPhysicalDevice();
-	this->CreateLogicalDevice();
-	this->CreateSwapChain();
-	this->CreateImageViews();
-	this->CreateRenderPass();
-	this->CreateGraphicsPipeline();
-	this->CreateFramebuffers();
-	this->CreateCommandPool();
-	this->CreateCommandBuffers();
-	this->CreateSemaphores();
+	if (!headless_) startupTimeline_.Measure("CreateSurface", [this]() { this->CreateSurface(); });
+	startupTimeline_.Measure("PickPhysicalDevice", [this]() { this->PickPhysicalDevice(); });
+	startupTimeline_.Measure("CreateLogicalDevice", [this]() { this->CreateLogicalDevice(); });
+	startupTimeline_.Measure("CreateSwapChain", [this]() { this->CreateSwapChain(); });
+	startupTimeline_.Measure("CreateImageViews", [this]() { this->CreateImageViews(); });
+	startupTimeline_.Measure("CreateRenderPass", [this]() { this->CreateRenderPass(); });
+	startupTimeline_.Measure("CreateScene", [this]() { this->CreateScene(); });
+	startupTimeline_.Measure("CreateInstanceBuffer", [this]() { this->CreateInstanceBuffer(); });
+	startupTimeline_.Measure("CreateMeshes", [this]() { this->CreateMeshes(); });
+	startupTimeline_.Measure("CreateOcclusionCulling", [this]() { this->CreateOcclusionCulling(); });
+	startupTimeline_.Measure("CreateLighting", [this]() { this->CreateLighting(); });
+	startupTimeline_.Measure("CreateGraphicsPipeline", [this]() { this->CreateGraphicsPipeline(); });
+	startupTimeline_.Measure("CreateSceneTargets", [this]() { this->CreateSceneTargets(); });
+	startupTimeline_.Measure("CreatePostProcess", [this]() { this->CreatePostProcess(); });
+	if (showOverlay_) startupTimeline_.Measure("CreateOverlay", [this]() { this->CreateOverlay(); });
+	startupTimeline_.Measure("CreateCommandPools", [this]() { this->CreateCommandPools(); });
+	startupTimeline_.Measure("CreateCommandBuffers", [this]() { this->CreateCommandBuffers(); });
+	startupTimeline_.Measure("CreateSemaphores", [this]() { this->CreateSemaphores(); });
 }
 
 void HelloTriangleApplication::MainLoop() {
+	bool firstFrame = true;
+	lastFrameStart_ = std::chrono::high_resolution_clock::now();
+
 	while (!glfwWindowShouldClose(window_)) {
 		glfwPollEvents();
+		auto frameStart = std::chrono::high_resolution_clock::now();
 		this->DrawFrame();
+		drawFrameMs_ = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count();
+
+		// Frames are presented one frame late, so the first one reaches the screen during the second DrawFrame.
+		if (firstFrame && presentedFrameCount_ > 0) {
+			startupTimeline_.Mark("FirstFrame");
+			startupTimeline_.Print(STARTUP_TARGET_MS);
+			firstFrame = false;
+		}
 	}
 
-	vkDeviceWaitIdle(device_);
+	scheduler_.WaitIdle();
 }
 
 void HelloTriangleApplication::CleanupSwapChain() {
-	for (size_t i = 0; i < swapChainFramebuffers_.size(); ++i) vkDestroyFramebuffer(device_, swapChainFramebuffers_[i], nullptr);
-	vkFreeCommandBuffers(device_, commandPool_, static_cast<uint32_t>(commandBuffers_.size()), commandBuffers_.data());
-	vkDestroyPipeline(device_, graphicsPipeline_, nullptr);
-	vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
-	vkDestroyRenderPass(device_, renderPass_, nullptr);
-	for (size_t i = 0; i < swapChainImageViews_.size(); ++i) vkDestroyImageView(device_, swapChainImageViews_[i], nullptr);
-	vkDestroySwapchainKHR(device_, swapchain_, nullptr);
+	// Frames still in flight may use these, so they go to the deletion queue instead of waiting for the device.
+	postProcess_.DestroyTargets();
+	occlusion_.DestroyTargets();
+	if (showOverlay_) overlay_.DestroyTargets();
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+		sceneFramebuffers_[i].Reset();
+		deletionQueue_.DestroyImage(sceneColor_[i]);
+		deletionQueue_.DestroyImage(sceneDepth_[i]);
+	}
+	swapChainImageViews_.clear();
+	deletionQueue_.DestroyImage(headlessOutput_);
 }
 
 void HelloTriangleApplication::Cleanup() {
+	scheduler_.Destroy();
 	this->CleanupSwapChain();
-	vkDestroySemaphore(device_, renderFinishedSemaphore_, nullptr);
-	vkDestroySemaphore(device_, imageAvailableSemaphore_, nullptr);
-	vkDestroyCommandPool(device_, commandPool_, nullptr);
-	vkDestroyDevice(device_, nullptr);
-	DestroyDebugReportCallbackEXT(instance_, callback_, nullptr);
-	vkDestroySurfaceKHR(instance_, surface_, nullptr);
+	profiler_.Destroy();
+	postProcess_.Destroy();
+	if (showOverlay_) overlay_.Destroy();
+	occlusion_.Destroy();
+	lighting_.Destroy();
+	instances_.Destroy();
+	DestroyGpuMesh(gpu_, sceneMesh_);
+	// The device is idle, so everything that was released can be destroyed right away.
+	deletionQueue_.FlushAll();
+	shaders_.Close();
+	if (swapchain_ != VK_NULL_HANDLE) dispatch_.DestroySwapchainKHR(device_, swapchain_, nullptr);
+	dispatch_.DestroyPipeline(device_, graphicsPipeline_, nullptr);
+	dispatch_.DestroyPipelineLayout(device_, pipelineLayout_, nullptr);
+	dispatch_.DestroyRenderPass(device_, lateRenderPass_, nullptr);
+	dispatch_.DestroyRenderPass(device_, renderPass_, nullptr);
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+		dispatch_.DestroySemaphore(device_, frames_[i].renderFinishedSemaphore, nullptr);
+		dispatch_.DestroySemaphore(device_, frames_[i].imageAvailableSemaphore, nullptr);
+		dispatch_.DestroyCommandPool(device_, frames_[i].computeCommandPool, nullptr);
+		dispatch_.DestroyCommandPool(device_, frames_[i].graphicsCommandPool, nullptr);
+	}
+	dispatch_.DestroyDevice(device_, nullptr);
+	if (callback_ != VK_NULL_HANDLE) instanceDispatch_.DestroyDebugReportCallbackEXT(instance_, callback_, nullptr);
+	if (surface_ != VK_NULL_HANDLE) vkDestroySurfaceKHR(instance_, surface_, nullptr);
 	vkDestroyInstance(instance_, nullptr);
-	glfwDestroyWindow(window_);
-	glfwTerminate();
+	if (!headless_) {
+		glfwDestroyWindow(window_);
+		glfwTerminate();
+	}
+	jobs_.Stop();
+	GetDebugSink().Stop();
 }
 
 
 void HelloTriangleApplication::DrawFrame() {
+	FrameResources& frame = frames_[currentFrame_];
+
+	// Everything the slot recorded last time, up to its composite, has to be finished before it is reused.
+	scheduler_.Wait(frame.ticket);
+	deletionQueue_.Flush();
+	if (replayFrame_) {
+		instances_.Stage(currentFrame_, replayFrame_->instanceCount, replayFrame_->ranges, replayFrame_->instances.data());
+		sceneTime_ = replayFrame_->sceneTime;
+	} else {
+		this->UpdateScene();
+	}
+	lighting_.Update(currentFrame_, sceneTime_, jobs_);
+
+	// The post-processing runs alongside the scene, so only the time it didn't overlap adds to the frame.
+	bool timed = profiler_.Resolve(currentFrame_);
+	if (timed) dynamicResolution_.Update(profiler_.LastFrame().TotalMs() - profiler_.LastOverlapMs());
+	if (timed && frame.timedFrame >= 0) this->StoreFrameTiming(frame.timedFrame);
+	if (showOverlay_) this->UpdateOverlay(timed);
+	occlusion_.Resolve(currentFrame_, timed && profiler_.LastFrame().valid[static_cast<int>(GpuPass::Scene)] ? profiler_.LastFrame().DurationMs(GpuPass::Scene) : -1.0);
+
+	if (replayFrame_) {
+		frame.renderExtent = replayFrame_->renderExtent;
+		camera_ = replayFrame_->camera;
+	} else {
+		frame.renderExtent = dynamicResolution_.RenderExtent();
+	}
+	frame.timedFrame = timedFrame_;
+	if (capture_.IsOpen()) this->CaptureFrame(currentFrame_);
+	dispatch_.ResetCommandPool(device_, frame.graphicsCommandPool, 0);
+	dispatch_.ResetCommandPool(device_, frame.computeCommandPool, 0);
+
+	// The scene and the post-processing record into command buffers from different pools,
+	// so both are recorded in parallel.
+	int frameIndex = currentFrame_;
+	JobCounter recorded;
+	jobs_.Run([this, frameIndex]() { this->RecordScene(frameIndex); }, recorded);
+	jobs_.Run([this, frameIndex]() { this->RecordPostProcess(frameIndex); }, recorded);
+	jobs_.Wait(recorded);
+
+	SubmitBatch sceneBatch;
+	sceneBatch.commandBufferCount = 1;
+	sceneBatch.pCommandBuffers = &frame.sceneCommandBuffer;
+	sceneBatch.crossQueueSignal = true;
+	GpuTicket sceneTicket = scheduler_.Submit(QueueType::Graphics, sceneBatch);
+
+	if (meshUploadPending_) {
+		ReleaseMeshStaging(gpu_, sceneMesh_);
+		meshUploadPending_ = false;
+	}
+
+	TicketWait sceneWait = { sceneTicket, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+	SubmitBatch postBatch;
+	postBatch.commandBufferCount = 1;
+	postBatch.pCommandBuffers = &frame.postCommandBuffer;
+	postBatch.ticketWaitCount = 1;
+	postBatch.pTicketWaits = &sceneWait;
+	postBatch.crossQueueSignal = true;
+	frame.ticket = scheduler_.Submit(QueueType::Compute, postBatch);
+
+	// The previous frame is only composited now, after this frame's scene pass has been
+	// queued, so the graphics queue doesn't stall on its post-processing and the compute
+	// queue can run it alongside this frame's scene.
+	int previousFrame = (currentFrame_ + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT;
+	bool compositePrevious = hasPendingComposite_;
+	hasPendingComposite_ = !headless_ || showOverlay_;
+	currentFrame_ = (currentFrame_ + 1) % MAX_FRAMES_IN_FLIGHT;
+
+	if (compositePrevious && headless_) this->CompositeHeadless(previousFrame);
+	else if (compositePrevious) this->PresentFrame(previousFrame);
+}
+
+void HelloTriangleApplication::PresentFrame(int frameIndex) {
+	FrameResources& frame = frames_[frameIndex];
+
 	uint32_t imageIndex = 0;
-	VkResult result = vkAcquireNextImageKHR(device_, swapchain_, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphore_, VK_NULL_HANDLE, &imageIndex);
+	VkResult result = dispatch_.AcquireNextImageKHR(device_, swapchain_, std::numeric_limits<uint64_t>::max(), frame.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		this->RecreateSwapChain();
@@ -80,23 +290,24 @@ void HelloTriangleApplication::DrawFrame() {
 		throw std::runtime_error("Failed to acquire swap chain image!");
 	}
 
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphore_ };
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphore_ };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	VkSubmitInfo submitInfo = { };
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.pNext = nullptr;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers_[imageIndex];
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
-
-	result = vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-//	printf("vkQueueSubmit result: %d\n", result);
-	if (result != VK_SUCCESS) throw std::runtime_error("Failed to submit draw command buffer!");
+	this->RecordComposite(frameIndex, imageIndex);
+
+	VkSemaphore waitSemaphores[] = { frame.imageAvailableSemaphore };
+	VkSemaphore signalSemaphores[] = { frame.renderFinishedSemaphore };
+	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_TRANSFER_BIT };
+	TicketWait postWait = { frame.ticket, VK_PIPELINE_STAGE_TRANSFER_BIT };
+	SubmitBatch batch;
+	batch.waitSemaphoreCount = 1;
+	batch.pWaitSemaphores = waitSemaphores;
+	batch.pWaitDstStageMask = waitStages;
+	batch.commandBufferCount = 1;
+	batch.pCommandBuffers = &frame.compositeCommandBuffer;
+	batch.signalSemaphoreCount = 1;
+	batch.pSignalSemaphores = signalSemaphores;
+	batch.ticketWaitCount = 1;
+	batch.pTicketWaits = &postWait;
+
+	frame.ticket = scheduler_.Submit(QueueType::Graphics, batch);
 
 	VkSwapchainKHR swapchains[] = { swapchain_ };
 	VkPresentInfoKHR presentInfo = { };
@@ -109,8 +320,9 @@ void HelloTriangleApplication::DrawFrame() {
 	presentInfo.pImageIndices = &imageIndex;
 	presentInfo.pResults = nullptr;
 
-	result = vkQueuePresentKHR(presentQueue_, &presentInfo);
+	result = dispatch_.QueuePresentKHR(presentQueue_, &presentInfo);
 //	printf("vkQueuePresentKHR result: %d\n", result);
+	++presentedFrameCount_;
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
 		this->RecreateSwapChain();
@@ -119,17 +331,805 @@ void HelloTriangleApplication::DrawFrame() {
 	}
 }
 
-void HelloTriangleApplication::RecreateSwapChain() {
-	vkDeviceWaitIdle(device_);
+void HelloTriangleApplication::UpdateScene() {
+	// Headless runs have to render the same frames every time, so they step at a fixed 60 Hz.
+	float time = headless_ ? sceneFrameCount_ / 60.0f : static_cast<float>(glfwGetTime());
+	++sceneFrameCount_;
+	sceneTime_ = time;
+
+	// Only the root and the planets spin; the moons move because their parents do.
+	if (sceneRoot_ != INVALID_ENTITY) {
+		Transform local = scene_.Local(sceneRoot_);
+		local.rotation[2] = std::sin(0.1f * time);
+		local.rotation[3] = std::cos(0.1f * time);
+		scene_.SetLocal(sceneRoot_, local);
+	}
+
+	for (size_t i = 0; i < scenePlanets_.size(); ++i) {
+		float halfAngle = (0.25f + 0.05f * i) * time;
+		Transform local = scene_.Local(scenePlanets_[i]);
+		local.rotation[2] = std::sin(halfAngle);
+		local.rotation[3] = std::cos(halfAngle);
+		scene_.SetLocal(scenePlanets_[i], local);
+	}
+
+	// Grid instances bob back and forth in depth, each a little out of phase.
+	if (suiteScene_ && suiteScene_->moveAll) {
+		for (size_t i = 0; i < sceneGrid_.size(); ++i) {
+			Transform local = scene_.Local(sceneGrid_[i]);
+			local.position[2] = 0.5f * std::sin(2.0f * time + 0.01f * i);
+			scene_.SetLocal(sceneGrid_[i], local);
+		}
+	}
 
+	scene_.Update(jobs_);
+	scene_.CollectChanges(sceneChanges_);
+	instances_.Stage(currentFrame_, scene_, sceneChanges_);
+}
+
+// Composites the frame and draws the overlay over it like PresentFrame, but into the
+// headless output, which nothing presents.
+void HelloTriangleApplication::CompositeHeadless(int frameIndex) {
+	FrameResources& frame = frames_[frameIndex];
+	this->RecordComposite(frameIndex, 0);
+
+	TicketWait postWait = { frame.ticket, VK_PIPELINE_STAGE_TRANSFER_BIT };
+	SubmitBatch batch;
+	batch.commandBufferCount = 1;
+	batch.pCommandBuffers = &frame.compositeCommandBuffer;
+	batch.ticketWaitCount = 1;
+	batch.pTicketWaits = &postWait;
+	frame.ticket = scheduler_.Submit(QueueType::Graphics, batch);
+}
+
+// Call once the profiler has resolved the slot, before its extent is chosen.
+void HelloTriangleApplication::UpdateOverlay(bool timed) {
+	auto now = std::chrono::high_resolution_clock::now();
+
+	OverlayFrame frame;
+	frame.frameMs = std::chrono::duration<double, std::milli>(now - lastFrameStart_).count();
+	frame.cpuMs = drawFrameMs_;
+	frame.gpuValid = timed;
+	if (timed) {
+		frame.gpu = profiler_.LastFrame();
+		frame.gpuMs = frame.gpu.TotalMs() - profiler_.LastOverlapMs();
+	}
+	frame.renderExtent = dynamicResolution_.RenderExtent();
+	frame.outputExtent = swapChainExtent_;
+	frame.deviceMemory = GetDeviceMemoryUsage();
+	frame.processPeakBytes = PeakProcessMemoryBytes();
+	for (int i = 0; i < static_cast<int>(QueueType::Count); ++i) frame.queueDepths[i] = scheduler_.InFlightCount(static_cast<QueueType>(i));
+	frame.pendingDeletions = static_cast<uint32_t>(deletionQueue_.Depth());
+
+	overlay_.AddFrame(frame);
+	lastFrameStart_ = now;
+}
+
+void HelloTriangleApplication::RecreateSwapChain() {
+	// Nothing waits for the GPU here: the frames in flight keep using the old resources
+	// until the deletion queue destroys them. The render pass and pipeline don't depend
+	// on the swap chain, since the scene has its own format and a dynamic viewport.
 	this->CleanupSwapChain();
 
 	this->CreateSwapChain();
 	this->CreateImageViews();
-	this->CreateRenderPass();
-	this->CreateGraphicsPipeline();
-	this->CreateFramebuffers();
-	this->CreateCommandBuffers();
+	this->CreateSceneTargets();
+	postProcess_.CreateTargets(swapChainExtent_, sceneColor_);
+	if (showOverlay_) overlay_.CreateTargets(swapChainImageViews_, swapChainExtent_);
+
+	// The post-processed frame waiting to be presented was written to the old targets.
+	hasPendingComposite_ = false;
+}
+
+
+void HelloTriangleApplication::StartCapture(const AppOptions& options) {
+	// The largest extent is filled in by the frames as they are written.
+	TraceSettings settings;
+	settings.vertexFormat = sceneMesh_.format;
+	settings.occlusionCulling = options.occlusionCulling;
+	settings.compareOcclusionCulling = options.compareOcclusionCulling;
+	settings.instanceCapacity = instances_.Capacity();
+	settings.indexCount = sceneMesh_.indexCount;
+	settings.lightCount = lighting_.LightCount();
+
+	capture_.Open(options.captureFile, settings);
+	captureStart_ = std::chrono::high_resolution_clock::now();
+	printf("Capturing frames to %s\n", options.captureFile.c_str());
+}
+
+// Call once the slot's instances are staged and its render extent is chosen.
+void HelloTriangleApplication::CaptureFrame(int frameIndex) {
+	TraceFrame& frame = captureFrame_;
+	frame.timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - captureStart_).count();
+	frame.sceneTime = sceneTime_;
+	frame.renderExtent = frames_[frameIndex].renderExtent;
+	frame.camera = camera_;
+	frame.instanceCount = instances_.Count();
+	instances_.Staged(frameIndex, frame.ranges, frame.instances);
+
+	capture_.Write(frame);
+}
+
+void HelloTriangleApplication::LoadReplay(const std::string& filename) {
+	ReadTrace(filename, replaySettings_, replayFrames_);
+	if (replayFrames_.empty()) throw std::runtime_error("Trace has no frames!");
+	printf("Replaying %s: %d frames at up to %ux%u\n", filename.c_str(), static_cast<int>(replayFrames_.size()), replaySettings_.extent.width, replaySettings_.extent.height);
+
+	// The trace decides how the renderer is set up and every frame's extent, and there is no window.
+	this->StartHeadless(replaySettings_.extent);
+	vertexFormat_ = replaySettings_.vertexFormat;
+	occlusion_.Configure(replaySettings_.occlusionCulling, replaySettings_.compareOcclusionCulling);
+	lightCount_ = replaySettings_.lightCount;
+}
+
+// Feeds the trace through DrawFrame in place of the live scene and reports what each
+// frame cost the CPU and the GPU. Nothing is presented, so frames are only paced by
+// the frame slots, or by the capture's timing when realtime is set.
+void HelloTriangleApplication::Replay(const std::string& filename, bool realtime) {
+	if (instances_.Capacity() != replaySettings_.instanceCapacity || sceneMesh_.indexCount != replaySettings_.indexCount) throw std::runtime_error("Trace was captured from a different scene!");
+
+	auto start = std::chrono::high_resolution_clock::now();
+	double totalMs = this->RunTimedFrames(static_cast<int>(replayFrames_.size()), [&](int i) {
+		replayFrame_ = &replayFrames_[i];
+		if (realtime) std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double, std::milli>(replayFrame_->timeMs)));
+	});
+	replayFrame_ = nullptr;
+
+	std::vector<double> cpuMs;
+	std::vector<double> gpuMs;
+	for (const FrameTiming& timing : frameTimings_) {
+		cpuMs.push_back(timing.cpuMs);
+		gpuMs.push_back(timing.gpuMs);
+	}
+
+	printf("Replayed %d frames in %.1f ms (%.1f frames/s)%s\n", static_cast<int>(replayFrames_.size()), totalMs, 1000.0 * replayFrames_.size() / totalMs, realtime ? " at the captured pace" : "");
+	PrintFrameTimes("CPU", SummarizeFrameTimes(cpuMs));
+	PrintFrameTimes("GPU", SummarizeFrameTimes(gpuMs));
+
+	// Every frame's times, for comparing builds frame by frame.
+	std::string reportFile = filename + ".frames.csv";
+	FILE* report = fopen(reportFile.c_str(), "w");
+	if (!report) throw std::runtime_error("Failed to write replay report!");
+	fputs("frame,cpu_ms,gpu_ms\n", report);
+	for (size_t i = 0; i < frameTimings_.size(); ++i) fprintf(report, "%d,%.4f,%.4f\n", static_cast<int>(i), frameTimings_[i].cpuMs, frameTimings_[i].gpuMs);
+	fclose(report);
+	printf("Per-frame times written to %s\n", reportFile.c_str());
+}
+
+void HelloTriangleApplication::LoadSuiteScene(const std::string& name) {
+	suiteScene_ = FindSuiteScene(name);
+	if (!suiteScene_) {
+		std::string names;
+		for (const SuiteScene& scene : SuiteScenes()) names += std::string(" ") + scene.name;
+		throw std::runtime_error("Unknown benchmark scene " + name + ", the scenes are:" + names);
+	}
+	printf("Benchmark scene %s: %s, %d frames\n", suiteScene_->name, suiteScene_->description, suiteScene_->frames);
+
+	// Every run has to render the same frames at the same size, so there is no window
+	// and no dynamic resolution, and the rest is left at its defaults.
+	this->StartHeadless({ WIDTH, HEIGHT });
+	vertexFormat_ = VertexFormat::Quantized;
+	occlusion_.Configure(true, false);
+	lightCount_ = suiteScene_->lightCount;
+}
+
+// Renders the scene through the headless path and writes its frame times, startup
+// time and memory high-water marks for Benchmarks/run_suite.py.
+void HelloTriangleApplication::RunSuiteScene(const std::string& outputFile) {
+	const SuiteScene& scene = *suiteScene_;
+	if (enableValidationLayers) puts("Warning: validation layers are enabled, timings include layer overhead!");
+
+	SuiteResult result;
+	result.scene = suiteScene_;
+	result.device = physicalDeviceProperties_.deviceName;
+	result.validation = enableValidationLayers;
+
+	double totalMs = this->RunTimedFrames(scene.frames, [&](int i) {
+		// Startup ends once the first frame has been submitted.
+		if (i == 1) result.startupMs = startupTimeline_.ElapsedMs();
+		if (scene.resizeInterval > 0 && i > 0 && i % scene.resizeInterval == 0) {
+			SuiteResizeExtent(i / scene.resizeInterval - 1, headlessExtent_.width, headlessExtent_.height);
+			this->RecreateSwapChain();
+		}
+	});
+
+	std::vector<double> cpuMs;
+	std::vector<double> gpuMs;
+	std::vector<double> overlayMs;
+	for (size_t i = std::min<size_t>(SUITE_WARMUP_FRAMES, frameTimings_.size() / 2); i < frameTimings_.size(); ++i) {
+		cpuMs.push_back(frameTimings_[i].cpuMs);
+		gpuMs.push_back(frameTimings_[i].gpuMs);
+		overlayMs.push_back(frameTimings_[i].passMs[static_cast<int>(GpuPass::Overlay)]);
+	}
+	result.cpu = SummarizeFrameTimes(cpuMs);
+	result.gpu = SummarizeFrameTimes(gpuMs);
+	result.overlayGpu = SummarizeFrameTimes(overlayMs);
+	result.processPeakBytes = PeakProcessMemoryBytes();
+	result.devicePeakBytes = GetDeviceMemoryUsage().peakBytes;
+	result.overflowedClusters = lighting_.MaxOverflow().clusters;
+	result.droppedLights = lighting_.MaxOverflow().droppedLights;
+
+	printf("Rendered %d frames in %.1f ms, startup %.1f ms on %s\n", scene.frames, totalMs, result.startupMs, result.device.c_str());
+	PrintFrameTimes("CPU", result.cpu);
+	PrintFrameTimes("GPU", result.gpu);
+	if (result.overlayGpu.count > 0) {
+		PrintFrameTimes("Overlay GPU", result.overlayGpu);
+		if (result.overlayGpu.medianMs > OVERLAY_TARGET_MS) printf("Warning: the overlay takes more than its %.1f ms target!\n", OVERLAY_TARGET_MS);
+	}
+	printf("  Peak memory: process %.1f MB, device %.1f MB\n", result.processPeakBytes / (1024.0 * 1024.0), result.devicePeakBytes / (1024.0 * 1024.0));
+	if (result.overflowedClusters > 0) printf("Warning: %u clusters dropped %u lights, the timings are invalid!\n", result.overflowedClusters, result.droppedLights);
+
+	WriteSuiteResult(outputFile, result);
+	printf("Results written to %s\n", outputFile.c_str());
+}
+
+// Draws frameCount frames headless and times each: the CPU time of DrawFrame and, once
+// its slot comes around again, the GPU time of its passes. prepareFrame runs untimed
+// before every frame. Returns how long all frames took.
+double HelloTriangleApplication::RunTimedFrames(int frameCount, const std::function<void(int)>& prepareFrame) {
+	frameTimings_.assign(frameCount, FrameTiming());
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < frameCount; ++i) {
+		prepareFrame(i);
+		timedFrame_ = i;
+
+		auto frameStart = std::chrono::high_resolution_clock::now();
+		this->DrawFrame();
+		frameTimings_[i].cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count();
+	}
+	timedFrame_ = -1;
+
+	// The frames still in flight are timed once the GPU has finished them.
+	scheduler_.WaitIdle();
+	double totalMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+		int slot = (currentFrame_ + i) % MAX_FRAMES_IN_FLIGHT;
+		FrameResources& frame = frames_[slot];
+		if (frame.timedFrame >= 0 && profiler_.Resolve(slot)) this->StoreFrameTiming(frame.timedFrame);
+		frame.timedFrame = -1;
+	}
+
+	return totalMs;
+}
+
+// Call once the profiler has resolved the frame's slot.
+void HelloTriangleApplication::StoreFrameTiming(int timedFrame) {
+	const GpuFrameTimings& times = profiler_.LastFrame();
+	FrameTiming& timing = frameTimings_[timedFrame];
+	timing.gpuMs = times.TotalMs() - profiler_.LastOverlapMs();
+	for (int i = 0; i < GPU_PASS_COUNT; ++i) {
+		if (times.valid[i]) timing.passMs[i] = times.DurationMs(static_cast<GpuPass>(i));
+	}
+}
+
+// Headless runs have no window and no swap chain, render at extent and don't scale it.
+void HelloTriangleApplication::StartHeadless(VkExtent2D extent) {
+	headless_ = true;
+	headlessExtent_ = extent;
+	dynamicResolution_.Configure(false, 0.0);
+}
+
+void HelloTriangleApplication::BeginRecording(VkCommandBuffer commandBuffer) {
+	VkCommandBufferBeginInfo beginInfo = { };
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.pNext = nullptr;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = nullptr;
+
+	VkResult result = dispatch_.BeginCommandBuffer(commandBuffer, &beginInfo);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to begin recording command buffer!");
+}
+
+void HelloTriangleApplication::EndRecording(VkCommandBuffer commandBuffer) {
+	VkResult result = dispatch_.EndCommandBuffer(commandBuffer);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to record command buffer!");
+}
+
+void HelloTriangleApplication::RecordScene(int frameIndex) {
+	const FrameResources& frame = frames_[frameIndex];
+	VkCommandBuffer commandBuffer = frame.sceneCommandBuffer;
+	this->BeginRecording(commandBuffer);
+	profiler_.Begin(commandBuffer, frameIndex, GpuPass::Lights);
+	lighting_.Record(commandBuffer, frameIndex, camera_);
+	profiler_.End(commandBuffer, frameIndex, GpuPass::Lights);
+	profiler_.Begin(commandBuffer, frameIndex, GpuPass::Scene);
+	instances_.RecordUpload(commandBuffer, frameIndex);
+	if (meshUploadPending_) RecordMeshUpload(gpu_, commandBuffer, sceneMesh_);
+	occlusion_.RecordEarly(commandBuffer, frameIndex, instances_.Count(), sceneMesh_.indexCount, camera_);
+
+	VkClearValue clearValues[2] = { };
+	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassInfo = { };
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.pNext = nullptr;
+	renderPassInfo.renderPass = renderPass_;
+	renderPassInfo.framebuffer = sceneFramebuffers_[frameIndex].Get();
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = frame.renderExtent;
+	renderPassInfo.clearValueCount = 2;
+	renderPassInfo.pClearValues = clearValues;
+
+	VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(frame.renderExtent.width), static_cast<float>(frame.renderExtent.height), 0.0f, 1.0f };
+	VkRect2D scissor = { { 0, 0 }, frame.renderExtent };
+	VkDescriptorSet sets[] = { instances_.Set(), occlusion_.DrawSet(), lighting_.Set() };
+	VkDeviceSize vertexOffset = 0;
+
+	SceneDrawParams params = { };
+	memcpy(params.positionOffset, sceneMesh_.positionOffset, sizeof(params.positionOffset));
+	memcpy(params.positionScale, sceneMesh_.positionScale, sizeof(params.positionScale));
+	params.camera = camera_;
+
+	auto draw = [&](OcclusionCuller::Phase phase) {
+		dispatch_.CmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		dispatch_.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline_);
+		dispatch_.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0, 3, sets, 0, nullptr);
+		dispatch_.CmdSetViewport(commandBuffer, 0, 1, &viewport);
+		dispatch_.CmdSetScissor(commandBuffer, 0, 1, &scissor);
+		dispatch_.CmdBindVertexBuffers(commandBuffer, 0, 1, &sceneMesh_.vertices.buffer, &vertexOffset);
+		dispatch_.CmdBindIndexBuffer(commandBuffer, sceneMesh_.indices.buffer, 0, sceneMesh_.indexType);
+		params.listOffset = occlusion_.ListOffset(phase);
+		dispatch_.CmdPushConstants(commandBuffer, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(params), &params);
+		occlusion_.RecordDraw(commandBuffer, phase);
+		dispatch_.CmdEndRenderPass(commandBuffer);
+	};
+
+	// What was visible last frame, then what turns out to be visible against this frame's depth.
+	draw(OcclusionCuller::EARLY);
+	occlusion_.RecordLate(commandBuffer, frameIndex, instances_.Count(), frame.renderExtent, camera_);
+	renderPassInfo.renderPass = lateRenderPass_;
+	renderPassInfo.clearValueCount = 0;
+	renderPassInfo.pClearValues = nullptr;
+	draw(OcclusionCuller::LATE);
+	occlusion_.RecordReadback(commandBuffer, frameIndex);
+
+	profiler_.End(commandBuffer, frameIndex, GpuPass::Scene);
+	this->EndRecording(commandBuffer);
+}
+
+void HelloTriangleApplication::RecordPostProcess(int frameIndex) {
+	VkCommandBuffer commandBuffer = frames_[frameIndex].postCommandBuffer;
+	this->BeginRecording(commandBuffer);
+	profiler_.Begin(commandBuffer, frameIndex, GpuPass::PostProcess);
+	postProcess_.Record(commandBuffer, frameIndex, frames_[frameIndex].renderExtent);
+	profiler_.End(commandBuffer, frameIndex, GpuPass::PostProcess);
+	this->EndRecording(commandBuffer);
+}
+
+void HelloTriangleApplication::RecordComposite(int frameIndex, uint32_t imageIndex) {
+	const FrameResources& frame = frames_[frameIndex];
+	VkCommandBuffer commandBuffer = frame.compositeCommandBuffer;
+	const GpuImage& output = postProcess_.Output(frameIndex);
+	VkImage swapChainImage = swapChainImages_[imageIndex];
+
+	this->BeginRecording(commandBuffer);
+	profiler_.Begin(commandBuffer, frameIndex, GpuPass::Composite);
+
+	// The headless output is the same image every frame, so the previous overlay has to be done drawing to it.
+	VkImageMemoryBarrier barrier = { };
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = headless_ ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = swapChainImage;
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	dispatch_.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	// Upscales the frame from the resolution it was rendered at.
+	VkImageBlit blit = { };
+	blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	blit.srcOffsets[1] = { static_cast<int32_t>(frame.renderExtent.width), static_cast<int32_t>(frame.renderExtent.height), 1 };
+	blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	blit.dstOffsets[1] = { static_cast<int32_t>(swapChainExtent_.width), static_cast<int32_t>(swapChainExtent_.height), 1 };
+	dispatch_.CmdBlitImage(commandBuffer, output.image, VK_IMAGE_LAYOUT_GENERAL, swapChainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+	// The overlay's render pass takes the image on to presenting.
+	bool overlay = showOverlay_ && overlayVisible_;
+	if (!overlay) {
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		dispatch_.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+	profiler_.End(commandBuffer, frameIndex, GpuPass::Composite);
+
+	if (overlay) {
+		profiler_.Begin(commandBuffer, frameIndex, GpuPass::Overlay);
+		overlay_.Record(commandBuffer, frameIndex, imageIndex);
+		profiler_.End(commandBuffer, frameIndex, GpuPass::Overlay);
+	}
+	this->EndRecording(commandBuffer);
+}
+
+// Records the same stream of draws, each with its push constants the way the scene
+// pass records them, once through the loader's exported trampolines and once through
+// the device dispatch table and reports the cost per call.
+void HelloTriangleApplication::BenchmarkDispatch() {
+	const uint32_t commandsPerBuffer = 100000;
+	const int rounds = 20;
+
+	if (enableValidationLayers) puts("Warning: validation layers are enabled, dispatch timings include layer overhead!");
+
+	VkCommandPoolCreateInfo poolInfo = { };
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.pNext = nullptr;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamilyIndices_.graphicsFamily;
+
+	VkCommandPool benchmarkPool;
+	VkResult result = dispatch_.CreateCommandPool(device_, &poolInfo, nullptr, &benchmarkPool);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create benchmark command pool!");
+
+	VkCommandBufferAllocateInfo allocateInfo = { };
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.pNext = nullptr;
+	allocateInfo.commandPool = benchmarkPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	result = dispatch_.AllocateCommandBuffers(device_, &allocateInfo, &commandBuffer);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to allocate benchmark command buffer!");
+
+	VkCommandBufferBeginInfo beginInfo = { };
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.pNext = nullptr;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = nullptr;
+
+	// The scene render pass clears both attachments.
+	VkClearValue clearValues[2] = { };
+	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassInfo = { };
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.pNext = nullptr;
+	renderPassInfo.renderPass = renderPass_;
+	renderPassInfo.framebuffer = sceneFramebuffers_[0].Get();
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = swapChainExtent_;
+	renderPassInfo.clearValueCount = 2;
+	renderPassInfo.pClearValues = clearValues;
+
+	VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(swapChainExtent_.width), static_cast<float>(swapChainExtent_.height), 0.0f, 1.0f };
+	VkRect2D scissor = { { 0, 0 }, swapChainExtent_ };
+	VkDescriptorSet sets[] = { instances_.Set(), occlusion_.DrawSet(), lighting_.Set() };
+	VkDeviceSize vertexOffset = 0;
+
+	SceneDrawParams params = { };
+	memcpy(params.positionOffset, sceneMesh_.positionOffset, sizeof(params.positionOffset));
+	memcpy(params.positionScale, sceneMesh_.positionScale, sizeof(params.positionScale));
+	params.camera = camera_;
+	params.listOffset = occlusion_.ListOffset(OcclusionCuller::EARLY);
+
+	auto measure = [&](PFN_vkCmdPushConstants cmdPushConstants, PFN_vkCmdDraw cmdDraw) {
+		double totalSeconds = 0.0;
+
+		for (int round = 0; round < rounds; ++round) {
+			dispatch_.ResetCommandPool(device_, benchmarkPool, 0);
+			dispatch_.BeginCommandBuffer(commandBuffer, &beginInfo);
+			dispatch_.CmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			dispatch_.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline_);
+			dispatch_.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0, 3, sets, 0, nullptr);
+			dispatch_.CmdBindVertexBuffers(commandBuffer, 0, 1, &sceneMesh_.vertices.buffer, &vertexOffset);
+			dispatch_.CmdSetViewport(commandBuffer, 0, 1, &viewport);
+			dispatch_.CmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < commandsPerBuffer; i += 2) {
+				cmdPushConstants(commandBuffer, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(params), &params);
+				cmdDraw(commandBuffer, 3, 1, 0, 0);
+			}
+			totalSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+			dispatch_.CmdEndRenderPass(commandBuffer);
+			dispatch_.EndCommandBuffer(commandBuffer);
+		}
+
+		return totalSeconds / (static_cast<double>(commandsPerBuffer) * rounds);
+	};
+
+	// Warm up both paths once so neither pays for first-touch allocations.
+	measure(vkCmdPushConstants, vkCmdDraw);
+	measure(dispatch_.CmdPushConstants, dispatch_.CmdDraw);
+
+	double loaderSeconds = measure(vkCmdPushConstants, vkCmdDraw);
+	double directSeconds = measure(dispatch_.CmdPushConstants, dispatch_.CmdDraw);
+
+	printf("vkCmdPushConstants + vkCmdDraw via loader:         %7.2f ns/call, %7.2f M commands/s\n", loaderSeconds * 1e9, 1e-6 / loaderSeconds);
+	printf("vkCmdPushConstants + vkCmdDraw via dispatch table: %7.2f ns/call, %7.2f M commands/s\n", directSeconds * 1e9, 1e-6 / directSeconds);
+	printf("Dispatch overhead saved: %.2f ns/call (%.1f%%)\n", (loaderSeconds - directSeconds) * 1e9, 100.0 * (loaderSeconds - directSeconds) / loaderSeconds);
+
+	dispatch_.DestroyCommandPool(device_, benchmarkPool, nullptr);
+}
+
+
+// Floods the sink from several threads, the way a validation message storm does,
+// and reports what each push costs the calling thread.
+void HelloTriangleApplication::BenchmarkDebugSink() {
+	const int threadCount = 4;
+	const int messagesPerThread = 250000;
+
+	DebugMessageSink& sink = GetDebugSink();
+	std::vector<std::thread> threads;
+	std::vector<double> seconds(threadCount);
+
+	for (int t = 0; t < threadCount; ++t) {
+		threads.emplace_back([&sink, &seconds, t]() {
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < messagesPerThread; ++i) {
+				sink.PushReport(VK_DEBUG_REPORT_WARNING_BIT_EXT, VK_DEBUG_REPORT_OBJECT_TYPE_UNKNOWN_EXT, i % 64, t, "Benchmark", "Synthetic validation message, pushed to measure the cost of the debug callback.");
+			}
+			seconds[t] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		});
+	}
+	for (std::thread& thread : threads) thread.join();
+
+	double worstSeconds = *std::max_element(seconds.begin(), seconds.end());
+	printf("Debug sink push: %.1f ns/message (slowest of %d threads, %d messages each)\n", worstSeconds * 1e9 / messagesPerThread, threadCount, messagesPerThread);
+}
+
+// Builds a three level hierarchy of about a million entities and measures the
+// transform update and the change collection with everything, one percent and
+// nothing moving, on one worker and on all of them.
+void HelloTriangleApplication::BenchmarkScene() {
+	const uint32_t rootCount = 1024;
+	const uint32_t childrenPerEntity = 31;
+	const int rounds = 20;
+	const BoundingSphere bounds = { { 0.0f, 0.0f, 0.0f }, 1.0f };
+
+	SceneStore scene;
+	std::vector<Entity> roots;
+	std::vector<Entity> leaves;
+	for (uint32_t r = 0; r < rootCount; ++r) {
+		Entity root = scene.Create(INVALID_ENTITY, { { static_cast<float>(r), 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 1.0f }, bounds, { 0, 0 });
+		roots.push_back(root);
+		for (uint32_t c = 0; c < childrenPerEntity; ++c) {
+			Entity child = scene.Create(root, { { 0.0f, static_cast<float>(c), 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0.5f }, bounds, { 0, 0 });
+			for (uint32_t l = 0; l < childrenPerEntity; ++l) {
+				leaves.push_back(scene.Create(child, { { 0.0f, 0.0f, static_cast<float>(l) }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0.5f }, bounds, { 0, 0 }));
+			}
+		}
+	}
+
+	std::vector<SceneRange> ranges;
+	std::vector<uint32_t> workerCounts = { 1 };
+	if (std::thread::hardware_concurrency() > 1) workerCounts.push_back(std::thread::hardware_concurrency());
+	printf("Scene: %u entities in 3 levels, %d rounds per case\n", scene.Size(), rounds);
+
+	for (uint32_t workerCount : workerCounts) {
+		JobSystem jobs;
+		jobs.Start(workerCount);
+		// Sorts the instances and computes everything once.
+		scene.Update(jobs);
+
+		auto measure = [&](const char* name, const std::function<void(float)>& move) {
+			double updateMs = 0.0;
+			double collectMs = 0.0;
+			for (int round = 0; round < rounds; ++round) {
+				move(static_cast<float>(round));
+
+				auto start = std::chrono::high_resolution_clock::now();
+				scene.Update(jobs);
+				auto updated = std::chrono::high_resolution_clock::now();
+				scene.CollectChanges(ranges);
+				auto collected = std::chrono::high_resolution_clock::now();
+
+				updateMs += std::chrono::duration<double, std::milli>(updated - start).count();
+				collectMs += std::chrono::duration<double, std::milli>(collected - updated).count();
+			}
+
+			uint32_t changed = 0;
+			for (const SceneRange& range : ranges) changed += range.count;
+			printf("  %-12s update %8.3f ms (%5.2f ns/entity), collect %7.3f ms, %7u uploaded in %6u ranges\n", name, updateMs / rounds, 1e6 * updateMs / rounds / scene.Size(), collectMs / rounds, changed, static_cast<uint32_t>(ranges.size()));
+		};
+
+		auto moveEntity = [&scene](Entity entity, float offset) {
+			Transform local = scene.Local(entity);
+			local.position[0] += offset;
+			scene.SetLocal(entity, local);
+		};
+
+		printf("%u worker%s:\n", workerCount, workerCount > 1 ? "s" : "");
+		measure("all moving", [&](float offset) { for (Entity root : roots) moveEntity(root, offset); });
+		measure("1% moving", [&](float offset) { for (size_t i = 0; i < leaves.size(); i += 100) moveEntity(leaves[i], offset); });
+		measure("static", [](float) { });
+
+		jobs.Stop();
+	}
+
+	// The floor every system that walks the scene pays: one pass over a packed component array.
+	auto start = std::chrono::high_resolution_clock::now();
+	float radiusSum = 0.0f;
+	for (int round = 0; round < rounds; ++round) {
+		const BoundingSphere* worldBounds = scene.WorldBounds();
+		for (uint32_t i = 0; i < scene.Size(); ++i) radiusSum += worldBounds[i].radius;
+	}
+	double iterateMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / rounds;
+	printf("Iterating world bounds: %.3f ms (%.2f ns/entity, checksum %.0f)\n", iterateMs, 1e6 * iterateMs / scene.Size(), radiusSum);
+}
+
+// Renders the live scene headless with more and more lights of the same radius and
+// prints the median cost of binning and shading them. The scene pass grows with how
+// many lights overlap a cluster until clusters start to fill up; from there the most
+// full clusters and dropped lights of a frame show what keeping its cost bounded loses,
+// and the timings of that count are marked as invalid.
+void HelloTriangleApplication::BenchmarkLights() {
+	static const uint32_t lightCounts[] = { 0, 256, 1024, 4096, 16384, 65536 };
+	const int frames = 200;
+	if (enableValidationLayers) puts("Warning: validation layers are enabled, timings include layer overhead!");
+
+	printf("Lights: %d frames per count, medians after %d warmup frames\n", frames, SUITE_WARMUP_FRAMES);
+	printf("  %8s %8s %8s %10s %10s %10s %10s\n", "lights", "full", "dropped", "CPU ms", "bin ms", "scene ms", "GPU ms");
+	for (uint32_t lightCount : lightCounts) {
+		lighting_.SetLights(lightCount, SCENE_LIGHT_BOUNDS[0], SCENE_LIGHT_BOUNDS[1]);
+		this->RunTimedFrames(frames, [](int) { });
+
+		std::vector<double> cpuMs;
+		std::vector<double> binMs;
+		std::vector<double> sceneMs;
+		std::vector<double> gpuMs;
+		for (size_t i = SUITE_WARMUP_FRAMES; i < frameTimings_.size(); ++i) {
+			const FrameTiming& timing = frameTimings_[i];
+			cpuMs.push_back(timing.cpuMs);
+			binMs.push_back(timing.passMs[static_cast<int>(GpuPass::Lights)]);
+			sceneMs.push_back(timing.passMs[static_cast<int>(GpuPass::Scene)]);
+			gpuMs.push_back(timing.gpuMs);
+		}
+
+		const ClusterOverflow& overflow = lighting_.MaxOverflow();
+		printf("  %8u %8u %8u %10.3f %10.3f %10.3f %10.3f%s\n", lighting_.LightCount(), overflow.clusters, overflow.droppedLights, SummarizeFrameTimes(cpuMs).medianMs,
+			SummarizeFrameTimes(binMs).medianMs, SummarizeFrameTimes(sceneMs).medianMs, SummarizeFrameTimes(gpuMs).medianMs, overflow.clusters > 0 ? "  invalid" : "");
+	}
+}
+
+// Runs each optimization over a few spheres, one of them with its triangles
+// shuffled the way a careless exporter might leave them, and prints the cache and
+// fetch statistics after every step, then what quantization saves and costs.
+void HelloTriangleApplication::ReportMeshOptimization() {
+	struct TestMesh {
+		const char* name;
+		MeshData data;
+	};
+
+	std::vector<TestMesh> meshes;
+	meshes.push_back({ "icosphere 3", CreateIcosphere(1.0f, 3) });
+	meshes.push_back({ "icosphere 5", CreateIcosphere(1.0f, 5) });
+
+	MeshData shuffled = CreateIcosphere(1.0f, 5);
+	std::vector<uint32_t> triangles(shuffled.indices.size() / 3);
+	for (uint32_t i = 0; i < triangles.size(); ++i) triangles[i] = i;
+	std::shuffle(triangles.begin(), triangles.end(), std::mt19937(1));
+	std::vector<uint32_t> shuffledIndices;
+	for (uint32_t triangle : triangles) shuffledIndices.insert(shuffledIndices.end(), &shuffled.indices[3 * triangle], &shuffled.indices[3 * triangle] + 3);
+	shuffled.indices = shuffledIndices;
+	meshes.push_back({ "shuffled 5", shuffled });
+
+	const uint32_t floatSize = VertexSize(VertexFormat::Float);
+	const uint32_t quantizedSize = VertexSize(VertexFormat::Quantized);
+
+	for (TestMesh& mesh : meshes) {
+		MeshData& data = mesh.data;
+		uint32_t vertexCount = static_cast<uint32_t>(data.vertices.size());
+		printf("%s: %u vertices, %u triangles\n", mesh.name, vertexCount, static_cast<uint32_t>(data.indices.size() / 3));
+
+		auto print = [&](const char* step, double ms) {
+			VertexCacheStats cache = AnalyzeVertexCache(data.indices, vertexCount);
+			VertexFetchStats fetch = AnalyzeVertexFetch(data.indices, vertexCount, floatSize);
+			printf("  %-13s ACMR %5.3f, ATVR %5.3f, overfetch %5.2f, %7.3f ms\n", step, cache.acmr, cache.atvr, fetch.overfetch, ms);
+		};
+
+		auto timed = [](const std::function<void()>& step) {
+			auto start = std::chrono::high_resolution_clock::now();
+			step();
+			return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		};
+
+		print("source", 0.0);
+		print("vertex cache", timed([&]() { OptimizeVertexCache(data.indices, vertexCount); }));
+		print("overdraw", timed([&]() { OptimizeOverdraw(data.indices, data.vertices[0].position, sizeof(MeshVertex) / sizeof(float), vertexCount); }));
+
+		double fetchMs = timed([&]() {
+			std::vector<uint32_t> remap = OptimizeVertexFetch(data.indices, vertexCount);
+			std::vector<MeshVertex> vertices(remap.size());
+			for (size_t i = 0; i < remap.size(); ++i) vertices[i] = data.vertices[remap[i]];
+			data.vertices.swap(vertices);
+		});
+		vertexCount = static_cast<uint32_t>(data.vertices.size());
+		print("vertex fetch", fetchMs);
+
+		QuantizedMesh quantized = QuantizeMesh(data);
+		float positionError = 0.0f;
+		float normalError = 0.0f;
+		MeasureQuantizationError(data, quantized, positionError, normalError);
+
+		uint32_t indexSize = vertexCount <= 0xFFFF ? sizeof(uint16_t) : sizeof(uint32_t);
+		size_t floatBytes = vertexCount * floatSize + data.indices.size() * sizeof(uint32_t);
+		size_t quantizedBytes = vertexCount * quantizedSize + data.indices.size() * indexSize;
+		printf("  quantized     %u -> %u bytes per vertex, %u -> %u bytes per index, %zu -> %zu bytes (%.1f%%)\n", floatSize, quantizedSize, static_cast<uint32_t>(sizeof(uint32_t)), indexSize, floatBytes, quantizedBytes, 100.0 * quantizedBytes / floatBytes);
+		printf("                position error %.2e of the extent, normal error %.2f degrees\n", positionError, normalError);
+	}
+}
+
+// Runs a synthetic frame graph shaped like an engine frame (animation, culling
+// per view, command recording, each stage depending on the one before) on 1 to
+// 32 workers and reports how close each count comes to linear scaling.
+void HelloTriangleApplication::BenchmarkJobs() {
+	const uint32_t workerCounts[] = { 1, 2, 4, 8, 16, 32 };
+	const int warmupFrames = 5;
+	const int frames = 60;
+	const uint32_t objectCount = 16384;
+	const uint32_t viewCount = 4;
+	const uint32_t recordJobCount = 32;
+
+	// Stands in for real work: a dependent chain the compiler can't fold away.
+	auto work = [](uint32_t seed, int iterations) {
+		uint32_t x = seed | 1;
+		for (int i = 0; i < iterations; ++i) x = x * 1664525u + 1013904223u;
+		return x;
+	};
+
+	std::vector<uint32_t> transforms(objectCount);
+	std::vector<uint32_t> visible(viewCount * objectCount);
+	std::vector<uint32_t> commands(recordJobCount);
+
+	auto runFrame = [&](JobSystem& jobs) {
+		JobCounter animated;
+		jobs.ParallelFor(objectCount, 64, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) transforms[i] = work(i, 200);
+		}, animated);
+
+		JobCounter culled;
+		for (uint32_t view = 0; view < viewCount; ++view) {
+			jobs.Run([&, view]() {
+				jobs.Wait(animated);
+				JobCounter viewCulled;
+				jobs.ParallelFor(objectCount, 128, [&, view](uint32_t begin, uint32_t end) {
+					for (uint32_t i = begin; i < end; ++i) visible[view * objectCount + i] = work(transforms[i] + view, 50);
+				}, viewCulled);
+				jobs.Wait(viewCulled);
+			}, culled);
+		}
+
+		JobCounter recorded;
+		for (uint32_t j = 0; j < recordJobCount; ++j) {
+			jobs.Run([&, j]() {
+				jobs.Wait(culled);
+				uint32_t x = 0;
+				for (uint32_t i = j; i < viewCount * objectCount; i += recordJobCount) x += work(visible[i], 20);
+				commands[j] = x;
+			}, recorded);
+		}
+
+		jobs.Wait(recorded);
+	};
+
+	uint32_t hardwareThreads = std::thread::hardware_concurrency();
+	printf("Job system: %u hardware threads, %d frames per worker count\n", hardwareThreads, frames);
+
+	double singleWorkerMs = 0.0;
+	for (uint32_t workerCount : workerCounts) {
+		JobSystem jobs;
+		jobs.Start(workerCount);
+		for (int frame = 0; frame < warmupFrames; ++frame) runFrame(jobs);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frames; ++frame) runFrame(jobs);
+		double frameMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / frames;
+		jobs.Stop();
+
+		if (workerCount == 1) singleWorkerMs = frameMs;
+		double speedup = singleWorkerMs / frameMs;
+		printf("%2u workers: %7.3f ms/frame, speedup %5.2fx, efficiency %5.1f%%%s\n", workerCount, frameMs, speedup, 100.0 * speedup / workerCount, workerCount > hardwareThreads ? " (more workers than hardware threads)" : "");
+	}
 }
 
 
@@ -139,9 +1139,10 @@ bool HelloTriangleApplication::CheckValidationLayerSupport() {
 	std::vector<VkLayerProperties> availableLayers(layerCount);
 	vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
 
-	puts("Supported validation layers:");
-
-	for (const auto& layerProperties : availableLayers) printf("\t%s\n", layerProperties.layerName);
+	if (enableVerboseStartup) {
+		puts("Supported validation layers:");
+		for (const auto& layerProperties : availableLayers) printf("\t%s\n", layerProperties.layerName);
+	}
 
 	puts("Checking required validation layers:");
 	for (const char* layerName : validationLayers) {
@@ -165,17 +1166,15 @@ bool HelloTriangleApplication::CheckValidationLayerSupport() {
 	return true;
 }
 
-bool HelloTriangleApplication::IsDeviceSuitable(VkPhysicalDevice device) {
-	VkPhysicalDeviceProperties deviceProperties;
-	VkPhysicalDeviceFeatures deviceFeatures;
-	vkGetPhysicalDeviceProperties(device, &deviceProperties);
-	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-	
-	QueueFamilyIndices indices = this->FindQueueFamilies(device);
+bool HelloTriangleApplication::IsDeviceSuitable(VkPhysicalDevice device, QueueFamilyIndices& indices, SwapChainSupportDetails& swapChainSupport) {
+	indices = this->FindQueueFamilies(device);
+	if (!indices.IsComplete()) return false;
+	if (headless_) return true;
+
 	bool exensionsSupported = this->CheckDeviceExtensionSupport(device);
 	bool swapChainAdequate = false;
 	if (exensionsSupported) {
-		SwapChainSupportDetails swapChainSupport = this->QuerySwapChainSupport(device);
+		swapChainSupport = this->QuerySwapChainSupport(device);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
 
@@ -191,15 +1190,28 @@ HelloTriangleApplication::QueueFamilyIndices HelloTriangleApplication::FindQueue
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
 	for (int i = 0; i < queueFamilies.size(); ++i) {
-		if (queueFamilies[i].queueCount > 0 && queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) indices.graphicsFamily = i;
+		if (queueFamilies[i].queueCount == 0) continue;
 
-		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
-		if (queueFamilies[i].queueCount > 0 && presentSupport) indices.presentFamily = i;
+		bool graphics = (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		if (graphics && indices.graphicsFamily < 0) indices.graphicsFamily = i;
+
+		// A compute family without graphics runs on the async compute engine.
+		if (!graphics && (queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && indices.computeFamily < 0) indices.computeFamily = i;
 
-		if (indices.IsComplete()) break;
+		VkBool32 presentSupport = false;
+		if (!headless_) vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+		if (presentSupport && indices.presentFamily < 0) indices.presentFamily = i;
 	}
 
+	// Nothing is presented without a window; the graphics queue stands in for the present queue.
+	if (headless_) indices.presentFamily = indices.graphicsFamily;
+
+	// Graphics families always support compute, so post-processing falls back to the graphics family.
+	if (indices.computeFamily < 0) indices.computeFamily = indices.graphicsFamily;
+
+	if (indices.graphicsFamily >= 0) indices.graphicsTimestampBits = queueFamilies[indices.graphicsFamily].timestampValidBits;
+	if (indices.computeFamily >= 0) indices.computeTimestampBits = queueFamilies[indices.computeFamily].timestampValidBits;
+
 	return indices;
 }
 
@@ -209,9 +1221,10 @@ bool HelloTriangleApplication::CheckDeviceExtensionSupport(VkPhysicalDevice devi
 	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-	puts("\tSupported device extensions:");
-
-	for (const auto& extension : availableExtensions) printf("\t\t%s\n", extension.extensionName);
+	if (enableVerboseStartup) {
+		puts("\tSupported device extensions:");
+		for (const auto& extension : availableExtensions) printf("\t\t%s\n", extension.extensionName);
+	}
 
 	puts("\tChecking required device extension:");
 	for (const char* requiredExtension : deviceExtensions) {
@@ -290,26 +1303,17 @@ VkExtent2D HelloTriangleApplication::ChooseSwapExtent(const VkSurfaceCapabilitie
 	return actualExtent;
 }
 
-VkShaderModule HelloTriangleApplication::CreateShaderModule(const std::vector<char>& code) {
-	std::vector<uint32_t> codeAligned(code.size() / sizeof(uint32_t) + 1);
-	memcpy(codeAligned.data(), code.data(), code.size());
 
-	VkShaderModuleCreateInfo createInfo = { };
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.pNext = nullptr;
-	createInfo.flags = 0;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = codeAligned.data();
-
-	VkShaderModule shaderModule;
-	VkResult result = vkCreateShaderModule(device_, &createInfo, nullptr, &shaderModule);
-	printf("vkCreateShaderModule result: %d\n", result);
-	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create shader module!");
+void HelloTriangleApplication::LoadShaders() {
+	// One mapping for every module; the SPIR-V is only paged in when a module is created from it.
+	shaders_.Open("CompiledShaders/shaders.bundle");
 
-	return shaderModule;
+	printf("Shader bundle: %d modules, %d pipelines, %d bytes\n", static_cast<int>(shaders_.Modules().size()), static_cast<int>(shaders_.Pipelines().size()), static_cast<int>(shaders_.Size()));
+	for (const ShaderModuleInfo& module : shaders_.Modules()) {
+		printf("%s shader code size: %d, %d bindings, %d bytes of push constants\n", module.name, static_cast<int>(module.code.size), static_cast<int>(module.bindingCount), static_cast<int>(module.pushConstantSize));
+	}
 }
 
-
 void HelloTriangleApplication::SetupDebugCallback() {
 	if (!enableValidationLayers) return;
 
@@ -318,24 +1322,27 @@ void HelloTriangleApplication::SetupDebugCallback() {
 	createInfo.pNext = nullptr;
 	createInfo.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
 	createInfo.pfnCallback = this->DebugCallback;
-	createInfo.pUserData = this;
+	createInfo.pUserData = &GetDebugSink();
 
-	VkResult result = CreateDebugReportCallbackEXT(instance_, &createInfo, nullptr, &callback_);
-	printf("CreateDebugReportCallbackEXT result: %d\n", result);
+	VkResult result = VK_ERROR_EXTENSION_NOT_PRESENT;
+	if (instanceDispatch_.CreateDebugReportCallbackEXT) result = instanceDispatch_.CreateDebugReportCallbackEXT(instance_, &createInfo, nullptr, &callback_);
+	LogResult("CreateDebugReportCallbackEXT", result);
 	if (result != VK_SUCCESS) throw std::runtime_error("Failed to set up debug callback!");
 }
 
 void HelloTriangleApplication::CreateSurface() {
 	VkResult result = glfwCreateWindowSurface(instance_, window_, nullptr, &surface_);
-	printf("glfwCreateWindowSurface result: %d\n", result);
+	LogResult("glfwCreateWindowSurface", result);
 	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create window surface!");
 }
 
 void HelloTriangleApplication::GetRequiredExtensions(std::vector<const char*>& extensions) {
-	unsigned int glfwExtensionCount = 0;
-	const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	if (!headless_) {
+		unsigned int glfwExtensionCount = 0;
+		const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-	for (unsigned int i = 0; i < glfwExtensionCount; ++i) extensions.push_back(glfwExtensions[i]);
+		for (unsigned int i = 0; i < glfwExtensionCount; ++i) extensions.push_back(glfwExtensions[i]);
+	}
 
 	if (enableValidationLayers) extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 }
@@ -371,16 +1378,20 @@ void HelloTriangleApplication::CreateInstance() {
 	}
 
 	VkResult result = vkCreateInstance(&createInfo, nullptr, &instance_);
-	printf("vkCreateInstance result: %d\n", result);
+	LogResult("vkCreateInstance", result);
 	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create instance!");
 
+	instanceDispatch_.Load(instance_);
+
 	uint32_t extensionCount = 0;
 	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
 	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
 
-	puts("Supported extensions:");
-	for (const auto& extension : availableExtensions) printf("\t%s\n", extension.extensionName);
+	if (enableVerboseStartup) {
+		puts("Supported extensions:");
+		for (const auto& extension : availableExtensions) printf("\t%s\n", extension.extensionName);
+	}
 
 	puts("Checking required extensions:");
 	for (const auto& extensionName : requiredExtensions) {
@@ -409,22 +1420,33 @@ void HelloTriangleApplication::PickPhysicalDevice() {
 	std::vector<VkPhysicalDevice> devices(deviceCount);
 	vkEnumeratePhysicalDevices(instance_, &deviceCount, devices.data());
 
+	// Queue families and surface support are queried once here and cached for the
+	// logical device, swap chain and command pool instead of being re-queried.
 	for (uint32_t i = 0; i < deviceCount; ++i) {
 		printf("Checking suitability of device %d:\n", i);
-		if (this->IsDeviceSuitable(devices[i])) {
+
+		QueueFamilyIndices indices;
+		SwapChainSupportDetails swapChainSupport;
+		if (this->IsDeviceSuitable(devices[i], indices, swapChainSupport)) {
 			physicalDevice_ = devices[i];
+			queueFamilyIndices_ = indices;
+			swapChainSupport_ = swapChainSupport;
 			break;
 		}
 	}
 
 	if (physicalDevice_ == VK_NULL_HANDLE) throw std::runtime_error("Failed to find suitable GPU!");
+
+	vkGetPhysicalDeviceProperties(physicalDevice_, &physicalDeviceProperties_);
+	printf("Using device: %s\n", physicalDeviceProperties_.deviceName);
+	printf("Post-processing queue family: %d (%s)\n", queueFamilyIndices_.computeFamily, queueFamilyIndices_.computeFamily != queueFamilyIndices_.graphicsFamily ? "async compute" : "shared with graphics");
 }
 
 void HelloTriangleApplication::CreateLogicalDevice() {
-	QueueFamilyIndices indices = this->FindQueueFamilies(physicalDevice_);
+	const QueueFamilyIndices& indices = queueFamilyIndices_;
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+	std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily, indices.computeFamily };
 
 	float queuePriority = 1.0f;
 	for (int queueFamily : uniqueQueueFamilies) {
@@ -447,8 +1469,8 @@ void HelloTriangleApplication::CreateLogicalDevice() {
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	createInfo.enabledExtensionCount = headless_ ? 0 : static_cast<uint32_t>(deviceExtensions.size());
+	createInfo.ppEnabledExtensionNames = headless_ ? nullptr : deviceExtensions.data();
 	if (enableValidationLayers) {
 		createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
 		createInfo.ppEnabledLayerNames = validationLayers.data();
@@ -458,15 +1480,46 @@ void HelloTriangleApplication::CreateLogicalDevice() {
 	}
 
 	VkResult result = vkCreateDevice(physicalDevice_, &createInfo, nullptr, &device_);
-	printf("vkCreateDevice result: %d\n", result);
+	LogResult("vkCreateDevice", result);
 	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create logical device!");
 
-	vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
-	vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+	dispatch_.Load(device_);
+
+	dispatch_.GetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
+	dispatch_.GetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+	dispatch_.GetDeviceQueue(device_, indices.computeFamily, 0, &computeQueue_);
+
+	// There is no dedicated transfer queue yet, so that lane shares the graphics queue.
+	scheduler_.Init(device_, &dispatch_, graphicsQueue_, computeQueue_, graphicsQueue_);
+
+	gpu_.physicalDevice = physicalDevice_;
+	gpu_.device = device_;
+	gpu_.dispatch = &dispatch_;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice_, &gpu_.memoryProperties);
+	gpu_.queueFamilies.clear();
+	gpu_.queueFamilies.push_back(indices.graphicsFamily);
+	if (indices.computeFamily != indices.graphicsFamily) gpu_.queueFamilies.push_back(indices.computeFamily);
+
+	deletionQueue_.Init(gpu_, &scheduler_);
+	gpu_.deletionQueue = &deletionQueue_;
 }
 
 void HelloTriangleApplication::CreateSwapChain() {
-	SwapChainSupportDetails swapChainSupport = this->QuerySwapChainSupport(physicalDevice_);
+	// Without a window the scene targets are sized for the trace and nothing is presented.
+	if (headless_) {
+		swapChainExtent_ = headlessExtent_;
+		dynamicResolution_.SetMaxExtent(headlessExtent_);
+		if (showOverlay_) {
+			headlessOutput_ = CreateImage2D(gpu_, HEADLESS_OUTPUT_FORMAT, headlessExtent_, 1, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+			swapChainImages_.assign(1, headlessOutput_.image);
+			swapChainImageFormat_ = HEADLESS_OUTPUT_FORMAT;
+		}
+		return;
+	}
+
+	// Formats and present modes don't change with the window size, only the capabilities do.
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice_, surface_, &swapChainSupport_.capabilities);
+	const SwapChainSupportDetails& swapChainSupport = swapChainSupport_;
 
 	VkSurfaceFormatKHR surfaceFormat = this->ChooseSwapSurfaceFormat(swapChainSupport.formats);
 	VkPresentModeKHR presentMode = this->ChooseSwapPresentMode(swapChainSupport.presentModes);
@@ -475,7 +1528,13 @@ void HelloTriangleApplication::CreateSwapChain() {
 	uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
 	if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) imageCount = swapChainSupport.capabilities.maxImageCount;
 
-	QueueFamilyIndices indices = this->FindQueueFamilies(physicalDevice_);
+	// The post-processed image is blitted into the swap chain image.
+	if (!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) throw std::runtime_error("Swap chain images don't support transfer!");
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice_, surfaceFormat.format, &formatProperties);
+	if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT)) throw std::runtime_error("Swap chain format doesn't support blits!");
+
+	const QueueFamilyIndices& indices = queueFamilyIndices_;
 	uint32_t queueFamilyIndices[] = { static_cast<uint32_t>(indices.graphicsFamily), static_cast<uint32_t>(indices.presentFamily) };
 
 	VkSwapchainCreateInfoKHR createInfo = { };
@@ -488,7 +1547,7 @@ void HelloTriangleApplication::CreateSwapChain() {
 	createInfo.imageColorSpace = surfaceFormat.colorSpace;
 	createInfo.imageExtent = extent;
 	createInfo.imageArrayLayers = 1;
-	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 	if (indices.graphicsFamily != indices.presentFamily) {
 		createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
 		createInfo.queueFamilyIndexCount = 2;
@@ -502,17 +1561,33 @@ void HelloTriangleApplication::CreateSwapChain() {
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	// Handing over the old swap chain lets the presentation engine reuse its resources.
+	createInfo.oldSwapchain = swapchain_;
 
-	VkResult result = vkCreateSwapchainKHR(device_, &createInfo, nullptr, &swapchain_);
-	printf("vkCreateSwapchainKHR result: %d\n", result);
+	VkResult result = dispatch_.CreateSwapchainKHR(device_, &createInfo, nullptr, &swapchain_);
+	LogResult("vkCreateSwapchainKHR", result);
 	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create swap chain!");
+	if (createInfo.oldSwapchain != VK_NULL_HANDLE) {
+		// Presents execute in order with the submissions of their queue, so when that is the
+		// graphics queue an empty submission made now retires after the old swap chain's last
+		// present. A present queue of its own has no tickets and is drained instead; that only
+		// happens on a resize.
+		GpuTicket afterPresent;
+		if (presentQueue_ == graphicsQueue_) {
+			afterPresent = scheduler_.Submit(QueueType::Graphics, SubmitBatch());
+		} else {
+			dispatch_.QueueWaitIdle(presentQueue_);
+			afterPresent = scheduler_.LastSubmitted();
+		}
+		deletionQueue_.DestroySwapchainKHR(createInfo.oldSwapchain, afterPresent);
+	}
 
-	vkGetSwapchainImagesKHR(device_, swapchain_, &imageCount, nullptr);
+	dispatch_.GetSwapchainImagesKHR(device_, swapchain_, &imageCount, nullptr);
 	swapChainImages_.resize(imageCount);
-	vkGetSwapchainImagesKHR(device_, swapchain_, &imageCount, swapChainImages_.data());
+	dispatch_.GetSwapchainImagesKHR(device_, swapchain_, &imageCount, swapChainImages_.data());
 	swapChainImageFormat_ = surfaceFormat.format;
 	swapChainExtent_ = extent;
+	dynamicResolution_.SetMaxExtent(extent);
 }
 
 void HelloTriangleApplication::CreateImageViews() {
@@ -536,28 +1611,45 @@ void HelloTriangleApplication::CreateImageViews() {
 		createInfo.subresourceRange.baseArrayLayer = 0;
 		createInfo.subresourceRange.layerCount = 1;
 
-		VkResult result = vkCreateImageView(device_, &createInfo, nullptr, &swapChainImageViews_[i]);
-		printf("vkCreateImageView %d result: %d\n", static_cast<int>(i), result);
+		VkImageView view;
+		VkResult result = dispatch_.CreateImageView(device_, &createInfo, nullptr, &view);
+		LogResult("vkCreateImageView", result, i);
 		if (result != VK_SUCCESS) throw std::runtime_error("Failed to create image views!");
+		swapChainImageViews_[i] = UniqueImageView(deletionQueue_, view);
 	}
 }
 
 void HelloTriangleApplication::CreateRenderPass() {
-	VkAttachmentDescription colorAttachment = { };
-	colorAttachment.flags = 0;
-	colorAttachment.format = swapChainImageFormat_;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	VkAttachmentDescription attachments[2] = { };
+	attachments[0].flags = 0;
+	attachments[0].format = SCENE_COLOR_FORMAT;
+	attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	// The occlusion culling builds its depth pyramid from the early pass's depth.
+	attachments[1].flags = 0;
+	attachments[1].format = SCENE_DEPTH_FORMAT;
+	attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
 	VkAttachmentReference colorAttachmentRef = { };
 	colorAttachmentRef.attachment = 0;
 	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+	VkAttachmentReference depthAttachmentRef = { };
+	depthAttachmentRef.attachment = 1;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
 	VkSubpassDescription subpass = { };
 	subpass.flags = 0;
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -566,44 +1658,152 @@ void HelloTriangleApplication::CreateRenderPass() {
 	subpass.colorAttachmentCount = 1;
 	subpass.pColorAttachments = &colorAttachmentRef;
 	subpass.pResolveAttachments = nullptr;
-	subpass.pDepthStencilAttachment = nullptr;
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
 	subpass.preserveAttachmentCount = 0;
 	subpass.pPreserveAttachments = nullptr;
 
+	// The slot's depth was last read by the pyramid build of its previous frame.
 	VkSubpassDependency dependency = { };
 	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
 	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	dependency.dependencyFlags = 0;
 
 	VkRenderPassCreateInfo renderPassInfo = { };
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	renderPassInfo.pNext = nullptr;
 	renderPassInfo.flags = 0;
-	renderPassInfo.attachmentCount = 1;
-	renderPassInfo.pAttachments = &colorAttachment;
+	renderPassInfo.attachmentCount = 2;
+	renderPassInfo.pAttachments = attachments;
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
 	renderPassInfo.dependencyCount = 1;
 	renderPassInfo.pDependencies = &dependency;
 
-	VkResult result = vkCreateRenderPass(device_, &renderPassInfo, nullptr, &renderPass_);
-	printf("vkCreateRenderPass result: %d\n", result);
+	VkResult result = dispatch_.CreateRenderPass(device_, &renderPassInfo, nullptr, &renderPass_);
+	LogResult("vkCreateRenderPass", result);
 	if (result != VK_SUCCESS) throw std::runtime_error("Failed to cerate render pass!");
+
+	// The late pass continues on the early pass's targets, after the pyramid build read the depth.
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	// Post-processing reads the scene color as a storage image.
+	attachments[0].finalLayout = VK_IMAGE_LAYOUT_GENERAL;
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	result = dispatch_.CreateRenderPass(device_, &renderPassInfo, nullptr, &lateRenderPass_);
+	LogResult("vkCreateRenderPass", result);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to cerate late render pass!");
+}
+
+// A small solar system: the root, planets circling it and moons circling them.
+void HelloTriangleApplication::CreateScene() {
+	if (suiteScene_ && suiteScene_->gridInstances > 0) {
+		this->CreateGridScene(suiteScene_->gridInstances);
+		return;
+	}
+
+	const float pi = 3.14159265f;
+	// Encloses the sphere mesh every entity is drawn with.
+	const BoundingSphere meshBounds = { { 0.0f, 0.0f, 0.0f }, 0.5f };
+
+	sceneRoot_ = scene_.Create(INVALID_ENTITY, { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0.3f }, meshBounds, { 0, 0 });
+
+	for (uint32_t p = 0; p < SCENE_PLANET_COUNT; ++p) {
+		float angle = 2.0f * pi * p / SCENE_PLANET_COUNT;
+		Entity planet = scene_.Create(sceneRoot_, { { 2.0f * std::cos(angle), 2.0f * std::sin(angle), 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0.4f }, meshBounds, { 0, p + 1 });
+		scenePlanets_.push_back(planet);
+
+		for (uint32_t m = 0; m < SCENE_MOONS_PER_PLANET; ++m) {
+			angle = 2.0f * pi * m / SCENE_MOONS_PER_PLANET;
+			scene_.Create(planet, { { 2.0f * std::cos(angle), 2.0f * std::sin(angle), 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0.4f }, meshBounds, { 0, p + 1 });
+		}
+	}
+
+	// Every layer is shifted by half a sphere against the one in front, and the spheres
+	// overlap, so the front layer covers the view completely.
+	const float wallSpacing = 0.125f;
+	for (uint32_t layer = 0; layer < SCENE_WALL_LAYERS; ++layer) {
+		float shift = (layer % 2) * 0.5f * wallSpacing;
+		for (uint32_t y = 0; y < SCENE_WALL_SIZE; ++y) {
+			for (uint32_t x = 0; x < SCENE_WALL_SIZE; ++x) {
+				float position[3] = { (x - 0.5f * SCENE_WALL_SIZE) * wallSpacing + shift, (y - 0.5f * SCENE_WALL_SIZE) * wallSpacing + shift, -1.0f - 0.25f * layer };
+				scene_.Create(INVALID_ENTITY, { { position[0], position[1], position[2] }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0.18f }, meshBounds, { 0, SCENE_PLANET_COUNT + 1 + layer });
+			}
+		}
+	}
+
+	// Looks down -z at the 2 x 2 square around the origin.
+	camera_ = CreateOrthographicCamera(1.0f, 1.0f, 4.0f, -4.0f);
+}
+
+// Fills the view with a square grid of instances, one material per row.
+void HelloTriangleApplication::CreateGridScene(uint32_t instanceCount) {
+	const BoundingSphere meshBounds = { { 0.0f, 0.0f, 0.0f }, 0.5f };
+	uint32_t size = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instanceCount))));
+	float spacing = 2.0f / size;
+
+	sceneGrid_.reserve(instanceCount);
+	for (uint32_t i = 0; i < instanceCount; ++i) {
+		uint32_t x = i % size;
+		uint32_t y = i / size;
+		float position[3] = { -1.0f + (x + 0.5f) * spacing, -1.0f + (y + 0.5f) * spacing, 0.0f };
+		sceneGrid_.push_back(scene_.Create(INVALID_ENTITY, { { position[0], position[1], position[2] }, { 0.0f, 0.0f, 0.0f, 1.0f }, spacing }, meshBounds, { 0, y }));
+	}
+
+	camera_ = CreateOrthographicCamera(1.0f, 1.0f, 4.0f, -4.0f);
+}
+
+void HelloTriangleApplication::CreateInstanceBuffer() {
+	instances_.Init(gpu_, scene_.Size(), MAX_FRAMES_IN_FLIGHT);
+}
+
+// There are no mesh assets yet, so the sphere is generated and optimized at load
+// time. The upload is recorded into the first frame's scene pass.
+void HelloTriangleApplication::CreateMeshes() {
+	int subdivisions = suiteScene_ ? suiteScene_->meshSubdivisions : SCENE_MESH_SUBDIVISIONS;
+	MeshData mesh = subdivisions < 0 ? CreateTriangle(0.5f) : CreateIcosphere(0.5f, static_cast<uint32_t>(subdivisions));
+	OptimizeMesh(mesh);
+	sceneMesh_ = CreateGpuMesh(gpu_, mesh, vertexFormat_);
+	meshUploadPending_ = true;
+}
+
+void HelloTriangleApplication::CreateOcclusionCulling() {
+	const ShaderModuleInfo& pyramidShader = shaders_.PipelineStage("depthpyramid", VK_SHADER_STAGE_COMPUTE_BIT);
+	const ShaderModuleInfo& cullShader = shaders_.PipelineStage("cull", VK_SHADER_STAGE_COMPUTE_BIT);
+	occlusion_.Init(gpu_, pyramidShader.code, cullShader.code, instances_.Buffer(), instances_.Capacity(), MAX_FRAMES_IN_FLIGHT);
+}
+
+void HelloTriangleApplication::CreateLighting() {
+	lighting_.Init(gpu_, shaders_.PipelineStage("lightbin", VK_SHADER_STAGE_COMPUTE_BIT).code, MAX_FRAMES_IN_FLIGHT);
+	lighting_.SetLights(lightCount_, SCENE_LIGHT_BOUNDS[0], SCENE_LIGHT_BOUNDS[1]);
 }
 
 void HelloTriangleApplication::CreateGraphicsPipeline() {
-	std::vector<char> vertShaderCode, fragShaderCode;
-	this->ReadFile("CompiledShaders/vert.spv", vertShaderCode);
-	this->ReadFile("CompiledShaders/frag.spv", fragShaderCode);
-	printf("vertShaderCode size: %d\n", static_cast<int>(vertShaderCode.size()));
-	printf("fragShaderCode size: %d\n", static_cast<int>(fragShaderCode.size()));
+	const ShaderModuleInfo& vertShader = shaders_.PipelineStage("scene", VK_SHADER_STAGE_VERTEX_BIT);
+	const ShaderModuleInfo& fragShader = shaders_.PipelineStage("scene", VK_SHADER_STAGE_FRAGMENT_BIT);
+	if (vertShader.pushConstantSize > sizeof(SceneDrawParams)) throw std::runtime_error("Scene draw parameters don't match the vertex shader!");
+
+	VkShaderModule vertShaderModule = CreateShaderModule(gpu_, vertShader.code);
+	VkShaderModule fragShaderModule = CreateShaderModule(gpu_, fragShader.code);
 
-	VkShaderModule vertShaderModule = this->CreateShaderModule(vertShaderCode);
-	VkShaderModule fragShaderModule = this->CreateShaderModule(fragShaderCode);
+	// Quantized normals arrive octahedral encoded.
+	VkBool32 octahedralNormals = sceneMesh_.format == VertexFormat::Quantized ? VK_TRUE : VK_FALSE;
+	VkSpecializationMapEntry specializationEntry = { 0, 0, sizeof(VkBool32) };
+
+	VkSpecializationInfo vertSpecializationInfo = { };
+	vertSpecializationInfo.mapEntryCount = 1;
+	vertSpecializationInfo.pMapEntries = &specializationEntry;
+	vertSpecializationInfo.dataSize = sizeof(octahedralNormals);
+	vertSpecializationInfo.pData = &octahedralNormals;
 
 	VkPipelineShaderStageCreateInfo vertShaderStageInfo = { };
 	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -612,7 +1812,7 @@ void HelloTriangleApplication::CreateGraphicsPipeline() {
 	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
 	vertShaderStageInfo.module = vertShaderModule;
 	vertShaderStageInfo.pName = "main";
-	vertShaderStageInfo.pSpecializationInfo = nullptr;
+	vertShaderStageInfo.pSpecializationInfo = &vertSpecializationInfo;
 
 	VkPipelineShaderStageCreateInfo fragShaderStageInfo = { };
 	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -629,10 +1829,11 @@ void HelloTriangleApplication::CreateGraphicsPipeline() {
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	vertexInputInfo.pNext = nullptr;
 	vertexInputInfo.flags = 0;
-	vertexInputInfo.vertexBindingDescriptionCount = 0;
-	vertexInputInfo.pVertexBindingDescriptions = nullptr;
-	vertexInputInfo.vertexAttributeDescriptionCount = 0;
-	vertexInputInfo.pVertexAttributeDescriptions = nullptr;
+	VertexInputDescription vertexInput = GetVertexInputDescription(sceneMesh_.format);
+	vertexInputInfo.vertexBindingDescriptionCount = 1;
+	vertexInputInfo.pVertexBindingDescriptions = &vertexInput.binding;
+	vertexInputInfo.vertexAttributeDescriptionCount = 3;
+	vertexInputInfo.pVertexAttributeDescriptions = vertexInput.attributes;
 
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = { };
 	inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -678,6 +1879,20 @@ void HelloTriangleApplication::CreateGraphicsPipeline() {
 	rasterizerInfo.depthBiasClamp = 0.0f;
 	rasterizerInfo.depthBiasSlopeFactor = 0.0f;
 
+	VkPipelineDepthStencilStateCreateInfo depthStencilInfo = { };
+	depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencilInfo.pNext = nullptr;
+	depthStencilInfo.flags = 0;
+	depthStencilInfo.depthTestEnable = VK_TRUE;
+	depthStencilInfo.depthWriteEnable = VK_TRUE;
+	depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
+	depthStencilInfo.stencilTestEnable = VK_FALSE;
+	depthStencilInfo.front = { };
+	depthStencilInfo.back = { };
+	depthStencilInfo.minDepthBounds = 0.0f;
+	depthStencilInfo.maxDepthBounds = 1.0f;
+
 	VkPipelineMultisampleStateCreateInfo multisamplingInfo = { };
 	multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 	multisamplingInfo.pNext = nullptr;
@@ -712,13 +1927,16 @@ void HelloTriangleApplication::CreateGraphicsPipeline() {
 	colorBlendingInfo.blendConstants[2] = 0.0f;
 	colorBlendingInfo.blendConstants[3] = 0.0f;
 
+	// The scene is rendered at a dynamic resolution.
 	VkDynamicState dynamicStates[] = {
 		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_LINE_WIDTH
+		VK_DYNAMIC_STATE_SCISSOR
 	};
 
 	VkPipelineDynamicStateCreateInfo dynamicStateInfo = { };
 	dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateInfo.pNext = nullptr;
+	dynamicStateInfo.flags = 0;
 	dynamicStateInfo.dynamicStateCount = 2;
 	dynamicStateInfo.pDynamicStates = dynamicStates;
 
@@ -726,13 +1944,18 @@ void HelloTriangleApplication::CreateGraphicsPipeline() {
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.pNext = nullptr;
 	pipelineLayoutInfo.flags = 0;
-	pipelineLayoutInfo.setLayoutCount = 0;
-	pipelineLayoutInfo.pSetLayouts = nullptr;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-	VkResult result = vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &pipelineLayout_);
-	printf("vkCreatePipelineLayout result: %d\n", result);
+	VkDescriptorSetLayout setLayouts[] = { instances_.SetLayout(), occlusion_.DrawSetLayout(), lighting_.SetLayout() };
+	pipelineLayoutInfo.setLayoutCount = 3;
+	pipelineLayoutInfo.pSetLayouts = setLayouts;
+	VkPushConstantRange pushConstantRange = { };
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(SceneDrawParams);
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	VkResult result = dispatch_.CreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &pipelineLayout_);
+	LogResult("vkCreatePipelineLayout", result);
 	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create pipeline layout!");
 
 	VkGraphicsPipelineCreateInfo pipelineInfo = { };
@@ -747,102 +1970,115 @@ void HelloTriangleApplication::CreateGraphicsPipeline() {
 	pipelineInfo.pViewportState = &viewportStateInfo;
 	pipelineInfo.pRasterizationState = &rasterizerInfo;
 	pipelineInfo.pMultisampleState = &multisamplingInfo;
-	pipelineInfo.pDepthStencilState = nullptr;
+	pipelineInfo.pDepthStencilState = &depthStencilInfo;
 	pipelineInfo.pColorBlendState = &colorBlendingInfo;
-	pipelineInfo.pDynamicState = nullptr;
+	pipelineInfo.pDynamicState = &dynamicStateInfo;
 	pipelineInfo.layout = pipelineLayout_;
 	pipelineInfo.renderPass = renderPass_;
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 	pipelineInfo.basePipelineIndex = -1;
 
-	result = vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline_);
-	printf("vkCreateGraphicsPipelines result: %d\n", result);
+	result = dispatch_.CreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline_);
+	LogResult("vkCreateGraphicsPipelines", result);
 	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create graphics pipeline!");
 
-	vkDestroyShaderModule(device_, fragShaderModule, nullptr);
-	vkDestroyShaderModule(device_, vertShaderModule, nullptr);
+	dispatch_.DestroyShaderModule(device_, fragShaderModule, nullptr);
+	dispatch_.DestroyShaderModule(device_, vertShaderModule, nullptr);
 }
 
-void HelloTriangleApplication::CreateFramebuffers() {
-	swapChainFramebuffers_.resize(swapChainImageViews_.size());
+void HelloTriangleApplication::CreateSceneTargets() {
+	// Every frame slot renders into its own HDR target, which its post-processing may still read while the next frame renders.
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+		sceneColor_[i] = CreateImage2D(gpu_, SCENE_COLOR_FORMAT, swapChainExtent_, 1, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+		sceneDepth_[i] = CreateImage2D(gpu_, SCENE_DEPTH_FORMAT, swapChainExtent_, 1, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
 
-	for (size_t i = 0; i < swapChainImageViews_.size(); ++i) {
-		VkImageView attachments[] = { swapChainImageViews_[i] };
+		VkImageView attachments[] = { sceneColor_[i].view, sceneDepth_[i].view };
 
 		VkFramebufferCreateInfo framebufferInfo = { };
 		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 		framebufferInfo.pNext = nullptr;
 		framebufferInfo.flags = 0;
 		framebufferInfo.renderPass = renderPass_;
-		framebufferInfo.attachmentCount = 1;
+		framebufferInfo.attachmentCount = 2;
 		framebufferInfo.pAttachments = attachments;
 		framebufferInfo.width = swapChainExtent_.width;
 		framebufferInfo.height = swapChainExtent_.height;
 		framebufferInfo.layers = 1;
 
-		VkResult result = vkCreateFramebuffer(device_, &framebufferInfo, nullptr, &swapChainFramebuffers_[i]);
-		printf("vkCreateFramebuffer %d result: %d\n", static_cast<int>(i), result);
+		VkFramebuffer framebuffer;
+		VkResult result = dispatch_.CreateFramebuffer(device_, &framebufferInfo, nullptr, &framebuffer);
+		LogResult("vkCreateFramebuffer", result, i);
 		if (result != VK_SUCCESS) throw std::runtime_error("Failed to create framebuffer!");
+		sceneFramebuffers_[i] = UniqueFramebuffer(deletionQueue_, framebuffer);
 	}
+
+	occlusion_.CreateTargets(swapChainExtent_, sceneDepth_);
+}
+
+void HelloTriangleApplication::CreatePostProcess() {
+	const ShaderModuleInfo& downsampleShader = shaders_.PipelineStage("downsample", VK_SHADER_STAGE_COMPUTE_BIT);
+	const ShaderModuleInfo& blurShader = shaders_.PipelineStage("blur", VK_SHADER_STAGE_COMPUTE_BIT);
+	const ShaderModuleInfo& tonemapShader = shaders_.PipelineStage("tonemap", VK_SHADER_STAGE_COMPUTE_BIT);
+	postProcess_.Init(gpu_, downsampleShader.code, blurShader.code, tonemapShader.code, MAX_FRAMES_IN_FLIGHT);
+	postProcess_.CreateTargets(swapChainExtent_, sceneColor_);
+
+	const QueueFamilyIndices& indices = queueFamilyIndices_;
+	profiler_.Init(gpu_, physicalDeviceProperties_.limits.timestampPeriod, indices.graphicsTimestampBits, indices.computeTimestampBits, MAX_FRAMES_IN_FLIGHT);
 }
 
-void HelloTriangleApplication::CreateCommandPool() {
-	QueueFamilyIndices queueFamilyIndices = this->FindQueueFamilies(physicalDevice_);
+void HelloTriangleApplication::CreateOverlay() {
+	const ShaderModuleInfo& vertShader = shaders_.PipelineStage("overlay", VK_SHADER_STAGE_VERTEX_BIT);
+	const ShaderModuleInfo& fragShader = shaders_.PipelineStage("overlay", VK_SHADER_STAGE_FRAGMENT_BIT);
+	// Without a swap chain the overlay leaves the image as it is for the next frame's composite.
+	VkImageLayout finalLayout = headless_ ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	overlay_.Init(gpu_, vertShader.code, fragShader.code, swapChainImageFormat_, finalLayout, gpuBudgetMs_, MAX_FRAMES_IN_FLIGHT);
+	overlay_.CreateTargets(swapChainImageViews_, swapChainExtent_);
+}
 
+void HelloTriangleApplication::CreateCommandPools() {
 	VkCommandPoolCreateInfo poolInfo = { };
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.pNext = nullptr;
-	poolInfo.flags = 0;
-	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-
-	VkResult result = vkCreateCommandPool(device_, &poolInfo, nullptr, &commandPool_);
-	printf("vkCreateCommandPool result: %d\n", result);
-	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create command pool!");
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	// Command buffers are re-recorded every frame, so each slot gets pools it can reset as a whole.
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+		poolInfo.queueFamilyIndex = queueFamilyIndices_.graphicsFamily;
+		VkResult result = dispatch_.CreateCommandPool(device_, &poolInfo, nullptr, &frames_[i].graphicsCommandPool);
+		LogResult("vkCreateCommandPool", result, i);
+		if (result != VK_SUCCESS) throw std::runtime_error("Failed to create command pool!");
+
+		poolInfo.queueFamilyIndex = queueFamilyIndices_.computeFamily;
+		result = dispatch_.CreateCommandPool(device_, &poolInfo, nullptr, &frames_[i].computeCommandPool);
+		LogResult("vkCreateCommandPool", result, i);
+		if (result != VK_SUCCESS) throw std::runtime_error("Failed to create compute command pool!");
+	}
 }
 
 void HelloTriangleApplication::CreateCommandBuffers() {
-	commandBuffers_.resize(swapChainFramebuffers_.size());
-
 	VkCommandBufferAllocateInfo allocateInfo = { };
 	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocateInfo.pNext = nullptr;
-	allocateInfo.commandPool = commandPool_;
 	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocateInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers_.size());
-
-	VkResult result = vkAllocateCommandBuffers(device_, &allocateInfo, commandBuffers_.data());
-	printf("vkAllocateCommandBuffers result: %d\n", result);
-	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create command buffers!");
 
-	for (size_t i = 0; i < commandBuffers_.size(); ++i) {
-		VkCommandBufferBeginInfo beginInfo = { };
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.pNext = nullptr;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		beginInfo.pInheritanceInfo = nullptr;
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+		VkCommandBuffer graphicsCommandBuffers[2];
+		allocateInfo.commandPool = frames_[i].graphicsCommandPool;
+		allocateInfo.commandBufferCount = 2;
 
-		vkBeginCommandBuffer(commandBuffers_[i], &beginInfo);
+		VkResult result = dispatch_.AllocateCommandBuffers(device_, &allocateInfo, graphicsCommandBuffers);
+		LogResult("vkAllocateCommandBuffers", result, i);
+		if (result != VK_SUCCESS) throw std::runtime_error("Failed to create command buffers!");
+		frames_[i].sceneCommandBuffer = graphicsCommandBuffers[0];
+		frames_[i].compositeCommandBuffer = graphicsCommandBuffers[1];
 
-		VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-		VkRenderPassBeginInfo renderPassInfo = { };
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.pNext = nullptr;
-		renderPassInfo.renderPass = renderPass_;
-		renderPassInfo.framebuffer = swapChainFramebuffers_[i];
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = swapChainExtent_;
-		renderPassInfo.clearValueCount = 1;
-		renderPassInfo.pClearValues = &clearColor;
+		allocateInfo.commandPool = frames_[i].computeCommandPool;
+		allocateInfo.commandBufferCount = 1;
 
-		vkCmdBeginRenderPass(commandBuffers_[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(commandBuffers_[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline_);
-		vkCmdDraw(commandBuffers_[i], 3, 1, 0, 0);
-		vkCmdEndRenderPass(commandBuffers_[i]);
-
-		result = vkEndCommandBuffer(commandBuffers_[i]);
-		printf("vkEndCommandBuffer %d result: %d\n", static_cast<int>(i), result);
-		if (result != VK_SUCCESS) throw std::runtime_error("Failed to record command buffer!");
+		result = dispatch_.AllocateCommandBuffers(device_, &allocateInfo, &frames_[i].postCommandBuffer);
+		LogResult("vkAllocateCommandBuffers", result, i);
+		if (result != VK_SUCCESS) throw std::runtime_error("Failed to create compute command buffers!");
 	}
 }
 
@@ -852,10 +2088,12 @@ void HelloTriangleApplication::CreateSemaphores() {
 	semaphoreInfo.pNext = nullptr;
 	semaphoreInfo.flags = 0;
 
-	VkResult result = vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &imageAvailableSemaphore_);
-	printf("vkCreateSemaphore result: %d\n", result);
-	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create imageAvailableSemaphore!");
-	result = vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &renderFinishedSemaphore_);
-	printf("vkCreateSemaphore result: %d\n", result);
-	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create renderFinishedSemaphore!");
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+		VkResult result = dispatch_.CreateSemaphore(device_, &semaphoreInfo, nullptr, &frames_[i].imageAvailableSemaphore);
+		LogResult("vkCreateSemaphore", result, i);
+		if (result != VK_SUCCESS) throw std::runtime_error("Failed to create imageAvailableSemaphore!");
+		result = dispatch_.CreateSemaphore(device_, &semaphoreInfo, nullptr, &frames_[i].renderFinishedSemaphore);
+		LogResult("vkCreateSemaphore", result, i);
+		if (result != VK_SUCCESS) throw std::runtime_error("Failed to create renderFinishedSemaphore!");
+	}
 }
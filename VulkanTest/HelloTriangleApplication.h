@@ -3,16 +3,56 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW\glfw3.h>
 
+#include <chrono>
 #include <cstdio>
 #include <stdexcept>
 #include <functional>
 #include <vector>
-#include <fstream>
+#include <string>
+
+#include "AppOptions.h"
+#include "BenchmarkSuite.h"
+#include "Camera.h"
+#include "ClusteredLighting.h"
+#include "DebugMessageSink.h"
+#include "DeletionQueue.h"
+#include "DynamicResolution.h"
+#include "FrameTrace.h"
+#include "GpuProfiler.h"
+#include "GpuResources.h"
+#include "GpuScheduler.h"
+#include "InstanceBuffer.h"
+#include "JobSystem.h"
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "OcclusionCuller.h"
+#include "PerformanceOverlay.h"
+#include "PostProcessChain.h"
+#include "SceneStore.h"
+#include "ShaderBundle.h"
+#include "StartupTimeline.h"
+#include "VulkanDispatch.h"
 
 
 const int WIDTH = 800;
 const int HEIGHT = 600;
 
+const int MAX_FRAMES_IN_FLIGHT = 2;
+
+const VkFormat SCENE_COLOR_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+const VkFormat SCENE_DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+// What the benchmark suite composites into in place of a swap chain image.
+const VkFormat HEADLESS_OUTPUT_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+const double STARTUP_TARGET_MS = 100.0;
+
+const uint32_t SCENE_PLANET_COUNT = 6;
+const uint32_t SCENE_MOONS_PER_PLANET = 5;
+const uint32_t SCENE_MESH_SUBDIVISIONS = 3;
+// A wall of spheres behind the solar system, wider than the view, whose front layer hides the rest.
+const uint32_t SCENE_WALL_SIZE = 24;
+const uint32_t SCENE_WALL_LAYERS = 8;
+
 const std::vector<const char*> deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
@@ -27,15 +67,24 @@ const std::vector<const char*> validationLayers = {
 	const bool enableValidationLayers = true;
 #endif
 
+#ifdef VERBOSE_STARTUP
+	const bool enableVerboseStartup = true;
+#else
+	const bool enableVerboseStartup = false;
+#endif
+
 
 class HelloTriangleApplication {
 public:
-	void Run();
+	void Run(const AppOptions& options);
 
 private:
 	struct QueueFamilyIndices {
 		int graphicsFamily = -1;
 		int presentFamily = -1;
+		int computeFamily = -1;
+		uint32_t graphicsTimestampBits = 0;
+		uint32_t computeTimestampBits = 0;
 		bool IsComplete() { return graphicsFamily >= 0 && presentFamily >= 0; }
 	};
 
@@ -45,6 +94,21 @@ private:
 		std::vector<VkPresentModeKHR> presentModes;
 	};
 
+	struct FrameResources {
+		VkCommandPool graphicsCommandPool = VK_NULL_HANDLE;
+		VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+		VkCommandBuffer sceneCommandBuffer = VK_NULL_HANDLE;
+		VkCommandBuffer postCommandBuffer = VK_NULL_HANDLE;
+		VkCommandBuffer compositeCommandBuffer = VK_NULL_HANDLE;
+		VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
+		VkSemaphore renderFinishedSemaphore = VK_NULL_HANDLE;
+		VkExtent2D renderExtent = { 0, 0 };
+		// The timed frame the slot rendered last in a headless run, or -1.
+		int timedFrame = -1;
+		// Last submission that uses the slot's resources.
+		GpuTicket ticket = 0;
+	};
+
 private:
 	static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(
 		VkDebugReportFlagsEXT flags,
@@ -56,33 +120,11 @@ private:
 		const char* msg,
 		void* userData) {
 		
-		printf("Validation layer: %s\n", msg);
+		// Runs on whichever thread made the call, so it only hands the message to the sink.
+		reinterpret_cast<DebugMessageSink*>(userData)->PushReport(flags, objType, obj, code, layerPrefix, msg);
 		return VK_FALSE;
 	}
 
-	static VkResult CreateDebugReportCallbackEXT(VkInstance instance, const VkDebugReportCallbackCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugReportCallbackEXT* pCallback) {
-		auto func = (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugReportCallbackEXT");
-		if (func) return func(instance, pCreateInfo, pAllocator, pCallback);
-		else return VK_ERROR_EXTENSION_NOT_PRESENT;
-	}
-
-	static void DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT callback, const VkAllocationCallbacks* pAllocator) {
-		auto func = (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT");
-		if (func) func(instance, callback, pAllocator);
-	}
-
-	static void ReadFile(const std::string& filename, std::vector<char>& buffer) {
-		std::ifstream file(filename, std::ios::ate | std::ios::binary);
-		if (!file.is_open()) throw std::runtime_error("Failed to open file!");
-
-		size_t fileSize = static_cast<size_t>(file.tellg());
-		buffer.resize(fileSize);
-
-		file.seekg(0);
-		file.read(buffer.data(), fileSize);
-		file.close();
-	}
-
 	static void OnWindowResized(GLFWwindow* window, int width, int height) {
 		if (width == 0 || height == 0) return;
 
@@ -90,7 +132,15 @@ private:
 		app->RecreateSwapChain();
 	}
 
+	static void OnKey(GLFWwindow* window, int key, int scancode, int action, int mods) {
+		if (key != GLFW_KEY_F1 || action != GLFW_PRESS) return;
+
+		HelloTriangleApplication* app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+		app->overlayVisible_ = !app->overlayVisible_;
+	}
+
 private:
+	void Init();
 	void InitWindow();
 	void InitVulkan();
 	void MainLoop();
@@ -98,18 +148,44 @@ private:
 	void Cleanup();
 
 	void DrawFrame();
+	void PresentFrame(int frame);
+	void CompositeHeadless(int frame);
+	void UpdateScene();
+	void UpdateOverlay(bool timed);
 	void RecreateSwapChain();
+	void StartCapture(const AppOptions& options);
+	void CaptureFrame(int frame);
+	void LoadReplay(const std::string& filename);
+	void Replay(const std::string& filename, bool realtime);
+	void LoadSuiteScene(const std::string& name);
+	void RunSuiteScene(const std::string& outputFile);
+	double RunTimedFrames(int frameCount, const std::function<void(int)>& prepareFrame);
+	void StoreFrameTiming(int timedFrame);
+	void StartHeadless(VkExtent2D extent);
+
+	void BeginRecording(VkCommandBuffer commandBuffer);
+	void EndRecording(VkCommandBuffer commandBuffer);
+	void RecordScene(int frame);
+	void RecordPostProcess(int frame);
+	void RecordComposite(int frame, uint32_t imageIndex);
+
+	void BenchmarkDispatch();
+	void BenchmarkDebugSink();
+	void BenchmarkJobs();
+	void BenchmarkScene();
+	void BenchmarkLights();
+	void ReportMeshOptimization();
 
 	bool CheckValidationLayerSupport();
-	bool IsDeviceSuitable(VkPhysicalDevice device);
+	bool IsDeviceSuitable(VkPhysicalDevice device, QueueFamilyIndices& indices, SwapChainSupportDetails& swapChainSupport);
 	QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
 	bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
 	SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device);
 	VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 	VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR> availablePresentModes);
 	VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
-	VkShaderModule CreateShaderModule(const std::vector<char>& code);
 
+	void LoadShaders();
 	void SetupDebugCallback();
 	void CreateSurface();
 	void GetRequiredExtensions(std::vector<const char*>& extensions);
@@ -119,34 +195,109 @@ private:
 	void CreateSwapChain();
 	void CreateImageViews();
 	void CreateRenderPass();
+	void CreateScene();
+	void CreateGridScene(uint32_t instanceCount);
+	void CreateInstanceBuffer();
+	void CreateMeshes();
+	void CreateOcclusionCulling();
+	void CreateLighting();
 	void CreateGraphicsPipeline();
-	void CreateFramebuffers();
-	void CreateCommandPool();
+	void CreateSceneTargets();
+	void CreatePostProcess();
+	void CreateOverlay();
+	void CreateCommandPools();
 	void CreateCommandBuffers();
 	void CreateSemaphores();
 
 private:
-	GLFWwindow* window_;
+	StartupTimeline startupTimeline_;
+	JobSystem jobs_;
+
+	// Replays and the benchmark suite run without a window or swap chain and render at headlessExtent_.
+	bool headless_ = false;
+	VkExtent2D headlessExtent_ = { 0, 0 };
+	// Stands in for the swap chain image while the suite draws the overlay, so its pass is timed.
+	GpuImage headlessOutput_;
+	GLFWwindow* window_ = nullptr;
 
 	VkInstance instance_;
-	VkDebugReportCallbackEXT callback_;
-	VkSurfaceKHR surface_;
+	InstanceDispatch instanceDispatch_;
+	VkDebugReportCallbackEXT callback_ = VK_NULL_HANDLE;
+	VkSurfaceKHR surface_ = VK_NULL_HANDLE;
 	VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties physicalDeviceProperties_;
+	QueueFamilyIndices queueFamilyIndices_;
+	SwapChainSupportDetails swapChainSupport_;
 	VkDevice device_;
+	DeviceDispatch dispatch_;
 	VkQueue graphicsQueue_;
 	VkQueue presentQueue_;
-	VkSwapchainKHR swapchain_;
+	VkQueue computeQueue_;
+	GpuContext gpu_;
+	// Declared before everything that releases handles to the deletion queue, so it
+	// outlives them even when an exception skips Cleanup.
+	GpuScheduler scheduler_;
+	DeletionQueue deletionQueue_;
+	VkSwapchainKHR swapchain_ = VK_NULL_HANDLE;
 	std::vector<VkImage> swapChainImages_;
 	VkFormat swapChainImageFormat_;
 	VkExtent2D swapChainExtent_;
-	std::vector<VkImageView> swapChainImageViews_;
+	std::vector<UniqueImageView> swapChainImageViews_;
+	// The early pass clears the scene targets, the late pass adds the draws the late culling found.
 	VkRenderPass renderPass_;
+	VkRenderPass lateRenderPass_;
+	ShaderBundle shaders_;
 	VkPipelineLayout pipelineLayout_;
 	VkPipeline graphicsPipeline_;
-	std::vector<VkFramebuffer> swapChainFramebuffers_;
-	VkCommandPool commandPool_;
-	std::vector<VkCommandBuffer> commandBuffers_;
+	GpuImage sceneColor_[MAX_FRAMES_IN_FLIGHT];
+	GpuImage sceneDepth_[MAX_FRAMES_IN_FLIGHT];
+	UniqueFramebuffer sceneFramebuffers_[MAX_FRAMES_IN_FLIGHT];
+	SceneStore scene_;
+	Entity sceneRoot_ = INVALID_ENTITY;
+	std::vector<Entity> scenePlanets_;
+	// Every entity of a grid scene, in grid order.
+	std::vector<Entity> sceneGrid_;
+	// Headless runs animate the scene by this rather than by the clock.
+	uint64_t sceneFrameCount_ = 0;
+	std::vector<SceneRange> sceneChanges_;
+	Camera camera_;
+	InstanceBuffer instances_;
+	VertexFormat vertexFormat_ = VertexFormat::Quantized;
+	GpuMesh sceneMesh_;
+	// The mesh's staging buffers are copied by the next scene submission.
+	bool meshUploadPending_ = false;
+	OcclusionCuller occlusion_;
+	ClusteredLighting lighting_;
+	uint32_t lightCount_ = 0;
+	// The time the scene was last animated to, in seconds.
+	float sceneTime_ = 0.0f;
+	PostProcessChain postProcess_;
+	// The overlay only exists with a window; F1 toggles whether it is drawn.
+	PerformanceOverlay overlay_;
+	bool showOverlay_ = false;
+	bool overlayVisible_ = true;
+	double gpuBudgetMs_ = 0.0;
+	std::chrono::high_resolution_clock::time_point lastFrameStart_;
+	double drawFrameMs_ = 0.0;
+	GpuProfiler profiler_;
+	DynamicResolution dynamicResolution_;
 	
-	VkSemaphore imageAvailableSemaphore_;
-	VkSemaphore renderFinishedSemaphore_;
+	FrameResources frames_[MAX_FRAMES_IN_FLIGHT];
+	int currentFrame_ = 0;
+	// The previous frame has been post-processed but not yet composited and presented.
+	bool hasPendingComposite_ = false;
+	uint64_t presentedFrameCount_ = 0;
+
+	TraceWriter capture_;
+	std::chrono::high_resolution_clock::time_point captureStart_;
+	TraceFrame captureFrame_;
+	TraceSettings replaySettings_;
+	std::vector<TraceFrame> replayFrames_;
+	// Set while DrawFrame renders a trace frame instead of the live scene.
+	const TraceFrame* replayFrame_ = nullptr;
+	// Set while the benchmark suite renders one of its scenes.
+	const SuiteScene* suiteScene_ = nullptr;
+	// The frame RunTimedFrames is drawing, or -1, and what each of its frames cost.
+	int timedFrame_ = -1;
+	std::vector<FrameTiming> frameTimings_;
 };
\ No newline at end of file
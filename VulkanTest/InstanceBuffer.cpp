@@ -0,0 +1,172 @@
+#include "InstanceBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+void InstanceBuffer::Init(const GpuContext& context, uint32_t capacity, int slotCount) {
+	context_ = context;
+	capacity_ = capacity;
+	const DeviceDispatch& vk = *context_.dispatch;
+	VkDeviceSize size = std::max<VkDeviceSize>(1, capacity) * sizeof(InstanceData);
+
+	instances_ = CreateBuffer(context_, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	slots_.resize(slotCount);
+	for (Slot& slot : slots_) slot.staging = CreateBuffer(context_, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	VkDescriptorSetLayoutBinding binding = { };
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	binding.descriptorCount = 1;
+	binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	binding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = { };
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = nullptr;
+	layoutInfo.flags = 0;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &binding;
+
+	VkResult result = vk.CreateDescriptorSetLayout(context_.device, &layoutInfo, nullptr, &setLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create instance descriptor set layout!");
+
+	VkDescriptorPoolSize poolSize = { };
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo poolInfo = { };
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.pNext = nullptr;
+	poolInfo.flags = 0;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	result = vk.CreateDescriptorPool(context_.device, &poolInfo, nullptr, &descriptorPool_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create instance descriptor pool!");
+
+	VkDescriptorSetAllocateInfo allocateInfo = { };
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.pNext = nullptr;
+	allocateInfo.descriptorPool = descriptorPool_;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &setLayout_;
+
+	result = vk.AllocateDescriptorSets(context_.device, &allocateInfo, &set_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to allocate instance descriptor set!");
+
+	VkDescriptorBufferInfo bufferInfo = { };
+	bufferInfo.buffer = instances_.buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet write = { };
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = nullptr;
+	write.dstSet = set_;
+	write.dstBinding = 0;
+	write.dstArrayElement = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pImageInfo = nullptr;
+	write.pBufferInfo = &bufferInfo;
+	write.pTexelBufferView = nullptr;
+	vk.UpdateDescriptorSets(context_.device, 1, &write, 0, nullptr);
+}
+
+void InstanceBuffer::Destroy() {
+	const DeviceDispatch& vk = *context_.dispatch;
+
+	vk.DestroyDescriptorPool(context_.device, descriptorPool_, nullptr);
+	vk.DestroyDescriptorSetLayout(context_.device, setLayout_, nullptr);
+	for (Slot& slot : slots_) DestroyBuffer(context_, slot.staging);
+	DestroyBuffer(context_, instances_);
+}
+
+void InstanceBuffer::Stage(int slotIndex, const SceneStore& scene, const std::vector<SceneRange>& ranges) {
+	Slot& slot = slots_[slotIndex];
+	InstanceData* staged = static_cast<InstanceData*>(slot.staging.mapped);
+	const Affine* world = scene.WorldTransforms();
+	const BoundingSphere* bounds = scene.WorldBounds();
+	const RenderHandle* render = scene.RenderHandles();
+
+	count_ = std::min(scene.Size(), capacity_);
+	slot.copies.clear();
+
+	// Every range lands at its own offset, so each is a single copy region.
+	for (const SceneRange& range : ranges) {
+		if (range.first >= count_) break;
+		uint32_t last = std::min(range.first + range.count, count_);
+
+		for (uint32_t i = range.first; i < last; ++i) {
+			InstanceData& instance = staged[i];
+			memcpy(instance.world, world[i].rows, sizeof(instance.world));
+			instance.bounds = bounds[i];
+			instance.mesh = render[i].mesh;
+			instance.material = render[i].material;
+		}
+
+		VkDeviceSize offset = static_cast<VkDeviceSize>(range.first) * sizeof(InstanceData);
+		slot.copies.push_back({ offset, offset, static_cast<VkDeviceSize>(last - range.first) * sizeof(InstanceData) });
+	}
+}
+
+void InstanceBuffer::Stage(int slotIndex, uint32_t count, const std::vector<SceneRange>& ranges, const InstanceData* data) {
+	Slot& slot = slots_[slotIndex];
+	InstanceData* staged = static_cast<InstanceData*>(slot.staging.mapped);
+
+	count_ = std::min(count, capacity_);
+	slot.copies.clear();
+
+	for (const SceneRange& range : ranges) {
+		if (range.first < count_) {
+			uint32_t last = std::min(range.first + range.count, count_);
+			memcpy(staged + range.first, data, (last - range.first) * sizeof(InstanceData));
+
+			VkDeviceSize offset = static_cast<VkDeviceSize>(range.first) * sizeof(InstanceData);
+			slot.copies.push_back({ offset, offset, static_cast<VkDeviceSize>(last - range.first) * sizeof(InstanceData) });
+		}
+		data += range.count;
+	}
+}
+
+void InstanceBuffer::Staged(int slotIndex, std::vector<SceneRange>& ranges, std::vector<InstanceData>& instances) const {
+	const Slot& slot = slots_[slotIndex];
+	const InstanceData* staged = static_cast<const InstanceData*>(slot.staging.mapped);
+
+	// The staging memory is write combined, so this is slow, but only the changed ranges are read.
+	ranges.clear();
+	instances.clear();
+	for (const VkBufferCopy& copy : slot.copies) {
+		SceneRange range = { static_cast<uint32_t>(copy.dstOffset / sizeof(InstanceData)), static_cast<uint32_t>(copy.size / sizeof(InstanceData)) };
+		ranges.push_back(range);
+		instances.insert(instances.end(), staged + range.first, staged + range.first + range.count);
+	}
+}
+
+void InstanceBuffer::RecordUpload(VkCommandBuffer commandBuffer, int slotIndex) {
+	const Slot& slot = slots_[slotIndex];
+	if (slot.copies.empty()) return;
+	const DeviceDispatch& vk = *context_.dispatch;
+
+	// Earlier frames' shaders have to be done reading before the copy overwrites.
+	VkBufferMemoryBarrier barrier = { };
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = instances_.buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	vk.CmdCopyBuffer(commandBuffer, slot.staging.buffer, instances_.buffer, static_cast<uint32_t>(slot.copies.size()), slot.copies.data());
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
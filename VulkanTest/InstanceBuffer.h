@@ -0,0 +1,55 @@
+#pragma once
+
+#include "GpuResources.h"
+#include "SceneStore.h"
+
+
+// Layout of one instance in the shaders' std430 instance array.
+struct InstanceData {
+	float world[3][4];
+	BoundingSphere bounds;
+	uint32_t mesh;
+	uint32_t material;
+	uint32_t padding[2];
+};
+
+// The scene's instances in a device local storage buffer. Only the ranges that
+// changed are staged into the frame slot's host visible buffer and copied over
+// at the start of the slot's scene pass.
+class InstanceBuffer {
+public:
+	void Init(const GpuContext& context, uint32_t capacity, int slotCount);
+	void Destroy();
+
+	// The slot's previous frame has to be finished.
+	void Stage(int slot, const SceneStore& scene, const std::vector<SceneRange>& ranges);
+	// Stages instances captured from an earlier run; data holds every range's instances back to back.
+	void Stage(int slot, uint32_t count, const std::vector<SceneRange>& ranges, const InstanceData* data);
+	// Reads back what the slot's last Stage wrote, for capturing it.
+	void Staged(int slot, std::vector<SceneRange>& ranges, std::vector<InstanceData>& instances) const;
+	// Records the staged copies and makes them visible to the vertex and cull shaders.
+	void RecordUpload(VkCommandBuffer commandBuffer, int slot);
+
+	uint32_t Count() const { return count_; }
+	uint32_t Capacity() const { return capacity_; }
+	VkBuffer Buffer() const { return instances_.buffer; }
+	VkDescriptorSetLayout SetLayout() const { return setLayout_; }
+	VkDescriptorSet Set() const { return set_; }
+
+private:
+	struct Slot {
+		GpuBuffer staging;
+		std::vector<VkBufferCopy> copies;
+	};
+
+private:
+	GpuContext context_;
+	uint32_t capacity_ = 0;
+	uint32_t count_ = 0;
+	GpuBuffer instances_;
+	std::vector<Slot> slots_;
+
+	VkDescriptorSetLayout setLayout_ = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+	VkDescriptorSet set_ = VK_NULL_HANDLE;
+};
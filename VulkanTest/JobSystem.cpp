@@ -0,0 +1,209 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+// The worker the current thread runs as, if any.
+static thread_local JobSystem* currentSystem = nullptr;
+static thread_local uint32_t currentWorker = 0;
+
+
+JobSystem::Deque::Deque() : jobs_(new std::atomic<Job*>[MAX_JOBS_PER_WORKER]), top_(0), bottom_(0) {
+}
+
+// Chase-Lev with the memory orders of Le, Pop, Cohen and Zappa Nardelli (2013).
+void JobSystem::Deque::Push(Job* job) {
+	int64_t bottom = bottom_.load(std::memory_order_relaxed);
+	jobs_[bottom & (MAX_JOBS_PER_WORKER - 1)].store(job, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom_.store(bottom + 1, std::memory_order_relaxed);
+}
+
+JobSystem::Job* JobSystem::Deque::Pop() {
+	int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+	bottom_.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t top = top_.load(std::memory_order_relaxed);
+
+	if (top > bottom) {
+		bottom_.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = jobs_[bottom & (MAX_JOBS_PER_WORKER - 1)].load(std::memory_order_relaxed);
+	if (top == bottom) {
+		// The last job; a thief may be taking it at the same time.
+		if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+		bottom_.store(bottom + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+JobSystem::Job* JobSystem::Deque::Steal() {
+	int64_t top = top_.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t bottom = bottom_.load(std::memory_order_acquire);
+	if (top >= bottom) return nullptr;
+
+	Job* job = jobs_[top & (MAX_JOBS_PER_WORKER - 1)].load(std::memory_order_relaxed);
+	if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+	return job;
+}
+
+
+JobSystem::~JobSystem() {
+	this->Stop();
+}
+
+void JobSystem::Start(uint32_t workerCount) {
+	if (running_) throw std::runtime_error("Job system is already running!");
+	if (workerCount == 0) workerCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for (uint32_t i = 0; i < workerCount; ++i) {
+		std::unique_ptr<Worker> worker(new Worker());
+		worker->jobs.reset(new Job[MAX_JOBS_PER_WORKER]);
+		worker->random = 2654435761u * (i + 1);
+		workers_.push_back(std::move(worker));
+	}
+
+	running_ = true;
+	currentSystem = this;
+	currentWorker = 0;
+	for (uint32_t i = 1; i < workerCount; ++i) workers_[i]->thread = std::thread(&JobSystem::WorkerMain, this, i);
+}
+
+void JobSystem::Stop() {
+	if (!running_) return;
+
+	running_ = false;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex_);
+	}
+	wakeUp_.notify_all();
+
+	for (size_t i = 1; i < workers_.size(); ++i) workers_[i]->thread.join();
+	workers_.clear();
+	queued_ = 0;
+	if (currentSystem == this) currentSystem = nullptr;
+}
+
+void JobSystem::Run(std::function<void()> function, JobCounter& counter) {
+	if (currentSystem != this) throw std::runtime_error("Jobs can only be started by a worker of the job system!");
+
+	Worker& worker = *workers_[currentWorker];
+	counter.pending_.fetch_add(1, std::memory_order_relaxed);
+
+	// A stolen job can still be running in the next slot, however short the deque is.
+	Job* job = &worker.jobs[worker.nextJob % MAX_JOBS_PER_WORKER];
+	if (worker.deque.Size() >= MAX_QUEUED_PER_WORKER || job->busy.load(std::memory_order_acquire)) {
+		Job inlineJob;
+		inlineJob.function = std::move(function);
+		inlineJob.counter = &counter;
+		this->Execute(&inlineJob);
+		return;
+	}
+
+	++worker.nextJob;
+	job->busy.store(true, std::memory_order_relaxed);
+	job->function = std::move(function);
+	job->counter = &counter;
+	queued_.fetch_add(1);
+	worker.deque.Push(job);
+
+	// Taking the lock orders this against a worker that is about to sleep, so it can't miss the job.
+	if (sleepers_.load() > 0) {
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex_);
+		}
+		wakeUp_.notify_one();
+	}
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t)>& function, JobCounter& counter) {
+	// One copy shared by all batches, so the caller's function may be a temporary.
+	std::shared_ptr<std::function<void(uint32_t, uint32_t)>> shared = std::make_shared<std::function<void(uint32_t, uint32_t)>>(function);
+
+	for (uint32_t begin = 0; begin < count; begin += batchSize) {
+		uint32_t end = std::min(count, begin + batchSize);
+		this->Run([shared, begin, end]() { (*shared)(begin, end); }, counter);
+	}
+}
+
+void JobSystem::Wait(JobCounter& counter) {
+	while (!counter.IsDone()) {
+		Job* job = currentSystem == this ? this->FindJob(currentWorker) : nullptr;
+		if (job) this->Execute(job);
+		else std::this_thread::yield();
+	}
+
+	if (counter.failed_.load(std::memory_order_acquire)) {
+		std::exception_ptr error = counter.error_;
+		counter.error_ = nullptr;
+		counter.failed_ = false;
+		std::rethrow_exception(error);
+	}
+}
+
+
+void JobSystem::WorkerMain(uint32_t index) {
+	currentSystem = this;
+	currentWorker = index;
+
+	int idleSpins = 0;
+	while (running_.load(std::memory_order_relaxed)) {
+		Job* job = this->FindJob(index);
+		if (job) {
+			this->Execute(job);
+			idleSpins = 0;
+		} else if (++idleSpins < SPINS_BEFORE_SLEEP) {
+			std::this_thread::yield();
+		} else {
+			this->Sleep();
+			idleSpins = 0;
+		}
+	}
+}
+
+JobSystem::Job* JobSystem::FindJob(uint32_t index) {
+	Job* job = workers_[index]->deque.Pop();
+
+	// Steal from the other workers, starting at a random one so thieves spread out.
+	if (!job) {
+		uint32_t& random = workers_[index]->random;
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+
+		uint32_t count = static_cast<uint32_t>(workers_.size());
+		for (uint32_t i = 0; i < count && !job; ++i) {
+			uint32_t victim = (random + i) % count;
+			if (victim != index) job = workers_[victim]->deque.Steal();
+		}
+	}
+
+	if (job) queued_.fetch_sub(1);
+	return job;
+}
+
+void JobSystem::Execute(Job* job) {
+	JobCounter* counter = job->counter;
+
+	try {
+		job->function();
+	} catch (...) {
+		if (!counter->failed_.exchange(true)) counter->error_ = std::current_exception();
+	}
+
+	// Releases the captures now rather than when the slot is reused.
+	job->function = nullptr;
+	job->busy.store(false, std::memory_order_release);
+	counter->pending_.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::Sleep() {
+	std::unique_lock<std::mutex> lock(sleepMutex_);
+	sleepers_.fetch_add(1);
+	wakeUp_.wait(lock, [this]() { return queued_.load() > 0 || !running_.load(); });
+	sleepers_.fetch_sub(1);
+}
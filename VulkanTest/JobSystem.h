@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Counts the jobs of a group that haven't finished yet. A job that depends on
+// others waits on their counter; the first exception thrown by a job of the
+// group is rethrown by the wait.
+class JobCounter {
+public:
+	JobCounter() : pending_(0), failed_(false) { }
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool IsDone() const { return pending_.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<int> pending_;
+	std::atomic<bool> failed_;
+	std::exception_ptr error_;
+};
+
+
+// Runs jobs on one worker per core. Every worker owns a work-stealing deque
+// (Chase-Lev): it pushes and pops its own jobs at the bottom, idle workers
+// steal the oldest jobs from the top. The thread that calls Start is worker 0;
+// it only runs jobs while it waits, so it is free for the window and the
+// presentation in between. Waiting never blocks while there is work: it runs
+// other jobs until the counter drops to zero, so jobs can wait on each other
+// and a frame can be written as a graph of jobs.
+class JobSystem {
+public:
+	JobSystem() = default;
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// A workerCount of 0 uses one worker per hardware thread.
+	void Start(uint32_t workerCount = 0);
+	void Stop();
+
+	uint32_t WorkerCount() const { return static_cast<uint32_t>(workers_.size()); }
+
+	// Only call these from the thread that called Start or from inside a job.
+	void Run(std::function<void()> function, JobCounter& counter);
+	// Splits [0, count) into batches of at most batchSize and runs function(begin, end) on each.
+	void ParallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t)>& function, JobCounter& counter);
+	void Wait(JobCounter& counter);
+
+private:
+	// Jobs are recycled from a ring per worker. Only half of it may be queued, and a slot
+	// is only reused once its previous job has finished; otherwise the job runs right away.
+	static const uint32_t MAX_JOBS_PER_WORKER = 4096;
+	static const int64_t MAX_QUEUED_PER_WORKER = MAX_JOBS_PER_WORKER / 2;
+	static const int SPINS_BEFORE_SLEEP = 64;
+	static const size_t CACHE_LINE_SIZE = 64;
+
+	struct Job {
+		std::function<void()> function;
+		JobCounter* counter = nullptr;
+		// Set from Run until Execute is done with the slot.
+		std::atomic<bool> busy{ false };
+	};
+
+	class Deque {
+	public:
+		Deque();
+
+		void Push(Job* job);
+		Job* Pop();
+		Job* Steal();
+		// Only exact for the owner.
+		int64_t Size() const { return bottom_.load(std::memory_order_relaxed) - top_.load(std::memory_order_relaxed); }
+
+	private:
+		std::unique_ptr<std::atomic<Job*>[]> jobs_;
+		// Kept on their own cache lines: the owner writes bottom, thieves write top. They are
+		// padded rather than aligned, since Workers are allocated with plain new, which
+		// doesn't honor extended alignment before C++17.
+		char topPadding_[CACHE_LINE_SIZE];
+		std::atomic<int64_t> top_;
+		char bottomPadding_[CACHE_LINE_SIZE];
+		std::atomic<int64_t> bottom_;
+		char endPadding_[CACHE_LINE_SIZE];
+	};
+
+	struct Worker {
+		Deque deque;
+		std::unique_ptr<Job[]> jobs;
+		uint32_t nextJob = 0;
+		uint32_t random = 0;
+		std::thread thread;
+	};
+
+private:
+	void WorkerMain(uint32_t index);
+	Job* FindJob(uint32_t index);
+	void Execute(Job* job);
+	void Sleep();
+
+private:
+	std::vector<std::unique_ptr<Worker>> workers_;
+	std::atomic<bool> running_{ false };
+	// Jobs pushed but not taken yet; sleeping workers are only woken while there are any.
+	std::atomic<int> queued_{ 0 };
+	std::atomic<int> sleepers_{ 0 };
+	std::mutex sleepMutex_;
+	std::condition_variable wakeUp_;
+};
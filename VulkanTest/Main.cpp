@@ -1,11 +1,11 @@
 #include "HelloTriangleApplication.h"
 
 
-int main() {
+int main(int argc, char** argv) {
 	HelloTriangleApplication app;
 
 	try {
-		app.Run();
+		app.Run(ParseOptions(argc, argv));
 	} catch (const std::runtime_error& e) {
 		printf("%s\n", e.what());
 
@@ -0,0 +1,301 @@
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <utility>
+
+#include "DeletionQueue.h"
+#include "MeshOptimizer.h"
+
+
+static float SignNotZero(float value) {
+	return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+// Projects the unit normal onto the octahedron and unfolds its lower half over the corners.
+static void EncodeOctahedral(const float normal[3], int8_t encoded[2]) {
+	float sum = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+	float x = normal[0] / sum;
+	float y = normal[1] / sum;
+	if (normal[2] < 0.0f) {
+		float foldedX = (1.0f - std::fabs(y)) * SignNotZero(x);
+		y = (1.0f - std::fabs(x)) * SignNotZero(y);
+		x = foldedX;
+	}
+
+	encoded[0] = static_cast<int8_t>(std::round(std::max(-1.0f, std::min(1.0f, x)) * 127.0f));
+	encoded[1] = static_cast<int8_t>(std::round(std::max(-1.0f, std::min(1.0f, y)) * 127.0f));
+}
+
+static void DecodeOctahedral(const int8_t encoded[2], float normal[3]) {
+	float x = std::max(-1.0f, encoded[0] / 127.0f);
+	float y = std::max(-1.0f, encoded[1] / 127.0f);
+	float z = 1.0f - std::fabs(x) - std::fabs(y);
+	if (z < 0.0f) {
+		float unfoldedX = (1.0f - std::fabs(y)) * SignNotZero(x);
+		y = (1.0f - std::fabs(x)) * SignNotZero(y);
+		x = unfoldedX;
+	}
+
+	float length = std::sqrt(x * x + y * y + z * z);
+	normal[0] = x / length;
+	normal[1] = y / length;
+	normal[2] = z / length;
+}
+
+static void Normalize(float v[3]) {
+	float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	for (int k = 0; k < 3; ++k) v[k] /= length;
+}
+
+
+VertexInputDescription GetVertexInputDescription(VertexFormat format) {
+	VertexInputDescription description = { };
+	description.binding.binding = 0;
+	description.binding.stride = VertexSize(format);
+	description.binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	for (uint32_t i = 0; i < 3; ++i) {
+		description.attributes[i].location = i;
+		description.attributes[i].binding = 0;
+	}
+
+	if (format == VertexFormat::Float) {
+		description.attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+		description.attributes[0].offset = offsetof(MeshVertex, position);
+		description.attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+		description.attributes[1].offset = offsetof(MeshVertex, normal);
+		description.attributes[2].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		description.attributes[2].offset = offsetof(MeshVertex, color);
+	} else {
+		// Three component 16 bit formats are rarely supported for vertex input, so the position has a fourth.
+		description.attributes[0].format = VK_FORMAT_R16G16B16A16_SNORM;
+		description.attributes[0].offset = offsetof(QuantizedVertex, position);
+		description.attributes[1].format = VK_FORMAT_R8G8_SNORM;
+		description.attributes[1].offset = offsetof(QuantizedVertex, normal);
+		description.attributes[2].format = VK_FORMAT_R8G8B8A8_UNORM;
+		description.attributes[2].offset = offsetof(QuantizedVertex, color);
+	}
+
+	return description;
+}
+
+uint32_t VertexSize(VertexFormat format) {
+	return format == VertexFormat::Float ? sizeof(MeshVertex) : sizeof(QuantizedVertex);
+}
+
+void OptimizeMesh(MeshData& mesh) {
+	// An empty mesh has nothing to reorder, and no first vertex to pass the positions by.
+	if (mesh.vertices.empty() || mesh.indices.empty()) return;
+
+	uint32_t vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+
+	OptimizeVertexCache(mesh.indices, vertexCount);
+	OptimizeOverdraw(mesh.indices, mesh.vertices[0].position, sizeof(MeshVertex) / sizeof(float), vertexCount);
+
+	std::vector<uint32_t> order = OptimizeVertexFetch(mesh.indices, vertexCount);
+	std::vector<MeshVertex> vertices(order.size());
+	for (size_t i = 0; i < order.size(); ++i) vertices[i] = mesh.vertices[order[i]];
+	mesh.vertices.swap(vertices);
+}
+
+QuantizedMesh QuantizeMesh(const MeshData& mesh) {
+	QuantizedMesh quantized;
+
+	float minimum[3] = { INFINITY, INFINITY, INFINITY };
+	float maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for (const MeshVertex& vertex : mesh.vertices) {
+		for (int k = 0; k < 3; ++k) {
+			minimum[k] = std::min(minimum[k], vertex.position[k]);
+			maximum[k] = std::max(maximum[k], vertex.position[k]);
+		}
+	}
+	for (int k = 0; k < 3; ++k) {
+		quantized.positionOffset[k] = 0.5f * (minimum[k] + maximum[k]);
+		quantized.positionScale[k] = std::max(0.5f * (maximum[k] - minimum[k]), 1e-6f);
+	}
+	quantized.positionOffset[3] = 0.0f;
+	quantized.positionScale[3] = 0.0f;
+
+	quantized.vertices.resize(mesh.vertices.size());
+	for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+		const MeshVertex& vertex = mesh.vertices[i];
+		QuantizedVertex& q = quantized.vertices[i];
+		for (int k = 0; k < 3; ++k) {
+			float normalized = (vertex.position[k] - quantized.positionOffset[k]) / quantized.positionScale[k];
+			q.position[k] = static_cast<int16_t>(std::round(std::max(-1.0f, std::min(1.0f, normalized)) * 32767.0f));
+		}
+		q.position[3] = 0;
+		EncodeOctahedral(vertex.normal, q.normal);
+		q.padding[0] = q.padding[1] = 0;
+		for (int k = 0; k < 4; ++k) q.color[k] = static_cast<uint8_t>(std::round(std::max(0.0f, std::min(1.0f, vertex.color[k])) * 255.0f));
+	}
+
+	return quantized;
+}
+
+void MeasureQuantizationError(const MeshData& mesh, const QuantizedMesh& quantized, float& positionError, float& normalErrorDegrees) {
+	float extent = 2.0f * std::max(quantized.positionScale[0], std::max(quantized.positionScale[1], quantized.positionScale[2]));
+	float minCosine = 1.0f;
+	positionError = 0.0f;
+
+	for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+		const MeshVertex& vertex = mesh.vertices[i];
+		const QuantizedVertex& q = quantized.vertices[i];
+
+		for (int k = 0; k < 3; ++k) {
+			float decoded = quantized.positionOffset[k] + std::max(-1.0f, q.position[k] / 32767.0f) * quantized.positionScale[k];
+			positionError = std::max(positionError, std::fabs(decoded - vertex.position[k]) / extent);
+		}
+
+		float normal[3];
+		DecodeOctahedral(q.normal, normal);
+		minCosine = std::min(minCosine, normal[0] * vertex.normal[0] + normal[1] * vertex.normal[1] + normal[2] * vertex.normal[2]);
+	}
+
+	normalErrorDegrees = std::acos(std::max(-1.0f, std::min(1.0f, minCosine))) * 180.0f / 3.14159265f;
+}
+
+MeshData CreateIcosphere(float radius, uint32_t subdivisions) {
+	const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+	std::vector<float> points = {
+		-1, t, 0,  1, t, 0,  -1, -t, 0,  1, -t, 0,
+		0, -1, t,  0, 1, t,  0, -1, -t,  0, 1, -t,
+		t, 0, -1,  t, 0, 1,  -t, 0, -1,  -t, 0, 1
+	};
+	std::vector<uint32_t> faces = {
+		0, 11, 5,  0, 5, 1,  0, 1, 7,  0, 7, 10,  0, 10, 11,
+		1, 5, 9,  5, 11, 4,  11, 10, 2,  10, 7, 6,  7, 1, 8,
+		3, 9, 4,  3, 4, 2,  3, 2, 6,  3, 6, 8,  3, 8, 9,
+		4, 9, 5,  2, 4, 11,  6, 2, 10,  8, 6, 7,  9, 8, 1
+	};
+	for (size_t i = 0; i < points.size(); i += 3) Normalize(&points[i]);
+
+	for (uint32_t level = 0; level < subdivisions; ++level) {
+		std::map<std::pair<uint32_t, uint32_t>, uint32_t> midpoints;
+		auto midpoint = [&](uint32_t a, uint32_t b) {
+			auto key = std::make_pair(std::min(a, b), std::max(a, b));
+			auto found = midpoints.find(key);
+			if (found != midpoints.end()) return found->second;
+
+			uint32_t index = static_cast<uint32_t>(points.size() / 3);
+			float p[3] = { points[3 * a] + points[3 * b], points[3 * a + 1] + points[3 * b + 1], points[3 * a + 2] + points[3 * b + 2] };
+			Normalize(p);
+			points.insert(points.end(), p, p + 3);
+			midpoints[key] = index;
+			return index;
+		};
+
+		std::vector<uint32_t> subdivided;
+		subdivided.reserve(faces.size() * 4);
+		for (size_t i = 0; i < faces.size(); i += 3) {
+			uint32_t a = faces[i], b = faces[i + 1], c = faces[i + 2];
+			uint32_t ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+			uint32_t children[] = { a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca };
+			subdivided.insert(subdivided.end(), children, children + 12);
+		}
+		faces.swap(subdivided);
+	}
+
+	MeshData mesh;
+	mesh.indices = faces;
+	mesh.vertices.resize(points.size() / 3);
+	for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+		MeshVertex& vertex = mesh.vertices[i];
+		for (int k = 0; k < 3; ++k) {
+			vertex.position[k] = radius * points[3 * i + k];
+			vertex.normal[k] = points[3 * i + k];
+			vertex.color[k] = 0.5f + 0.5f * points[3 * i + k];
+		}
+		vertex.color[3] = 1.0f;
+	}
+
+	return mesh;
+}
+
+MeshData CreateTriangle(float radius) {
+	const float pi = 3.14159265f;
+
+	MeshData mesh;
+	mesh.indices = { 0, 1, 2 };
+	mesh.vertices.resize(3);
+	for (int i = 0; i < 3; ++i) {
+		MeshVertex& vertex = mesh.vertices[i];
+		float angle = 0.5f * pi + 2.0f * pi * i / 3;
+		vertex.position[0] = radius * std::cos(angle);
+		vertex.position[1] = radius * std::sin(angle);
+		vertex.position[2] = 0.0f;
+		vertex.normal[0] = 0.0f;
+		vertex.normal[1] = 0.0f;
+		vertex.normal[2] = 1.0f;
+		for (int k = 0; k < 3; ++k) vertex.color[k] = k == i ? 1.0f : 0.0f;
+		vertex.color[3] = 1.0f;
+	}
+
+	return mesh;
+}
+
+
+GpuMesh CreateGpuMesh(const GpuContext& context, const MeshData& mesh, VertexFormat format) {
+	GpuMesh gpuMesh;
+	gpuMesh.format = format;
+	gpuMesh.indexCount = static_cast<uint32_t>(mesh.indices.size());
+	gpuMesh.indexType = mesh.vertices.size() <= 0xFFFF ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+	VkDeviceSize vertexBytes = static_cast<VkDeviceSize>(mesh.vertices.size()) * VertexSize(format);
+	VkDeviceSize indexBytes = static_cast<VkDeviceSize>(mesh.indices.size()) * (gpuMesh.indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4);
+	const VkMemoryPropertyFlags stagingProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	gpuMesh.vertexStaging = CreateBuffer(context, vertexBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingProperties);
+	gpuMesh.indexStaging = CreateBuffer(context, indexBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingProperties);
+	gpuMesh.vertices = CreateBuffer(context, vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	gpuMesh.indices = CreateBuffer(context, indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	if (format == VertexFormat::Float) {
+		memcpy(gpuMesh.vertexStaging.mapped, mesh.vertices.data(), vertexBytes);
+	} else {
+		QuantizedMesh quantized = QuantizeMesh(mesh);
+		memcpy(gpuMesh.vertexStaging.mapped, quantized.vertices.data(), vertexBytes);
+		memcpy(gpuMesh.positionOffset, quantized.positionOffset, sizeof(gpuMesh.positionOffset));
+		memcpy(gpuMesh.positionScale, quantized.positionScale, sizeof(gpuMesh.positionScale));
+	}
+
+	if (gpuMesh.indexType == VK_INDEX_TYPE_UINT16) {
+		uint16_t* indices = static_cast<uint16_t*>(gpuMesh.indexStaging.mapped);
+		for (size_t i = 0; i < mesh.indices.size(); ++i) indices[i] = static_cast<uint16_t>(mesh.indices[i]);
+	} else {
+		memcpy(gpuMesh.indexStaging.mapped, mesh.indices.data(), indexBytes);
+	}
+
+	return gpuMesh;
+}
+
+void RecordMeshUpload(const GpuContext& context, VkCommandBuffer commandBuffer, const GpuMesh& mesh) {
+	const DeviceDispatch& vk = *context.dispatch;
+
+	VkBufferCopy vertexCopy = { 0, 0, mesh.vertices.size };
+	vk.CmdCopyBuffer(commandBuffer, mesh.vertexStaging.buffer, mesh.vertices.buffer, 1, &vertexCopy);
+	VkBufferCopy indexCopy = { 0, 0, mesh.indices.size };
+	vk.CmdCopyBuffer(commandBuffer, mesh.indexStaging.buffer, mesh.indices.buffer, 1, &indexCopy);
+
+	VkMemoryBarrier barrier = { };
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void ReleaseMeshStaging(const GpuContext& context, GpuMesh& mesh) {
+	context.deletionQueue->DestroyBuffer(mesh.vertexStaging);
+	context.deletionQueue->DestroyBuffer(mesh.indexStaging);
+}
+
+void DestroyGpuMesh(const GpuContext& context, GpuMesh& mesh) {
+	DestroyBuffer(context, mesh.indexStaging);
+	DestroyBuffer(context, mesh.indices);
+	DestroyBuffer(context, mesh.vertexStaging);
+	DestroyBuffer(context, mesh.vertices);
+}
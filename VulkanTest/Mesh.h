@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GpuResources.h"
+
+
+struct MeshVertex {
+	float position[3];
+	float normal[3];
+	float color[4];
+};
+
+struct MeshData {
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// How a mesh's vertices are stored on the GPU.
+enum class VertexFormat {
+	// 40 bytes: float position, normal and color.
+	Float,
+	// 16 bytes: 16 bit positions relative to the mesh bounds, an octahedral
+	// encoded 8 bit normal and an 8 bit color.
+	Quantized
+};
+
+const int VERTEX_FORMAT_COUNT = 2;
+
+struct QuantizedVertex {
+	int16_t position[4];
+	int8_t normal[2];
+	uint8_t padding[2];
+	uint8_t color[4];
+};
+
+struct VertexInputDescription {
+	VkVertexInputBindingDescription binding;
+	VkVertexInputAttributeDescription attributes[3];
+};
+
+// The attributes are position, normal and color at locations 0 to 2. Quantized
+// normals arrive as two components that the shader has to decode.
+VertexInputDescription GetVertexInputDescription(VertexFormat format);
+uint32_t VertexSize(VertexFormat format);
+
+// Vertex cache order, then overdraw order, then vertex fetch order.
+void OptimizeMesh(MeshData& mesh);
+
+// Positions are reconstructed as positionOffset + stored * positionScale.
+struct QuantizedMesh {
+	std::vector<QuantizedVertex> vertices;
+	float positionOffset[4];
+	float positionScale[4];
+};
+
+QuantizedMesh QuantizeMesh(const MeshData& mesh);
+// The largest position error relative to the mesh extent and the largest normal error in degrees.
+void MeasureQuantizationError(const MeshData& mesh, const QuantizedMesh& quantized, float& positionError, float& normalErrorDegrees);
+
+// A sphere subdivided from an icosahedron, colored by its normals. Triangles come
+// out face by face of the previous level, which has some locality but isn't tuned
+// for any cache, much like what a modelling tool exports.
+MeshData CreateIcosphere(float radius, uint32_t subdivisions);
+
+// One red, green and blue triangle facing +z, inside a circle of the given radius.
+MeshData CreateTriangle(float radius);
+
+
+// The position offset and scale are those of the QuantizedMesh, or 0 and 1 for float vertices.
+struct GpuMesh {
+	VertexFormat format = VertexFormat::Float;
+	GpuBuffer vertices;
+	GpuBuffer indices;
+	// 16 bit whenever the vertex count allows.
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	uint32_t indexCount = 0;
+	float positionOffset[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float positionScale[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+	// Filled at creation and copied into the device local buffers by RecordMeshUpload.
+	GpuBuffer vertexStaging;
+	GpuBuffer indexStaging;
+};
+
+GpuMesh CreateGpuMesh(const GpuContext& context, const MeshData& mesh, VertexFormat format);
+void RecordMeshUpload(const GpuContext& context, VkCommandBuffer commandBuffer, const GpuMesh& mesh);
+// Call once the command buffer with the upload has been submitted.
+void ReleaseMeshStaging(const GpuContext& context, GpuMesh& mesh);
+void DestroyGpuMesh(const GpuContext& context, GpuMesh& mesh);
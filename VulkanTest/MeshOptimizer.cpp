@@ -0,0 +1,273 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// Forsyth's scoring: vertices of the last triangle are slightly less attractive than
+// those a few steps back, the cache decays with age, and vertices with few remaining
+// triangles get a boost so they are finished off and don't leave stragglers.
+static const uint32_t FORSYTH_CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+// Overdraw clusters shorter than this aren't split further.
+static const uint32_t MIN_SOFT_CLUSTER = 16;
+static const uint32_t OVERDRAW_CACHE_SIZE = 16;
+
+static const uint32_t FETCH_LINE_SIZE = 64;
+static const uint32_t FETCH_CACHE_LINES = 256;
+
+static const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+
+static float VertexScore(int cachePosition, uint32_t remainingTriangles) {
+	if (remainingTriangles == 0) return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) score = LAST_TRIANGLE_SCORE;
+		else score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+	}
+
+	return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+}
+
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount) {
+	uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (triangleCount == 0) return;
+
+	// Triangles per vertex; the live ones of vertex v are adjacency[offsets[v], offsets[v] + remaining[v]).
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (uint32_t index : indices) ++remaining[index];
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (uint32_t v = 0; v < vertexCount; ++v) offsets[v + 1] = offsets[v] + remaining[v];
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (uint32_t t = 0; t < triangleCount; ++t) {
+		for (int k = 0; k < 3; ++k) adjacency[fill[indices[3 * t + k]]++] = t;
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; ++v) vertexScore[v] = VertexScore(-1, remaining[v]);
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	for (uint32_t t = 0; t < triangleCount; ++t) {
+		triangleScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> newCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	uint32_t best = static_cast<uint32_t>(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+	uint32_t cursor = 0;
+
+	for (uint32_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+		// Nothing in the cache has triangles left, so start over at the next unused triangle.
+		if (best == INVALID_INDEX) {
+			while (emitted[cursor]) ++cursor;
+			best = cursor;
+		}
+
+		const uint32_t* triangle = &indices[3 * best];
+		output.insert(output.end(), triangle, triangle + 3);
+		emitted[best] = 1;
+
+		for (int k = 0; k < 3; ++k) {
+			uint32_t v = triangle[k];
+			uint32_t* live = &adjacency[offsets[v]];
+			uint32_t* last = live + remaining[v] - 1;
+			std::iter_swap(std::find(live, last, best), last);
+			--remaining[v];
+		}
+
+		newCache.assign(triangle, triangle + 3);
+		for (uint32_t v : cache) if (v != triangle[0] && v != triangle[1] && v != triangle[2]) newCache.push_back(v);
+
+		// Rescore everything that moved in the cache or fell out of it.
+		for (size_t i = 0; i < newCache.size(); ++i) {
+			uint32_t v = newCache[i];
+			cachePosition[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+			float score = VertexScore(cachePosition[v], remaining[v]);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+			for (uint32_t j = 0; j < remaining[v]; ++j) triangleScore[adjacency[offsets[v] + j]] += delta;
+		}
+
+		if (newCache.size() > FORSYTH_CACHE_SIZE) newCache.resize(FORSYTH_CACHE_SIZE);
+		cache.swap(newCache);
+
+		best = INVALID_INDEX;
+		float bestScore = -1.0f;
+		for (uint32_t v : cache) {
+			for (uint32_t j = 0; j < remaining[v]; ++j) {
+				uint32_t t = adjacency[offsets[v] + j];
+				if (triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+	}
+
+	indices.swap(output);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const float* positions, uint32_t positionStride, uint32_t vertexCount, float threshold) {
+	uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (triangleCount == 0) return;
+
+	float targetAcmr = AnalyzeVertexCache(indices, vertexCount, OVERDRAW_CACHE_SIZE).acmr * threshold;
+
+	// Hard boundaries are where all three vertices miss, so the cache is cold anyway. Inside
+	// those, clusters are also cut once they are long enough and as efficient as the target,
+	// simulating each cluster from a cold cache since it may end up anywhere.
+	std::vector<uint32_t> clusterStarts;
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = OVERDRAW_CACHE_SIZE + 1;
+	uint32_t clusterTriangles = 0;
+	uint32_t clusterMisses = 0;
+
+	for (uint32_t t = 0; t < triangleCount; ++t) {
+		uint32_t misses = 0;
+		for (int k = 0; k < 3; ++k) misses += time - timestamps[indices[3 * t + k]] > OVERDRAW_CACHE_SIZE;
+
+		bool hardBoundary = misses == 3;
+		bool softBoundary = clusterTriangles >= MIN_SOFT_CLUSTER && clusterMisses <= targetAcmr * clusterTriangles;
+		if (t == 0 || hardBoundary || softBoundary) {
+			clusterStarts.push_back(t);
+			clusterTriangles = 0;
+			clusterMisses = 0;
+			time += OVERDRAW_CACHE_SIZE + 1;
+		}
+
+		for (int k = 0; k < 3; ++k) {
+			uint32_t v = indices[3 * t + k];
+			if (time - timestamps[v] > OVERDRAW_CACHE_SIZE) {
+				timestamps[v] = time++;
+				++clusterMisses;
+			}
+		}
+		++clusterTriangles;
+	}
+	clusterStarts.push_back(triangleCount);
+	uint32_t clusterCount = static_cast<uint32_t>(clusterStarts.size() - 1);
+
+	// Area weighted centroid and normal of each cluster and of the whole mesh.
+	std::vector<float> clusterData(clusterCount * 6, 0.0f);
+	float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+	float meshArea = 0.0f;
+
+	for (uint32_t c = 0; c < clusterCount; ++c) {
+		float* centroid = &clusterData[6 * c];
+		float* normal = centroid + 3;
+		float clusterArea = 0.0f;
+
+		for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t) {
+			const float* p0 = positions + indices[3 * t] * positionStride;
+			const float* p1 = positions + indices[3 * t + 1] * positionStride;
+			const float* p2 = positions + indices[3 * t + 2] * positionStride;
+			float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			for (int k = 0; k < 3; ++k) {
+				centroid[k] += area * (p0[k] + p1[k] + p2[k]) / 3.0f;
+				normal[k] += n[k];
+			}
+			clusterArea += area;
+		}
+
+		for (int k = 0; k < 3; ++k) meshCentroid[k] += centroid[k];
+		meshArea += clusterArea;
+		if (clusterArea > 0.0f) for (int k = 0; k < 3; ++k) centroid[k] /= clusterArea;
+	}
+	if (meshArea > 0.0f) for (int k = 0; k < 3; ++k) meshCentroid[k] /= meshArea;
+
+	// Clusters facing away from the center are on the outside and should be drawn first.
+	std::vector<float> keys(clusterCount);
+	for (uint32_t c = 0; c < clusterCount; ++c) {
+		const float* centroid = &clusterData[6 * c];
+		const float* normal = centroid + 3;
+		float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		float dot = 0.0f;
+		for (int k = 0; k < 3; ++k) dot += (centroid[k] - meshCentroid[k]) * normal[k];
+		keys[c] = length > 0.0f ? dot / length : 0.0f;
+	}
+
+	std::vector<uint32_t> order(clusterCount);
+	for (uint32_t c = 0; c < clusterCount; ++c) order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (uint32_t c : order) output.insert(output.end(), indices.begin() + 3 * clusterStarts[c], indices.begin() + 3 * clusterStarts[c + 1]);
+
+	if (AnalyzeVertexCache(output, vertexCount, OVERDRAW_CACHE_SIZE).acmr <= targetAcmr) indices.swap(output);
+}
+
+std::vector<uint32_t> OptimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount) {
+	std::vector<uint32_t> remap(vertexCount, INVALID_INDEX);
+	std::vector<uint32_t> order;
+	order.reserve(vertexCount);
+
+	for (uint32_t& index : indices) {
+		if (remap[index] == INVALID_INDEX) {
+			remap[index] = static_cast<uint32_t>(order.size());
+			order.push_back(index);
+		}
+		index = remap[index];
+	}
+
+	return order;
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize) {
+	VertexCacheStats stats;
+	if (indices.empty()) return stats;
+
+	// A vertex is in the FIFO if fewer than cacheSize misses happened since it was loaded.
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+	for (uint32_t index : indices) {
+		if (time - timestamps[index] > cacheSize) {
+			timestamps[index] = time++;
+			++stats.transformedVertices;
+		}
+	}
+
+	stats.acmr = static_cast<float>(stats.transformedVertices) / (indices.size() / 3);
+	stats.atvr = vertexCount > 0 ? static_cast<float>(stats.transformedVertices) / vertexCount : 0.0f;
+	return stats;
+}
+
+VertexFetchStats AnalyzeVertexFetch(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t vertexSize) {
+	VertexFetchStats stats;
+	std::vector<uint64_t> tags(FETCH_CACHE_LINES, ~0ull);
+
+	for (uint32_t index : indices) {
+		uint64_t begin = static_cast<uint64_t>(index) * vertexSize;
+		uint64_t end = begin + vertexSize;
+		for (uint64_t line = begin / FETCH_LINE_SIZE; line <= (end - 1) / FETCH_LINE_SIZE; ++line) {
+			uint64_t& tag = tags[line % FETCH_CACHE_LINES];
+			if (tag != line) {
+				tag = line;
+				stats.bytesFetched += FETCH_LINE_SIZE;
+			}
+		}
+	}
+
+	uint64_t vertexBytes = static_cast<uint64_t>(vertexCount) * vertexSize;
+	stats.overfetch = vertexBytes > 0 ? static_cast<float>(stats.bytesFetched) / vertexBytes : 0.0f;
+	return stats;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+
+// Post-transform cache statistics of an index stream, simulated with a FIFO cache.
+struct VertexCacheStats {
+	uint32_t transformedVertices = 0;
+	// Average cache miss ratio: transformed vertices per triangle, 0.5 at best, 3 at worst.
+	float acmr = 0.0f;
+	// Average transformed vertex ratio: transformed vertices per vertex, 1 at best.
+	float atvr = 0.0f;
+};
+
+struct VertexFetchStats {
+	uint64_t bytesFetched = 0;
+	// Bytes fetched per byte of vertex data, 1 at best.
+	float overfetch = 0.0f;
+};
+
+
+// Index and vertex buffer optimizations for triangle lists, in the order they
+// should run: vertex cache order first, then overdraw order (which keeps most of
+// the cache efficiency), then vertex fetch order, which renumbers the vertices
+// and so has to come last.
+
+// Reorders triangles for the post-transform vertex cache (Forsyth, "Linear-Speed
+// Vertex Cache Optimisation").
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+// Reorders clusters of the cache optimized triangles so that the outward facing
+// ones are drawn first and hide the rest (Sander et al., "Fast Triangle Reordering
+// for Vertex Locality and Reduced Overdraw"). The clusters are split where the
+// cache is cold anyway; the new order is kept only if the ACMR grows by less than
+// the given factor. positions holds xyz with the given stride in floats.
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const float* positions, uint32_t positionStride, uint32_t vertexCount, float threshold = 1.05f);
+
+// Numbers the vertices in the order the indices first use them, so they are
+// fetched sequentially. Returns the old index of each new vertex; unused vertices are dropped.
+std::vector<uint32_t> OptimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = 16);
+// Simulates a small direct mapped cache of 64 byte lines in front of the vertex buffer.
+VertexFetchStats AnalyzeVertexFetch(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t vertexSize);
@@ -0,0 +1,503 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+
+struct PyramidParams {
+	int32_t srcSize[2];
+	int32_t dstSize[2];
+};
+
+struct CullParams {
+	Camera camera;
+	int32_t pyramidSize[2];
+	uint32_t pyramidLevels;
+	uint32_t instanceCount;
+	uint32_t phase;
+	uint32_t listOffset;
+	uint32_t testOcclusion;
+};
+
+
+static uint32_t GroupCount(uint32_t size, uint32_t groupSize) {
+	return (size + groupSize - 1) / groupSize;
+}
+
+static uint32_t PreviousPowerOfTwo(uint32_t value) {
+	uint32_t result = 1;
+	while (result * 2 <= value) result *= 2;
+	return result;
+}
+
+
+void OcclusionCuller::Init(const GpuContext& context, const ShaderCode& pyramidCode, const ShaderCode& cullCode, VkBuffer instanceBuffer, uint32_t capacity, int slotCount) {
+	context_ = context;
+	capacity_ = std::max(1u, capacity);
+	instanceBuffer_ = instanceBuffer;
+	slots_.resize(slotCount);
+	const DeviceDispatch& vk = *context_.dispatch;
+
+	counters_ = CreateBuffer(context_, sizeof(CullCounters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	drawLists_ = CreateBuffer(context_, PHASE_COUNT * capacity_ * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	occluded_ = CreateBuffer(context_, capacity_ * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	for (Slot& slot : slots_) slot.readback = CreateBuffer(context_, sizeof(CullCounters), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	// Only read with texelFetch, so the filtering doesn't matter.
+	VkSamplerCreateInfo samplerInfo = { };
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.pNext = nullptr;
+	samplerInfo.flags = 0;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1.0f;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = static_cast<float>(MAX_PYRAMID_LEVELS);
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+
+	VkResult result = vk.CreateSampler(context_.device, &samplerInfo, nullptr, &sampler_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create occlusion sampler!");
+
+	// Pyramid levels: the sampled source and the storage destination.
+	VkDescriptorSetLayoutBinding bindings[5] = { };
+	for (uint32_t i = 0; i < 5; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = { };
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = nullptr;
+	layoutInfo.flags = 0;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings;
+
+	result = vk.CreateDescriptorSetLayout(context_.device, &layoutInfo, nullptr, &pyramidSetLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create depth pyramid descriptor set layout!");
+
+	// Culling: the instances, the pyramid, the counters, the draw lists and the occluded flags.
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	for (uint32_t i = 2; i < 5; ++i) bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layoutInfo.bindingCount = 5;
+
+	result = vk.CreateDescriptorSetLayout(context_.device, &layoutInfo, nullptr, &cullSetLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create cull descriptor set layout!");
+
+	// Drawing: the draw lists.
+	bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	layoutInfo.bindingCount = 1;
+
+	result = vk.CreateDescriptorSetLayout(context_.device, &layoutInfo, nullptr, &drawSetLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create draw list descriptor set layout!");
+
+	VkPushConstantRange pushConstantRange = { };
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(PyramidParams);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = { };
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.pNext = nullptr;
+	pipelineLayoutInfo.flags = 0;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &pyramidSetLayout_;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	result = vk.CreatePipelineLayout(context_.device, &pipelineLayoutInfo, nullptr, &pyramidPipelineLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create depth pyramid pipeline layout!");
+
+	pushConstantRange.size = sizeof(CullParams);
+	pipelineLayoutInfo.pSetLayouts = &cullSetLayout_;
+	result = vk.CreatePipelineLayout(context_.device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create cull pipeline layout!");
+
+	pyramidPipeline_ = CreateComputePipeline(context_, pyramidPipelineLayout_, pyramidCode);
+	cullPipeline_ = CreateComputePipeline(context_, cullPipelineLayout_, cullCode);
+
+	VkDescriptorPoolSize poolSize = { };
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo poolInfo = { };
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.pNext = nullptr;
+	poolInfo.flags = 0;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	result = vk.CreateDescriptorPool(context_.device, &poolInfo, nullptr, &drawPool_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create draw list descriptor pool!");
+
+	drawSet_ = this->AllocateSet(drawPool_, drawSetLayout_);
+	this->WriteBuffer(drawSet_, 0, drawLists_.buffer);
+}
+
+void OcclusionCuller::Destroy() {
+	const DeviceDispatch& vk = *context_.dispatch;
+
+	this->DestroyTargets();
+	vk.DestroyDescriptorPool(context_.device, drawPool_, nullptr);
+	vk.DestroyPipeline(context_.device, cullPipeline_, nullptr);
+	vk.DestroyPipeline(context_.device, pyramidPipeline_, nullptr);
+	vk.DestroyPipelineLayout(context_.device, cullPipelineLayout_, nullptr);
+	vk.DestroyPipelineLayout(context_.device, pyramidPipelineLayout_, nullptr);
+	vk.DestroyDescriptorSetLayout(context_.device, drawSetLayout_, nullptr);
+	vk.DestroyDescriptorSetLayout(context_.device, cullSetLayout_, nullptr);
+	vk.DestroyDescriptorSetLayout(context_.device, pyramidSetLayout_, nullptr);
+	vk.DestroySampler(context_.device, sampler_, nullptr);
+	for (Slot& slot : slots_) DestroyBuffer(context_, slot.readback);
+	DestroyBuffer(context_, occluded_);
+	DestroyBuffer(context_, drawLists_);
+	DestroyBuffer(context_, counters_);
+}
+
+void OcclusionCuller::Configure(bool enabled, bool compare) {
+	enabled_ = enabled;
+	compare_ = compare;
+}
+
+void OcclusionCuller::CreateTargets(VkExtent2D maxExtent, const GpuImage* sceneDepths) {
+	// A power of two, so every level is exactly half the one before and a texel of
+	// any level covers the same texels of level 0 everywhere.
+	pyramidExtent_ = { PreviousPowerOfTwo(maxExtent.width), PreviousPowerOfTwo(maxExtent.height) };
+	pyramidLevels_ = 1;
+	while (pyramidLevels_ < MAX_PYRAMID_LEVELS && (std::max(pyramidExtent_.width, pyramidExtent_.height) >> pyramidLevels_) > 0) ++pyramidLevels_;
+	pyramidValid_ = false;
+
+	pyramid_ = CreateImage2D(context_, PYRAMID_FORMAT, pyramidExtent_, pyramidLevels_, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	for (uint32_t level = 0; level < pyramidLevels_; ++level) pyramidLevelViews_[level] = CreateImageView(context_, pyramid_.image, PYRAMID_FORMAT, level, 1);
+
+	uint32_t slotCount = static_cast<uint32_t>(slots_.size());
+	uint32_t pyramidSetCount = slotCount + pyramidLevels_ - 1;
+
+	VkDescriptorPoolSize poolSizes[3] = { };
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = pyramidSetCount + 1;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = pyramidSetCount;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[2].descriptorCount = 4;
+
+	VkDescriptorPoolCreateInfo poolInfo = { };
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.pNext = nullptr;
+	poolInfo.flags = 0;
+	poolInfo.maxSets = pyramidSetCount + 1;
+	poolInfo.poolSizeCount = 3;
+	poolInfo.pPoolSizes = poolSizes;
+
+	VkDescriptorPool pool;
+	VkResult result = context_.dispatch->CreateDescriptorPool(context_.device, &poolInfo, nullptr, &pool);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create occlusion descriptor pool!");
+	targetPool_ = UniqueDescriptorPool(*context_.deletionQueue, pool);
+
+	depthImages_.resize(slotCount);
+	depthSets_.resize(slotCount);
+	for (uint32_t i = 0; i < slotCount; ++i) {
+		depthImages_[i] = sceneDepths[i].image;
+		depthSets_[i] = this->AllocateSet(pool, pyramidSetLayout_);
+		this->WriteImage(depthSets_[i], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, sceneDepths[i].view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+		this->WriteImage(depthSets_[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, pyramidLevelViews_[0], VK_IMAGE_LAYOUT_GENERAL);
+	}
+
+	for (uint32_t level = 1; level < pyramidLevels_; ++level) {
+		levelSets_[level] = this->AllocateSet(pool, pyramidSetLayout_);
+		this->WriteImage(levelSets_[level], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, pyramidLevelViews_[level - 1], VK_IMAGE_LAYOUT_GENERAL);
+		this->WriteImage(levelSets_[level], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, pyramidLevelViews_[level], VK_IMAGE_LAYOUT_GENERAL);
+	}
+
+	cullSet_ = this->AllocateSet(pool, cullSetLayout_);
+	this->WriteBuffer(cullSet_, 0, instanceBuffer_);
+	this->WriteImage(cullSet_, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, pyramid_.view, VK_IMAGE_LAYOUT_GENERAL);
+	this->WriteBuffer(cullSet_, 2, counters_.buffer);
+	this->WriteBuffer(cullSet_, 3, drawLists_.buffer);
+	this->WriteBuffer(cullSet_, 4, occluded_.buffer);
+}
+
+void OcclusionCuller::DestroyTargets() {
+	DeletionQueue& deletionQueue = *context_.deletionQueue;
+
+	for (VkImageView& view : pyramidLevelViews_) {
+		if (view != VK_NULL_HANDLE) deletionQueue.DestroyImageView(view);
+		view = VK_NULL_HANDLE;
+	}
+	deletionQueue.DestroyImage(pyramid_);
+
+	// Freeing the pool frees the sets.
+	targetPool_.Reset();
+	pyramidValid_ = false;
+}
+
+void OcclusionCuller::RecordEarly(VkCommandBuffer commandBuffer, int slotIndex, uint32_t instanceCount, uint32_t indexCount, const Camera& camera) {
+	const DeviceDispatch& vk = *context_.dispatch;
+	Slot& slot = slots_[slotIndex];
+
+	slot.recorded = true;
+	slot.instanceCount = std::min(instanceCount, capacity_);
+	slot.occlusion = compare_ ? (frameCount_ / COMPARE_FRAMES) % 2 == 0 : enabled_;
+	++frameCount_;
+
+	// The previous frame's culling, draws and readback have to be done with the buffers
+	// before they are reset, and its pyramid has to be written before it is tested against.
+	VkMemoryBarrier barrier = { };
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	VkPipelineStageFlags previousStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+	vk.CmdPipelineBarrier(commandBuffer, previousStages, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// Without a frame's depth in it, the pyramid's contents can be discarded.
+	if (slot.occlusion && !pyramidValid_) {
+		VkImageMemoryBarrier imageBarrier = { };
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.pNext = nullptr;
+		imageBarrier.srcAccessMask = 0;
+		imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = pyramid_.image;
+		imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+		vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+	}
+
+	CullCounters counters = { };
+	for (int phase = 0; phase < PHASE_COUNT; ++phase) counters.draws[phase].indexCount = indexCount;
+	vk.CmdUpdateBuffer(commandBuffer, counters_.buffer, 0, sizeof(counters), &counters);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	this->Dispatch(commandBuffer, EARLY, slot.instanceCount, camera, slot.occlusion && pyramidValid_);
+}
+
+void OcclusionCuller::RecordLate(VkCommandBuffer commandBuffer, int slotIndex, uint32_t instanceCount, VkExtent2D renderExtent, const Camera& camera) {
+	const DeviceDispatch& vk = *context_.dispatch;
+	const Slot& slot = slots_[slotIndex];
+
+	// Frustum culling needs no second phase, and the pyramid goes stale without it.
+	if (!slot.occlusion) {
+		pyramidValid_ = false;
+		return;
+	}
+
+	// The early pass has to be done writing the depth, and the early culling done reading the pyramid.
+	VkImageMemoryBarrier depthBarrier = { };
+	depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	depthBarrier.pNext = nullptr;
+	depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.image = depthImages_[slotIndex];
+	depthBarrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+	VkMemoryBarrier levelBarrier = { };
+	levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	levelBarrier.pNext = nullptr;
+	levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	// Every texel keeps the farthest depth under it.
+	vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipeline_);
+	VkExtent2D src = renderExtent;
+	for (uint32_t level = 0; level < pyramidLevels_; ++level) {
+		VkExtent2D dst = { std::max(1u, pyramidExtent_.width >> level), std::max(1u, pyramidExtent_.height >> level) };
+		PyramidParams params = { { static_cast<int32_t>(src.width), static_cast<int32_t>(src.height) }, { static_cast<int32_t>(dst.width), static_cast<int32_t>(dst.height) } };
+		VkDescriptorSet set = level == 0 ? depthSets_[slotIndex] : levelSets_[level];
+
+		vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipelineLayout_, 0, 1, &set, 0, nullptr);
+		vk.CmdPushConstants(commandBuffer, pyramidPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+		vk.CmdDispatch(commandBuffer, GroupCount(dst.width, 8), GroupCount(dst.height, 8), 1);
+		vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+		src = dst;
+	}
+	pyramidValid_ = true;
+
+	this->Dispatch(commandBuffer, LATE, slot.instanceCount, camera, true);
+}
+
+void OcclusionCuller::RecordDraw(VkCommandBuffer commandBuffer, Phase phase) {
+	VkDeviceSize offset = offsetof(CullCounters, draws) + phase * sizeof(VkDrawIndexedIndirectCommand);
+	context_.dispatch->CmdDrawIndexedIndirect(commandBuffer, counters_.buffer, offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void OcclusionCuller::RecordReadback(VkCommandBuffer commandBuffer, int slotIndex) {
+	const DeviceDispatch& vk = *context_.dispatch;
+
+	VkBufferMemoryBarrier barrier = { };
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = counters_.buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	VkBufferCopy copy = { 0, 0, sizeof(CullCounters) };
+	vk.CmdCopyBuffer(commandBuffer, counters_.buffer, slots_[slotIndex].readback.buffer, 1, &copy);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	barrier.buffer = slots_[slotIndex].readback.buffer;
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void OcclusionCuller::Resolve(int slotIndex, double sceneMs) {
+	Slot& slot = slots_[slotIndex];
+	if (!slot.recorded) return;
+	slot.recorded = false;
+
+	CullCounters counters;
+	memcpy(&counters, slot.readback.mapped, sizeof(counters));
+
+	Totals& totals = totals_[slot.occlusion ? 1 : 0];
+	++totals.frames;
+	totals.instances += slot.instanceCount;
+	totals.frustumCulled += counters.frustumCulled;
+	totals.occluded += counters.lateOccluded;
+	totals.disoccluded += counters.earlyOccluded - counters.lateOccluded;
+	if (sceneMs >= 0.0) {
+		++totals.timedFrames;
+		totals.sceneMs += sceneMs;
+	}
+
+	if (totals_[0].frames + totals_[1].frames == REPORT_INTERVAL) this->Report();
+}
+
+
+VkDescriptorSet OcclusionCuller::AllocateSet(VkDescriptorPool pool, VkDescriptorSetLayout layout) {
+	VkDescriptorSetAllocateInfo allocateInfo = { };
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.pNext = nullptr;
+	allocateInfo.descriptorPool = pool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet set;
+	VkResult result = context_.dispatch->AllocateDescriptorSets(context_.device, &allocateInfo, &set);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to allocate occlusion descriptor set!");
+
+	return set;
+}
+
+void OcclusionCuller::WriteImage(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkImageView view, VkImageLayout layout) {
+	VkDescriptorImageInfo imageInfo = { };
+	imageInfo.sampler = type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ? sampler_ : VK_NULL_HANDLE;
+	imageInfo.imageView = view;
+	imageInfo.imageLayout = layout;
+
+	VkWriteDescriptorSet write = { };
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = nullptr;
+	write.dstSet = set;
+	write.dstBinding = binding;
+	write.dstArrayElement = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = type;
+	write.pImageInfo = &imageInfo;
+	write.pBufferInfo = nullptr;
+	write.pTexelBufferView = nullptr;
+	context_.dispatch->UpdateDescriptorSets(context_.device, 1, &write, 0, nullptr);
+}
+
+void OcclusionCuller::WriteBuffer(VkDescriptorSet set, uint32_t binding, VkBuffer buffer) {
+	VkDescriptorBufferInfo bufferInfo = { };
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet write = { };
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = nullptr;
+	write.dstSet = set;
+	write.dstBinding = binding;
+	write.dstArrayElement = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pImageInfo = nullptr;
+	write.pBufferInfo = &bufferInfo;
+	write.pTexelBufferView = nullptr;
+	context_.dispatch->UpdateDescriptorSets(context_.device, 1, &write, 0, nullptr);
+}
+
+void OcclusionCuller::Dispatch(VkCommandBuffer commandBuffer, Phase phase, uint32_t instanceCount, const Camera& camera, bool testOcclusion) {
+	const DeviceDispatch& vk = *context_.dispatch;
+
+	CullParams params = { };
+	params.camera = camera;
+	params.pyramidSize[0] = static_cast<int32_t>(pyramidExtent_.width);
+	params.pyramidSize[1] = static_cast<int32_t>(pyramidExtent_.height);
+	params.pyramidLevels = pyramidLevels_;
+	params.instanceCount = instanceCount;
+	params.phase = phase;
+	params.listOffset = this->ListOffset(phase);
+	params.testOcclusion = testOcclusion ? 1 : 0;
+
+	vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline_);
+	vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout_, 0, 1, &cullSet_, 0, nullptr);
+	vk.CmdPushConstants(commandBuffer, cullPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+	vk.CmdDispatch(commandBuffer, GroupCount(instanceCount, 64), 1, 1);
+
+	// The draw that follows reads the command and the list.
+	VkMemoryBarrier barrier = { };
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void OcclusionCuller::Report() {
+	static const char* modeNames[] = { "frustum only", "occlusion" };
+
+	printf("Culling (avg of %d frames):", REPORT_INTERVAL);
+	for (int mode = 1; mode >= 0; --mode) {
+		const Totals& totals = totals_[mode];
+		if (totals.frames == 0) continue;
+
+		double frames = totals.frames;
+		double drawn = (totals.instances - totals.frustumCulled - totals.occluded) / frames;
+		printf(" [%s] %.0f instances, %.0f outside the frustum, %.0f occluded, %.0f drawn (%.0f found by the late phase)", modeNames[mode], totals.instances / frames, totals.frustumCulled / frames, totals.occluded / frames, drawn, totals.disoccluded / frames);
+		if (totals.timedFrames > 0) printf(", scene %.3f ms", totals.sceneMs / totals.timedFrames);
+		printf(";");
+	}
+
+	const Totals& culled = totals_[1];
+	const Totals& frustum = totals_[0];
+	if (culled.timedFrames > 0 && frustum.timedFrames > 0) {
+		printf(" occlusion culling saves %.3f ms", frustum.sceneMs / frustum.timedFrames - culled.sceneMs / culled.timedFrames);
+	}
+	printf("\n");
+
+	totals_[0] = Totals();
+	totals_[1] = Totals();
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "Camera.h"
+#include "DeletionQueue.h"
+#include "GpuResources.h"
+
+
+// GPU frustum and two-phase hierarchical-Z occlusion culling of the instance
+// buffer into indirect draws. The early phase tests every instance against the
+// depth pyramid of the previous frame and draws what passes; the pyramid is then
+// rebuilt from that depth, and the late phase re-tests what the early phase found
+// occluded, drawing the disocclusions. The late phase only ever tests against
+// depth that was drawn this frame, so nothing visible is lost to stale depth.
+//
+// Everything runs in the scene command buffer on the graphics queue, so the
+// pyramid and the draw lists are shared by the frame slots; only the statistics
+// read back per slot.
+class OcclusionCuller {
+public:
+	static const VkFormat PYRAMID_FORMAT = VK_FORMAT_R32_SFLOAT;
+
+	enum Phase {
+		EARLY,
+		LATE,
+		PHASE_COUNT
+	};
+
+	void Init(const GpuContext& context, const ShaderCode& pyramidCode, const ShaderCode& cullCode, VkBuffer instanceBuffer, uint32_t capacity, int slotCount);
+	void Destroy();
+
+	// enabled off culls against the frustum only. compare alternates between both every
+	// COMPARE_FRAMES frames and reports the scene pass time of each.
+	void Configure(bool enabled, bool compare);
+
+	// The pyramid covers the largest extent the scene can be rendered at.
+	void CreateTargets(VkExtent2D maxExtent, const GpuImage* sceneDepths);
+	void DestroyTargets();
+
+	// Before the early render pass: culls into the early draw list. Every instance is
+	// drawn with the same indexCount indices.
+	void RecordEarly(VkCommandBuffer commandBuffer, int slot, uint32_t instanceCount, uint32_t indexCount, const Camera& camera);
+	// Between the render passes: builds the pyramid from the slot's depth, which has to be in
+	// VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, and culls into the late draw list.
+	void RecordLate(VkCommandBuffer commandBuffer, int slot, uint32_t instanceCount, VkExtent2D renderExtent, const Camera& camera);
+	void RecordDraw(VkCommandBuffer commandBuffer, Phase phase);
+	// After both render passes: copies the phase counters for Resolve.
+	void RecordReadback(VkCommandBuffer commandBuffer, int slot);
+
+	// Call once the slot's scene pass has finished; sceneMs is negative if it wasn't timed.
+	void Resolve(int slot, double sceneMs);
+
+	// The draw lists hold instance indices; the vertex shader finds a phase's list at ListOffset.
+	VkDescriptorSetLayout DrawSetLayout() const { return drawSetLayout_; }
+	VkDescriptorSet DrawSet() const { return drawSet_; }
+	uint32_t ListOffset(Phase phase) const { return phase * capacity_; }
+
+private:
+	static const int REPORT_INTERVAL = 300;
+	static const int COMPARE_FRAMES = 120;
+	static const uint32_t MAX_PYRAMID_LEVELS = 16;
+
+	// The draw buffer: one indexed indirect command per phase, then the counters.
+	struct CullCounters {
+		VkDrawIndexedIndirectCommand draws[PHASE_COUNT];
+		uint32_t frustumCulled;
+		uint32_t earlyOccluded;
+		uint32_t lateOccluded;
+		uint32_t padding;
+	};
+
+	struct Slot {
+		GpuBuffer readback;
+		bool recorded = false;
+		bool occlusion = false;
+		uint32_t instanceCount = 0;
+	};
+
+	struct Totals {
+		int frames = 0;
+		int timedFrames = 0;
+		double sceneMs = 0.0;
+		double instances = 0.0;
+		double frustumCulled = 0.0;
+		double occluded = 0.0;
+		double disoccluded = 0.0;
+	};
+
+private:
+	VkDescriptorSet AllocateSet(VkDescriptorPool pool, VkDescriptorSetLayout layout);
+	void WriteImage(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkImageView view, VkImageLayout layout);
+	void WriteBuffer(VkDescriptorSet set, uint32_t binding, VkBuffer buffer);
+	void Dispatch(VkCommandBuffer commandBuffer, Phase phase, uint32_t instanceCount, const Camera& camera, bool testOcclusion);
+	void Report();
+
+private:
+	GpuContext context_;
+	uint32_t capacity_ = 0;
+	bool enabled_ = true;
+	bool compare_ = false;
+	uint64_t frameCount_ = 0;
+
+	GpuBuffer counters_;
+	GpuBuffer drawLists_;
+	// Per instance: whether the early phase found it occluded, for the late phase to re-test.
+	GpuBuffer occluded_;
+	VkBuffer instanceBuffer_ = VK_NULL_HANDLE;
+	std::vector<Slot> slots_;
+
+	GpuImage pyramid_;
+	VkExtent2D pyramidExtent_ = { 0, 0 };
+	uint32_t pyramidLevels_ = 0;
+	VkImageView pyramidLevelViews_[MAX_PYRAMID_LEVELS] = { };
+	// False until the pyramid holds a frame's depth; the early phase can't test against it before.
+	bool pyramidValid_ = false;
+
+	VkSampler sampler_ = VK_NULL_HANDLE;
+	VkDescriptorSetLayout pyramidSetLayout_ = VK_NULL_HANDLE;
+	VkDescriptorSetLayout cullSetLayout_ = VK_NULL_HANDLE;
+	VkDescriptorSetLayout drawSetLayout_ = VK_NULL_HANDLE;
+	VkPipelineLayout pyramidPipelineLayout_ = VK_NULL_HANDLE;
+	VkPipelineLayout cullPipelineLayout_ = VK_NULL_HANDLE;
+	VkPipeline pyramidPipeline_ = VK_NULL_HANDLE;
+	VkPipeline cullPipeline_ = VK_NULL_HANDLE;
+	VkDescriptorPool drawPool_ = VK_NULL_HANDLE;
+	VkDescriptorSet drawSet_ = VK_NULL_HANDLE;
+
+	// Sets that reference the targets live in the targets' pool, which is released with them.
+	UniqueDescriptorPool targetPool_;
+	// Level 0 reduces the slot's depth, every other level the one before it.
+	std::vector<VkImage> depthImages_;
+	std::vector<VkDescriptorSet> depthSets_;
+	VkDescriptorSet levelSets_[MAX_PYRAMID_LEVELS] = { };
+	VkDescriptorSet cullSet_ = VK_NULL_HANDLE;
+
+	Totals totals_[2];
+};
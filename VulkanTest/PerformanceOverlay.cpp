@@ -0,0 +1,518 @@
+#include "PerformanceOverlay.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <stdexcept>
+
+
+// A 5x7 font for the characters from ' ' to '_', which covers upper case letters,
+// digits and punctuation. Every row is one byte, bit 0 is the leftmost column.
+static const uint8_t FONT_FIRST_CHAR = ' ';
+static const uint8_t FONT_LAST_CHAR = '_';
+static const uint8_t fontRows[FONT_LAST_CHAR - FONT_FIRST_CHAR + 1][7] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },  // space
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 },  // !
+	{ 0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00 },  // "
+	{ 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a },  // #
+	{ 0x04, 0x1e, 0x05, 0x0e, 0x14, 0x0f, 0x04 },  // $
+	{ 0x03, 0x13, 0x08, 0x04, 0x02, 0x19, 0x18 },  // %
+	{ 0x06, 0x09, 0x05, 0x02, 0x15, 0x09, 0x16 },  // &
+	{ 0x04, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00 },  // '
+	{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },  // (
+	{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },  // )
+	{ 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00 },  // *
+	{ 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 },  // +
+	{ 0x00, 0x00, 0x00, 0x00, 0x06, 0x04, 0x02 },  // ,
+	{ 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 },  // -
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x06 },  // .
+	{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 },  // /
+	{ 0x0e, 0x11, 0x19, 0x15, 0x13, 0x11, 0x0e },  // 0
+	{ 0x04, 0x06, 0x04, 0x04, 0x04, 0x04, 0x0e },  // 1
+	{ 0x0e, 0x11, 0x10, 0x08, 0x04, 0x02, 0x1f },  // 2
+	{ 0x1f, 0x08, 0x04, 0x08, 0x10, 0x11, 0x0e },  // 3
+	{ 0x08, 0x0c, 0x0a, 0x09, 0x1f, 0x08, 0x08 },  // 4
+	{ 0x1f, 0x01, 0x0f, 0x10, 0x10, 0x11, 0x0e },  // 5
+	{ 0x0c, 0x02, 0x01, 0x0f, 0x11, 0x11, 0x0e },  // 6
+	{ 0x1f, 0x10, 0x08, 0x04, 0x02, 0x02, 0x02 },  // 7
+	{ 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e },  // 8
+	{ 0x0e, 0x11, 0x11, 0x1e, 0x10, 0x08, 0x06 },  // 9
+	{ 0x00, 0x06, 0x06, 0x00, 0x06, 0x06, 0x00 },  // :
+	{ 0x00, 0x06, 0x06, 0x00, 0x06, 0x04, 0x02 },  // ;
+	{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },  // <
+	{ 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 },  // =
+	{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },  // >
+	{ 0x0e, 0x11, 0x10, 0x08, 0x04, 0x00, 0x04 },  // ?
+	{ 0x0e, 0x11, 0x10, 0x16, 0x15, 0x15, 0x0e },  // @
+	{ 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 },  // A
+	{ 0x0f, 0x11, 0x11, 0x0f, 0x11, 0x11, 0x0f },  // B
+	{ 0x0e, 0x11, 0x01, 0x01, 0x01, 0x11, 0x0e },  // C
+	{ 0x07, 0x09, 0x11, 0x11, 0x11, 0x09, 0x07 },  // D
+	{ 0x1f, 0x01, 0x01, 0x0f, 0x01, 0x01, 0x1f },  // E
+	{ 0x1f, 0x01, 0x01, 0x0f, 0x01, 0x01, 0x01 },  // F
+	{ 0x0e, 0x11, 0x01, 0x1d, 0x11, 0x11, 0x1e },  // G
+	{ 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 },  // H
+	{ 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e },  // I
+	{ 0x1c, 0x08, 0x08, 0x08, 0x08, 0x09, 0x06 },  // J
+	{ 0x11, 0x09, 0x05, 0x03, 0x05, 0x09, 0x11 },  // K
+	{ 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x1f },  // L
+	{ 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 },  // M
+	{ 0x11, 0x11, 0x13, 0x15, 0x19, 0x11, 0x11 },  // N
+	{ 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },  // O
+	{ 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x01, 0x01 },  // P
+	{ 0x0e, 0x11, 0x11, 0x11, 0x15, 0x09, 0x16 },  // Q
+	{ 0x0f, 0x11, 0x11, 0x0f, 0x05, 0x09, 0x11 },  // R
+	{ 0x1e, 0x01, 0x01, 0x0e, 0x10, 0x10, 0x0f },  // S
+	{ 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },  // T
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },  // U
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 },  // V
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a },  // W
+	{ 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 },  // X
+	{ 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04 },  // Y
+	{ 0x1f, 0x10, 0x08, 0x04, 0x02, 0x01, 0x1f },  // Z
+	{ 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e },  // [
+	{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 },  // backslash
+	{ 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e },  // ]
+	{ 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00 },  // ^
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f },  // _
+};
+
+// Font pixels are drawn as 2x2 screen pixels.
+static const float FONT_SCALE = 2.0f;
+static const float CHAR_ADVANCE = 6.0f * FONT_SCALE;
+static const float LINE_HEIGHT = 9.0f * FONT_SCALE;
+static const float PANEL_MARGIN = 8.0f;
+static const float PANEL_PADDING = 8.0f;
+static const float GRAPH_BAR_WIDTH = 3.0f;
+static const float GRAPH_HEIGHT = 48.0f;
+static const float PASS_BAR_OFFSET = 20.0f * CHAR_ADVANCE;
+static const float PASS_BAR_WIDTH = 144.0f;
+
+static const uint32_t SOLID_GLYPH[2] = { ~0u, ~0u };
+
+
+static uint32_t Rgba(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+	return r | g << 8 | b << 16 | a << 24;
+}
+
+static const uint32_t PANEL_COLOR = Rgba(0, 0, 0, 160);
+static const uint32_t TEXT_COLOR = Rgba(255, 255, 255, 255);
+static const uint32_t BUDGET_COLOR = Rgba(255, 255, 255, 128);
+static const uint32_t UNDER_BUDGET_COLOR = Rgba(64, 208, 64, 255);
+static const uint32_t OVER_BUDGET_COLOR = Rgba(224, 64, 48, 255);
+static const uint32_t PASS_COLOR = Rgba(64, 160, 224, 255);
+
+static double Megabytes(uint64_t bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+
+
+void PerformanceOverlay::Init(const GpuContext& context, const ShaderCode& vertCode, const ShaderCode& fragCode, VkFormat format, VkImageLayout finalLayout, double budgetMs, int slotCount) {
+	context_ = context;
+	const DeviceDispatch& vk = *context_.dispatch;
+	budgetMs_ = budgetMs;
+	std::fill(frameHistory_, frameHistory_ + HISTORY_SIZE, -1.0);
+	std::fill(gpuHistory_, gpuHistory_ + HISTORY_SIZE, -1.0);
+
+	// Loads what the composite blitted and hands the image on, usually to presenting.
+	VkAttachmentDescription attachment = { };
+	attachment.flags = 0;
+	attachment.format = format;
+	attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachment.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	attachment.finalLayout = finalLayout;
+
+	VkAttachmentReference colorAttachmentRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+	VkSubpassDescription subpass = { };
+	subpass.flags = 0;
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.inputAttachmentCount = 0;
+	subpass.pInputAttachments = nullptr;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorAttachmentRef;
+	subpass.pResolveAttachments = nullptr;
+	subpass.pDepthStencilAttachment = nullptr;
+	subpass.preserveAttachmentCount = 0;
+	subpass.pPreserveAttachments = nullptr;
+
+	VkSubpassDependency dependency = { };
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependency.dependencyFlags = 0;
+
+	VkRenderPassCreateInfo renderPassInfo = { };
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.pNext = nullptr;
+	renderPassInfo.flags = 0;
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &attachment;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = 1;
+	renderPassInfo.pDependencies = &dependency;
+
+	VkResult result = vk.CreateRenderPass(context_.device, &renderPassInfo, nullptr, &renderPass_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create overlay render pass!");
+
+	VkPushConstantRange pushConstantRange = { };
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = 2 * sizeof(float);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = { };
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.pNext = nullptr;
+	pipelineLayoutInfo.flags = 0;
+	pipelineLayoutInfo.setLayoutCount = 0;
+	pipelineLayoutInfo.pSetLayouts = nullptr;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	result = vk.CreatePipelineLayout(context_.device, &pipelineLayoutInfo, nullptr, &pipelineLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create overlay pipeline layout!");
+
+	VkShaderModule vertShaderModule = CreateShaderModule(context_, vertCode);
+	VkShaderModule fragShaderModule = CreateShaderModule(context_, fragCode);
+
+	VkPipelineShaderStageCreateInfo shaderStages[2] = { };
+	for (VkPipelineShaderStageCreateInfo& stage : shaderStages) {
+		stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stage.pNext = nullptr;
+		stage.flags = 0;
+		stage.pName = "main";
+		stage.pSpecializationInfo = nullptr;
+	}
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module = vertShaderModule;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module = fragShaderModule;
+
+	VkVertexInputBindingDescription binding = { 0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
+	VkVertexInputAttributeDescription attributes[4] = {
+		{ 0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, position) },
+		{ 1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, cell) },
+		{ 2, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(Vertex, color) },
+		{ 3, 0, VK_FORMAT_R32G32_UINT, offsetof(Vertex, glyph) }
+	};
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = { };
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.pNext = nullptr;
+	vertexInputInfo.flags = 0;
+	vertexInputInfo.vertexBindingDescriptionCount = 1;
+	vertexInputInfo.pVertexBindingDescriptions = &binding;
+	vertexInputInfo.vertexAttributeDescriptionCount = 4;
+	vertexInputInfo.pVertexAttributeDescriptions = attributes;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = { };
+	inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssemblyInfo.pNext = nullptr;
+	inputAssemblyInfo.flags = 0;
+	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+	// The viewport follows the swap chain, so it is dynamic.
+	VkPipelineViewportStateCreateInfo viewportStateInfo = { };
+	viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportStateInfo.pNext = nullptr;
+	viewportStateInfo.flags = 0;
+	viewportStateInfo.viewportCount = 1;
+	viewportStateInfo.pViewports = nullptr;
+	viewportStateInfo.scissorCount = 1;
+	viewportStateInfo.pScissors = nullptr;
+
+	VkPipelineRasterizationStateCreateInfo rasterizerInfo = { };
+	rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizerInfo.pNext = nullptr;
+	rasterizerInfo.flags = 0;
+	rasterizerInfo.depthClampEnable = VK_FALSE;
+	rasterizerInfo.rasterizerDiscardEnable = VK_FALSE;
+	rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizerInfo.lineWidth = 1.0f;
+	rasterizerInfo.cullMode = VK_CULL_MODE_NONE;
+	rasterizerInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	rasterizerInfo.depthBiasEnable = VK_FALSE;
+	rasterizerInfo.depthBiasConstantFactor = 0.0f;
+	rasterizerInfo.depthBiasClamp = 0.0f;
+	rasterizerInfo.depthBiasSlopeFactor = 0.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisamplingInfo = { };
+	multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisamplingInfo.pNext = nullptr;
+	multisamplingInfo.flags = 0;
+	multisamplingInfo.sampleShadingEnable = VK_FALSE;
+	multisamplingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	multisamplingInfo.minSampleShading = 1.0f;
+	multisamplingInfo.pSampleMask = nullptr;
+	multisamplingInfo.alphaToCoverageEnable = VK_FALSE;
+	multisamplingInfo.alphaToOneEnable = VK_FALSE;
+
+	// The panel behind the text is translucent.
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = { };
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_TRUE;
+	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	VkPipelineColorBlendStateCreateInfo colorBlendingInfo = { };
+	colorBlendingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlendingInfo.pNext = nullptr;
+	colorBlendingInfo.flags = 0;
+	colorBlendingInfo.logicOpEnable = VK_FALSE;
+	colorBlendingInfo.logicOp = VK_LOGIC_OP_COPY;
+	colorBlendingInfo.attachmentCount = 1;
+	colorBlendingInfo.pAttachments = &colorBlendAttachment;
+	colorBlendingInfo.blendConstants[0] = 0.0f;
+	colorBlendingInfo.blendConstants[1] = 0.0f;
+	colorBlendingInfo.blendConstants[2] = 0.0f;
+	colorBlendingInfo.blendConstants[3] = 0.0f;
+
+	VkDynamicState dynamicStates[] = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamicStateInfo = { };
+	dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateInfo.pNext = nullptr;
+	dynamicStateInfo.flags = 0;
+	dynamicStateInfo.dynamicStateCount = 2;
+	dynamicStateInfo.pDynamicStates = dynamicStates;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo = { };
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext = nullptr;
+	pipelineInfo.flags = 0;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+	pipelineInfo.pTessellationState = nullptr;
+	pipelineInfo.pViewportState = &viewportStateInfo;
+	pipelineInfo.pRasterizationState = &rasterizerInfo;
+	pipelineInfo.pMultisampleState = &multisamplingInfo;
+	pipelineInfo.pDepthStencilState = nullptr;
+	pipelineInfo.pColorBlendState = &colorBlendingInfo;
+	pipelineInfo.pDynamicState = &dynamicStateInfo;
+	pipelineInfo.layout = pipelineLayout_;
+	pipelineInfo.renderPass = renderPass_;
+	pipelineInfo.subpass = 0;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	result = vk.CreateGraphicsPipelines(context_.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline_);
+	vk.DestroyShaderModule(context_.device, fragShaderModule, nullptr);
+	vk.DestroyShaderModule(context_.device, vertShaderModule, nullptr);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create overlay pipeline!");
+
+	vertices_ = CreateBuffer(context_, slotCount * MAX_QUADS * 6 * sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+void PerformanceOverlay::Destroy() {
+	const DeviceDispatch& vk = *context_.dispatch;
+
+	DestroyBuffer(context_, vertices_);
+	vk.DestroyPipeline(context_.device, pipeline_, nullptr);
+	vk.DestroyPipelineLayout(context_.device, pipelineLayout_, nullptr);
+	vk.DestroyRenderPass(context_.device, renderPass_, nullptr);
+}
+
+void PerformanceOverlay::CreateTargets(const std::vector<UniqueImageView>& imageViews, VkExtent2D extent) {
+	extent_ = extent;
+	framebuffers_.resize(imageViews.size());
+
+	for (size_t i = 0; i < imageViews.size(); ++i) {
+		VkImageView attachment = imageViews[i].Get();
+
+		VkFramebufferCreateInfo framebufferInfo = { };
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.pNext = nullptr;
+		framebufferInfo.flags = 0;
+		framebufferInfo.renderPass = renderPass_;
+		framebufferInfo.attachmentCount = 1;
+		framebufferInfo.pAttachments = &attachment;
+		framebufferInfo.width = extent.width;
+		framebufferInfo.height = extent.height;
+		framebufferInfo.layers = 1;
+
+		VkFramebuffer framebuffer;
+		VkResult result = context_.dispatch->CreateFramebuffer(context_.device, &framebufferInfo, nullptr, &framebuffer);
+		if (result != VK_SUCCESS) throw std::runtime_error("Failed to create overlay framebuffer!");
+		framebuffers_[i] = UniqueFramebuffer(*context_.deletionQueue, framebuffer);
+	}
+}
+
+void PerformanceOverlay::DestroyTargets() {
+	framebuffers_.clear();
+}
+
+void PerformanceOverlay::AddFrame(const OverlayFrame& frame) {
+	frame_ = frame;
+	frameHistory_[historyIndex_] = frame.frameMs;
+	gpuHistory_[historyIndex_] = frame.gpuValid ? frame.gpuMs : -1.0;
+	historyIndex_ = (historyIndex_ + 1) % HISTORY_SIZE;
+
+	if (!frame.gpuValid) return;
+	const double smoothing = 0.1;
+	for (int i = 0; i < GPU_PASS_COUNT; ++i) smoothedPassMs_[i] += smoothing * (frame.gpu.DurationMs(static_cast<GpuPass>(i)) - smoothedPassMs_[i]);
+	smoothedGpuMs_ += smoothing * (frame.gpuMs - smoothedGpuMs_);
+}
+
+void PerformanceOverlay::Record(VkCommandBuffer commandBuffer, int slot, uint32_t imageIndex) {
+	const DeviceDispatch& vk = *context_.dispatch;
+	this->Build(slot);
+
+	VkRenderPassBeginInfo renderPassInfo = { };
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.pNext = nullptr;
+	renderPassInfo.renderPass = renderPass_;
+	renderPassInfo.framebuffer = framebuffers_[imageIndex].Get();
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = extent_;
+	renderPassInfo.clearValueCount = 0;
+	renderPassInfo.pClearValues = nullptr;
+
+	VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(extent_.width), static_cast<float>(extent_.height), 0.0f, 1.0f };
+	VkRect2D scissor = { { 0, 0 }, extent_ };
+	float pixelToClip[2] = { 2.0f / extent_.width, 2.0f / extent_.height };
+	VkDeviceSize offset = slot * MAX_QUADS * 6 * sizeof(Vertex);
+
+	vk.CmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
+	vk.CmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vk.CmdSetScissor(commandBuffer, 0, 1, &scissor);
+	vk.CmdPushConstants(commandBuffer, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pixelToClip), pixelToClip);
+	vk.CmdBindVertexBuffers(commandBuffer, 0, 1, &vertices_.buffer, &offset);
+	vk.CmdDraw(commandBuffer, quadCount_ * 6, 1, 0, 0);
+	vk.CmdEndRenderPass(commandBuffer);
+}
+
+
+void PerformanceOverlay::Build(int slot) {
+	building_ = static_cast<Vertex*>(vertices_.mapped) + slot * MAX_QUADS * 6;
+	quadCount_ = 0;
+
+	// The panel goes first, so it is drawn behind everything, but its size is only known at the end.
+	const float left = PANEL_MARGIN + PANEL_PADDING;
+	const float width = HISTORY_SIZE * GRAPH_BAR_WIDTH;
+	float y = PANEL_MARGIN + PANEL_PADDING;
+	this->AddRect(0.0f, 0.0f, 0.0f, 0.0f, PANEL_COLOR);
+
+	double frameMs = 0.0;
+	int frameCount = 0;
+	for (double ms : frameHistory_) {
+		if (ms < 0.0) continue;
+		frameMs += ms;
+		++frameCount;
+	}
+	if (frameCount > 0) frameMs /= frameCount;
+
+	this->AddText(left, y, TEXT_COLOR, "FRAME %6.2f MS  %6.1f FPS", frameMs, frameMs > 0.0 ? 1000.0 / frameMs : 0.0);
+	y += LINE_HEIGHT;
+	this->AddText(left, y, TEXT_COLOR, "CPU   %6.2f MS", frame_.cpuMs);
+	y += LINE_HEIGHT;
+	this->AddGraph(left, y, frameHistory_);
+	y += GRAPH_HEIGHT + LINE_HEIGHT / 2;
+
+	this->AddText(left, y, TEXT_COLOR, "GPU   %6.2f MS", smoothedGpuMs_);
+	y += LINE_HEIGHT;
+	this->AddText(left, y, TEXT_COLOR, "RES %ux%u OF %ux%u", frame_.renderExtent.width, frame_.renderExtent.height, frame_.outputExtent.width, frame_.outputExtent.height);
+	y += LINE_HEIGHT;
+	this->AddGraph(left, y, gpuHistory_);
+	y += GRAPH_HEIGHT + LINE_HEIGHT / 2;
+
+	// Bars run to the budget at full width.
+	for (int i = 0; i < GPU_PASS_COUNT; ++i) {
+		double ms = smoothedPassMs_[i];
+		this->AddText(left, y, TEXT_COLOR, "%-9s %6.3f MS", GpuPassName(static_cast<GpuPass>(i)), ms);
+		float barWidth = static_cast<float>(std::min(1.0, ms / budgetMs_)) * PASS_BAR_WIDTH;
+		this->AddRect(left + PASS_BAR_OFFSET, y, std::max(barWidth, 1.0f), 7.0f * FONT_SCALE, PASS_COLOR);
+		y += LINE_HEIGHT;
+	}
+	y += LINE_HEIGHT / 2;
+
+	this->AddText(left, y, TEXT_COLOR, "GPU MEM %6.1f MB PEAK %6.1f", Megabytes(frame_.deviceMemory.currentBytes), Megabytes(frame_.deviceMemory.peakBytes));
+	y += LINE_HEIGHT;
+	this->AddText(left, y, TEXT_COLOR, "CPU MEM PEAK %6.1f MB", Megabytes(frame_.processPeakBytes));
+	y += LINE_HEIGHT;
+	this->AddText(left, y, TEXT_COLOR, "QUEUES GFX %u COMP %u XFER %u", frame_.queueDepths[static_cast<int>(QueueType::Graphics)],
+		frame_.queueDepths[static_cast<int>(QueueType::Compute)], frame_.queueDepths[static_cast<int>(QueueType::Transfer)]);
+	y += LINE_HEIGHT;
+	this->AddText(left, y, TEXT_COLOR, "DELETIONS PENDING %u", frame_.pendingDeletions);
+
+	float bottom = y + 7.0f * FONT_SCALE + PANEL_PADDING;
+	this->SetQuad(0, PANEL_MARGIN, PANEL_MARGIN, width + 2.0f * PANEL_PADDING, bottom - PANEL_MARGIN, PANEL_COLOR, SOLID_GLYPH);
+	building_ = nullptr;
+}
+
+// Quads are two triangles of their own, so the draw needs no index buffer.
+void PerformanceOverlay::SetQuad(uint32_t quad, float x, float y, float width, float height, uint32_t color, const uint32_t glyph[2]) {
+	const float corners[6][2] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.0f, 1.0f }, { 0.0f, 1.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f } };
+
+	Vertex* vertex = building_ + quad * 6;
+	for (int i = 0; i < 6; ++i, ++vertex) {
+		vertex->position[0] = x + corners[i][0] * width;
+		vertex->position[1] = y + corners[i][1] * height;
+		vertex->cell[0] = corners[i][0] * 5.0f;
+		vertex->cell[1] = corners[i][1] * 7.0f;
+		vertex->color = color;
+		vertex->glyph[0] = glyph[0];
+		vertex->glyph[1] = glyph[1];
+	}
+}
+
+void PerformanceOverlay::AddRect(float x, float y, float width, float height, uint32_t color) {
+	if (quadCount_ == MAX_QUADS) return;
+	this->SetQuad(quadCount_++, x, y, width, height, color, SOLID_GLYPH);
+}
+
+void PerformanceOverlay::AddText(float x, float y, uint32_t color, const char* format, ...) {
+	char text[64];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	for (const char* c = text; *c && quadCount_ < MAX_QUADS; ++c, x += CHAR_ADVANCE) {
+		int code = toupper(static_cast<unsigned char>(*c));
+		if (code == ' ') continue;
+		if (code < FONT_FIRST_CHAR || code > FONT_LAST_CHAR) code = '?';
+
+		uint64_t bits = 0;
+		const uint8_t* rows = fontRows[code - FONT_FIRST_CHAR];
+		for (int row = 0; row < 7; ++row) bits |= static_cast<uint64_t>(rows[row]) << (5 * row);
+		uint32_t glyph[2] = { static_cast<uint32_t>(bits), static_cast<uint32_t>(bits >> 32) };
+
+		this->SetQuad(quadCount_++, x, y, 5.0f * FONT_SCALE, 7.0f * FONT_SCALE, color, glyph);
+	}
+}
+
+// One bar per frame, oldest on the left, scaled so the budget line is halfway up.
+void PerformanceOverlay::AddGraph(float x, float y, const double* history) {
+	double maxMs = 2.0 * budgetMs_;
+
+	for (uint32_t i = 0; i < HISTORY_SIZE; ++i) {
+		double ms = history[(historyIndex_ + i) % HISTORY_SIZE];
+		if (ms < 0.0) continue;
+
+		float height = std::max(1.0f, static_cast<float>(std::min(1.0, ms / maxMs)) * GRAPH_HEIGHT);
+		this->AddRect(x + i * GRAPH_BAR_WIDTH, y + GRAPH_HEIGHT - height, GRAPH_BAR_WIDTH - 1.0f, height, ms > budgetMs_ ? OVER_BUDGET_COLOR : UNDER_BUDGET_COLOR);
+	}
+
+	this->AddRect(x, y + GRAPH_HEIGHT / 2, HISTORY_SIZE * GRAPH_BAR_WIDTH, 1.0f, BUDGET_COLOR);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+
+#include "DeletionQueue.h"
+#include "GpuProfiler.h"
+#include "GpuResources.h"
+#include "GpuScheduler.h"
+
+
+// What the overlay shows about one frame.
+struct OverlayFrame {
+	// The time since the previous frame started, and what the previous DrawFrame took.
+	double frameMs = 0.0;
+	double cpuMs = 0.0;
+	// The latest GPU timings, if the frame resolved any.
+	bool gpuValid = false;
+	GpuFrameTimings gpu;
+	double gpuMs = 0.0;
+	VkExtent2D renderExtent = { 0, 0 };
+	VkExtent2D outputExtent = { 0, 0 };
+	DeviceMemoryUsage deviceMemory;
+	uint64_t processPeakBytes = 0;
+	// The submissions each queue has in flight and the objects waiting to be destroyed.
+	uint32_t queueDepths[static_cast<int>(QueueType::Count)] = { };
+	uint32_t pendingDeletions = 0;
+};
+
+// A heads-up display of frame times, GPU pass timings, memory use and queue depths,
+// drawn over the composited image. It is built on the CPU as colored quads, the text
+// included: every glyph quad carries its 5x7 bitmap, which the fragment shader tests,
+// so there is no font texture. Every frame slot builds into its own range of one
+// persistently mapped vertex buffer, and the whole overlay is a single draw in a
+// render pass of its own that loads the image and leaves it ready to present.
+class PerformanceOverlay {
+public:
+	void Init(const GpuContext& context, const ShaderCode& vertCode, const ShaderCode& fragCode, VkFormat format, VkImageLayout finalLayout, double budgetMs, int slotCount);
+	void Destroy();
+
+	// The framebuffers wrap the swap chain's image views, so they are remade with them.
+	void CreateTargets(const std::vector<UniqueImageView>& imageViews, VkExtent2D extent);
+	// Releases the framebuffers to the deletion queue.
+	void DestroyTargets();
+
+	void AddFrame(const OverlayFrame& frame);
+	// Builds the slot's geometry and draws it over the swap chain image, which the composite
+	// left in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL and the render pass leaves in the
+	// final layout given to Init. The slot's previous draw has to be finished.
+	void Record(VkCommandBuffer commandBuffer, int slot, uint32_t imageIndex);
+
+private:
+	static const uint32_t HISTORY_SIZE = 128;
+	static const uint32_t MAX_QUADS = 2048;
+
+	struct Vertex {
+		float position[2];
+		float cell[2];
+		uint32_t color;
+		uint32_t glyph[2];
+	};
+
+private:
+	void Build(int slot);
+	void SetQuad(uint32_t quad, float x, float y, float width, float height, uint32_t color, const uint32_t glyph[2]);
+	void AddRect(float x, float y, float width, float height, uint32_t color);
+	void AddText(float x, float y, uint32_t color, const char* format, ...);
+	void AddGraph(float x, float y, const double* history);
+
+private:
+	GpuContext context_;
+	double budgetMs_ = 0.0;
+	VkExtent2D extent_ = { 0, 0 };
+	std::vector<UniqueFramebuffer> framebuffers_;
+
+	VkRenderPass renderPass_ = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+	VkPipeline pipeline_ = VK_NULL_HANDLE;
+	GpuBuffer vertices_;
+	// The slot being built and its quads so far.
+	Vertex* building_ = nullptr;
+	uint32_t quadCount_ = 0;
+
+	OverlayFrame frame_;
+	// Ring buffers of frame and GPU times, oldest at historyIndex_; negative where unknown.
+	double frameHistory_[HISTORY_SIZE];
+	double gpuHistory_[HISTORY_SIZE];
+	uint32_t historyIndex_ = 0;
+	// Pass times change every frame, so the text shows them smoothed.
+	double smoothedPassMs_[GPU_PASS_COUNT] = { };
+	double smoothedGpuMs_ = 0.0;
+};
@@ -0,0 +1,320 @@
+#include "PostProcessChain.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+struct DownsampleParams {
+	int32_t srcSize[2];
+	int32_t dstSize[2];
+	float threshold;
+};
+
+struct BlurParams {
+	int32_t size[2];
+	int32_t direction[2];
+};
+
+struct TonemapParams {
+	int32_t size[2];
+	float bloomUvScale[2];
+	float exposure;
+	float bloomStrength;
+};
+
+static const float BLOOM_THRESHOLD = 0.8f;
+static const float BLOOM_STRENGTH = 0.3f;
+static const float EXPOSURE = 1.0f;
+
+
+static uint32_t GroupCount(uint32_t size, uint32_t groupSize) {
+	return (size + groupSize - 1) / groupSize;
+}
+
+
+void PostProcessChain::Init(const GpuContext& context, const ShaderCode& downsampleCode, const ShaderCode& blurCode, const ShaderCode& tonemapCode, int slotCount) {
+	context_ = context;
+	slots_.resize(slotCount);
+	const DeviceDispatch& vk = *context_.dispatch;
+
+	VkSamplerCreateInfo samplerInfo = { };
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.pNext = nullptr;
+	samplerInfo.flags = 0;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1.0f;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = 0.0f;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+
+	VkResult result = vk.CreateSampler(context_.device, &samplerInfo, nullptr, &sampler_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create post-process sampler!");
+
+	VkDescriptorSetLayoutBinding bindings[3] = { };
+	for (uint32_t i = 0; i < 3; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = i < 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = { };
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = nullptr;
+	layoutInfo.flags = 0;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings;
+
+	result = vk.CreateDescriptorSetLayout(context_.device, &layoutInfo, nullptr, &imagePairLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create post-process descriptor set layout!");
+
+	layoutInfo.bindingCount = 3;
+	result = vk.CreateDescriptorSetLayout(context_.device, &layoutInfo, nullptr, &tonemapLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create tonemap descriptor set layout!");
+
+	VkPushConstantRange pushConstantRange = { };
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = static_cast<uint32_t>(std::max(sizeof(DownsampleParams), sizeof(BlurParams)));
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = { };
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.pNext = nullptr;
+	pipelineLayoutInfo.flags = 0;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &imagePairLayout_;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	result = vk.CreatePipelineLayout(context_.device, &pipelineLayoutInfo, nullptr, &imagePairPipelineLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create post-process pipeline layout!");
+
+	pushConstantRange.size = sizeof(TonemapParams);
+	pipelineLayoutInfo.pSetLayouts = &tonemapLayout_;
+	result = vk.CreatePipelineLayout(context_.device, &pipelineLayoutInfo, nullptr, &tonemapPipelineLayout_);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create tonemap pipeline layout!");
+
+	downsamplePipeline_ = CreateComputePipeline(context_, imagePairPipelineLayout_, downsampleCode);
+	blurPipeline_ = CreateComputePipeline(context_, imagePairPipelineLayout_, blurCode);
+	tonemapPipeline_ = CreateComputePipeline(context_, tonemapPipelineLayout_, tonemapCode);
+}
+
+void PostProcessChain::Destroy() {
+	const DeviceDispatch& vk = *context_.dispatch;
+
+	this->DestroyTargets();
+	vk.DestroyPipeline(context_.device, tonemapPipeline_, nullptr);
+	vk.DestroyPipeline(context_.device, blurPipeline_, nullptr);
+	vk.DestroyPipeline(context_.device, downsamplePipeline_, nullptr);
+	vk.DestroyPipelineLayout(context_.device, tonemapPipelineLayout_, nullptr);
+	vk.DestroyPipelineLayout(context_.device, imagePairPipelineLayout_, nullptr);
+	vk.DestroyDescriptorSetLayout(context_.device, tonemapLayout_, nullptr);
+	vk.DestroyDescriptorSetLayout(context_.device, imagePairLayout_, nullptr);
+	vk.DestroySampler(context_.device, sampler_, nullptr);
+}
+
+void PostProcessChain::CreateTargets(VkExtent2D maxExtent, const GpuImage* sceneColors) {
+	maxExtent_ = maxExtent;
+	uint32_t slotCount = static_cast<uint32_t>(slots_.size());
+
+	VkDescriptorPoolSize poolSizes[2] = { };
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[0].descriptorCount = slotCount * (2 * PYRAMID_LEVELS + 6);
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[1].descriptorCount = slotCount;
+
+	VkDescriptorPoolCreateInfo poolInfo = { };
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.pNext = nullptr;
+	poolInfo.flags = 0;
+	poolInfo.maxSets = slotCount * SETS_PER_SLOT;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+
+	VkDescriptorPool pool;
+	VkResult result = context_.dispatch->CreateDescriptorPool(context_.device, &poolInfo, nullptr, &pool);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to create post-process descriptor pool!");
+	descriptorPool_ = UniqueDescriptorPool(*context_.deletionQueue, pool);
+	const VkImageUsageFlags intermediateUsage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+	for (size_t i = 0; i < slots_.size(); ++i) {
+		Slot& slot = slots_[i];
+		slot.sceneView = sceneColors[i].view;
+		slot.pyramid = CreateImage2D(context_, VK_FORMAT_R16G16B16A16_SFLOAT, LevelExtent(maxExtent, 0), PYRAMID_LEVELS, intermediateUsage);
+		for (uint32_t level = 0; level < PYRAMID_LEVELS; ++level) slot.pyramidLevelViews[level] = CreateImageView(context_, slot.pyramid.image, slot.pyramid.format, level, 1);
+		slot.blurTemp = CreateImage2D(context_, VK_FORMAT_R16G16B16A16_SFLOAT, LevelExtent(maxExtent, PYRAMID_LEVELS - 1), 1, intermediateUsage);
+		slot.output = CreateImage2D(context_, OUTPUT_FORMAT, maxExtent, 1, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+		for (uint32_t level = 0; level < PYRAMID_LEVELS; ++level) {
+			slot.downsampleSets[level] = this->AllocateSet(imagePairLayout_);
+			this->WriteStorageImages(slot.downsampleSets[level], level == 0 ? slot.sceneView : slot.pyramidLevelViews[level - 1], slot.pyramidLevelViews[level]);
+		}
+
+		VkImageView bloomView = slot.pyramidLevelViews[PYRAMID_LEVELS - 1];
+		slot.blurSets[0] = this->AllocateSet(imagePairLayout_);
+		this->WriteStorageImages(slot.blurSets[0], bloomView, slot.blurTemp.view);
+		slot.blurSets[1] = this->AllocateSet(imagePairLayout_);
+		this->WriteStorageImages(slot.blurSets[1], slot.blurTemp.view, bloomView);
+
+		slot.tonemapSet = this->AllocateSet(tonemapLayout_);
+		this->WriteStorageImages(slot.tonemapSet, slot.sceneView, slot.output.view);
+
+		VkDescriptorImageInfo bloomInfo = { };
+		bloomInfo.sampler = sampler_;
+		bloomInfo.imageView = bloomView;
+		bloomInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet write = { };
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.pNext = nullptr;
+		write.dstSet = slot.tonemapSet;
+		write.dstBinding = 2;
+		write.dstArrayElement = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &bloomInfo;
+		write.pBufferInfo = nullptr;
+		write.pTexelBufferView = nullptr;
+		context_.dispatch->UpdateDescriptorSets(context_.device, 1, &write, 0, nullptr);
+	}
+}
+
+void PostProcessChain::DestroyTargets() {
+	DeletionQueue& deletionQueue = *context_.deletionQueue;
+
+	for (Slot& slot : slots_) {
+		for (VkImageView& view : slot.pyramidLevelViews) {
+			if (view != VK_NULL_HANDLE) deletionQueue.DestroyImageView(view);
+			view = VK_NULL_HANDLE;
+		}
+		deletionQueue.DestroyImage(slot.pyramid);
+		deletionQueue.DestroyImage(slot.blurTemp);
+		deletionQueue.DestroyImage(slot.output);
+	}
+
+	// Freeing the pool frees the sets.
+	descriptorPool_.Reset();
+}
+
+void PostProcessChain::Record(VkCommandBuffer commandBuffer, int slotIndex, VkExtent2D renderExtent) {
+	const DeviceDispatch& vk = *context_.dispatch;
+	const Slot& slot = slots_[slotIndex];
+
+	// The intermediates are completely rewritten every frame, so their old contents can be discarded.
+	VkImageMemoryBarrier imageBarriers[3] = { };
+	const VkImage images[3] = { slot.pyramid.image, slot.blurTemp.image, slot.output.image };
+	for (int i = 0; i < 3; ++i) {
+		imageBarriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarriers[i].pNext = nullptr;
+		imageBarriers[i].srcAccessMask = 0;
+		imageBarriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageBarriers[i].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarriers[i].image = images[i];
+		imageBarriers[i].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+	}
+	vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 3, imageBarriers);
+
+	VkMemoryBarrier passBarrier = { };
+	passBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	passBarrier.pNext = nullptr;
+	passBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	passBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	auto waitForPreviousPass = [&]() {
+		vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &passBarrier, 0, nullptr, 0, nullptr);
+	};
+
+	vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, downsamplePipeline_);
+	for (uint32_t level = 0; level < PYRAMID_LEVELS; ++level) {
+		VkExtent2D src = level == 0 ? renderExtent : LevelExtent(renderExtent, level - 1);
+		VkExtent2D dst = LevelExtent(renderExtent, level);
+		DownsampleParams params = { { static_cast<int32_t>(src.width), static_cast<int32_t>(src.height) }, { static_cast<int32_t>(dst.width), static_cast<int32_t>(dst.height) }, level == 0 ? BLOOM_THRESHOLD : 0.0f };
+
+		vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, imagePairPipelineLayout_, 0, 1, &slot.downsampleSets[level], 0, nullptr);
+		vk.CmdPushConstants(commandBuffer, imagePairPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+		vk.CmdDispatch(commandBuffer, GroupCount(dst.width, 8), GroupCount(dst.height, 8), 1);
+		waitForPreviousPass();
+	}
+
+	VkExtent2D bloom = LevelExtent(renderExtent, PYRAMID_LEVELS - 1);
+	vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, blurPipeline_);
+	for (int pass = 0; pass < 2; ++pass) {
+		BlurParams params = { { static_cast<int32_t>(bloom.width), static_cast<int32_t>(bloom.height) }, { pass == 0 ? 1 : 0, pass == 0 ? 0 : 1 } };
+		uint32_t lineLength = pass == 0 ? bloom.width : bloom.height;
+		uint32_t lineCount = pass == 0 ? bloom.height : bloom.width;
+
+		vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, imagePairPipelineLayout_, 0, 1, &slot.blurSets[pass], 0, nullptr);
+		vk.CmdPushConstants(commandBuffer, imagePairPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+		vk.CmdDispatch(commandBuffer, GroupCount(lineLength, 64), lineCount, 1);
+		waitForPreviousPass();
+	}
+
+	// The bloom texture is sampled with normalized coordinates, which span its full, maximum size.
+	VkExtent2D maxBloom = LevelExtent(maxExtent_, PYRAMID_LEVELS - 1);
+	float bloomUvScale[2] = { static_cast<float>(bloom.width) / maxBloom.width, static_cast<float>(bloom.height) / maxBloom.height };
+
+	TonemapParams params = { { static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height) }, { bloomUvScale[0], bloomUvScale[1] }, EXPOSURE, BLOOM_STRENGTH };
+	vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tonemapPipeline_);
+	vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tonemapPipelineLayout_, 0, 1, &slot.tonemapSet, 0, nullptr);
+	vk.CmdPushConstants(commandBuffer, tonemapPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+	vk.CmdDispatch(commandBuffer, GroupCount(renderExtent.width, 8), GroupCount(renderExtent.height, 8), 1);
+}
+
+
+VkDescriptorSet PostProcessChain::AllocateSet(VkDescriptorSetLayout layout) {
+	VkDescriptorSetAllocateInfo allocateInfo = { };
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.pNext = nullptr;
+	allocateInfo.descriptorPool = descriptorPool_.Get();
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet set;
+	VkResult result = context_.dispatch->AllocateDescriptorSets(context_.device, &allocateInfo, &set);
+	if (result != VK_SUCCESS) throw std::runtime_error("Failed to allocate post-process descriptor set!");
+
+	return set;
+}
+
+void PostProcessChain::WriteStorageImages(VkDescriptorSet set, VkImageView src, VkImageView dst) {
+	VkDescriptorImageInfo imageInfos[2] = { };
+	imageInfos[0].sampler = VK_NULL_HANDLE;
+	imageInfos[0].imageView = src;
+	imageInfos[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	imageInfos[1].sampler = VK_NULL_HANDLE;
+	imageInfos[1].imageView = dst;
+	imageInfos[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkWriteDescriptorSet writes[2] = { };
+	for (uint32_t i = 0; i < 2; ++i) {
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].pNext = nullptr;
+		writes[i].dstSet = set;
+		writes[i].dstBinding = i;
+		writes[i].dstArrayElement = 0;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[i].pImageInfo = &imageInfos[i];
+		writes[i].pBufferInfo = nullptr;
+		writes[i].pTexelBufferView = nullptr;
+	}
+
+	context_.dispatch->UpdateDescriptorSets(context_.device, 2, writes, 0, nullptr);
+}
+
+VkExtent2D PostProcessChain::LevelExtent(VkExtent2D extent, uint32_t level) {
+	return { std::max(1u, extent.width >> (level + 1)), std::max(1u, extent.height >> (level + 1)) };
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "DeletionQueue.h"
+#include "GpuResources.h"
+
+
+// Compute post-processing of the HDR scene color: a bloom pyramid built by
+// repeated downsampling, a separable blur of its smallest level, and a tonemap
+// that combines scene and bloom into an 8 bit output image. It is recorded on
+// the async compute queue, so every frame slot has its own intermediates.
+class PostProcessChain {
+public:
+	static const VkFormat OUTPUT_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+	void Init(const GpuContext& context, const ShaderCode& downsampleCode, const ShaderCode& blurCode, const ShaderCode& tonemapCode, int slotCount);
+	void Destroy();
+
+	// The targets are allocated at the maximum extent the scene can be rendered at.
+	void CreateTargets(VkExtent2D maxExtent, const GpuImage* sceneColors);
+	// Releases the targets to the deletion queue, so frames in flight can finish with them.
+	void DestroyTargets();
+
+	// Processes the renderExtent corner of the slot's scene color into the same corner of
+	// its output. The scene color has to be in VK_IMAGE_LAYOUT_GENERAL; the output is left in it.
+	void Record(VkCommandBuffer commandBuffer, int slot, VkExtent2D renderExtent);
+
+	const GpuImage& Output(int slot) const { return slots_[slot].output; }
+
+private:
+	static const uint32_t PYRAMID_LEVELS = 4;
+	static const uint32_t SETS_PER_SLOT = PYRAMID_LEVELS + 3;
+
+	struct Slot {
+		VkImageView sceneView = VK_NULL_HANDLE;
+		GpuImage pyramid;
+		VkImageView pyramidLevelViews[PYRAMID_LEVELS] = { };
+		GpuImage blurTemp;
+		GpuImage output;
+		VkDescriptorSet downsampleSets[PYRAMID_LEVELS] = { };
+		VkDescriptorSet blurSets[2] = { };
+		VkDescriptorSet tonemapSet = VK_NULL_HANDLE;
+	};
+
+private:
+	VkDescriptorSet AllocateSet(VkDescriptorSetLayout layout);
+	void WriteStorageImages(VkDescriptorSet set, VkImageView src, VkImageView dst);
+	static VkExtent2D LevelExtent(VkExtent2D extent, uint32_t level);
+
+private:
+	GpuContext context_;
+	VkExtent2D maxExtent_ = { 0, 0 };
+	std::vector<Slot> slots_;
+
+	VkSampler sampler_ = VK_NULL_HANDLE;
+	VkDescriptorSetLayout imagePairLayout_ = VK_NULL_HANDLE;
+	VkDescriptorSetLayout tonemapLayout_ = VK_NULL_HANDLE;
+	VkPipelineLayout imagePairPipelineLayout_ = VK_NULL_HANDLE;
+	VkPipelineLayout tonemapPipelineLayout_ = VK_NULL_HANDLE;
+	VkPipeline downsamplePipeline_ = VK_NULL_HANDLE;
+	VkPipeline blurPipeline_ = VK_NULL_HANDLE;
+	VkPipeline tonemapPipeline_ = VK_NULL_HANDLE;
+	// Every set of targets gets its own pool, so released sets stay valid until the GPU is done with them.
+	UniqueDescriptorPool descriptorPool_;
+};
@@ -0,0 +1,197 @@
+#include "SceneStore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+
+static Affine ToAffine(const Transform& t) {
+	float x = t.rotation[0], y = t.rotation[1], z = t.rotation[2], w = t.rotation[3];
+	float s = t.scale;
+
+	Affine m;
+	m.rows[0][0] = s * (1.0f - 2.0f * (y * y + z * z));
+	m.rows[0][1] = s * (2.0f * (x * y - z * w));
+	m.rows[0][2] = s * (2.0f * (x * z + y * w));
+	m.rows[0][3] = t.position[0];
+	m.rows[1][0] = s * (2.0f * (x * y + z * w));
+	m.rows[1][1] = s * (1.0f - 2.0f * (x * x + z * z));
+	m.rows[1][2] = s * (2.0f * (y * z - x * w));
+	m.rows[1][3] = t.position[1];
+	m.rows[2][0] = s * (2.0f * (x * z - y * w));
+	m.rows[2][1] = s * (2.0f * (y * z + x * w));
+	m.rows[2][2] = s * (1.0f - 2.0f * (x * x + y * y));
+	m.rows[2][3] = t.position[2];
+	return m;
+}
+
+static Affine Multiply(const Affine& a, const Affine& b) {
+	Affine m;
+	for (int r = 0; r < 3; ++r) {
+		for (int c = 0; c < 4; ++c) {
+			m.rows[r][c] = a.rows[r][0] * b.rows[0][c] + a.rows[r][1] * b.rows[1][c] + a.rows[r][2] * b.rows[2][c];
+		}
+		m.rows[r][3] += a.rows[r][3];
+	}
+	return m;
+}
+
+static BoundingSphere TransformSphere(const Affine& m, const BoundingSphere& sphere) {
+	BoundingSphere result;
+	for (int r = 0; r < 3; ++r) {
+		result.center[r] = m.rows[r][0] * sphere.center[0] + m.rows[r][1] * sphere.center[1] + m.rows[r][2] * sphere.center[2] + m.rows[r][3];
+	}
+	// Scales are uniform, so the length of any column is the scale.
+	float scale = std::sqrt(m.rows[0][0] * m.rows[0][0] + m.rows[1][0] * m.rows[1][0] + m.rows[2][0] * m.rows[2][0]);
+	result.radius = sphere.radius * scale;
+	return result;
+}
+
+
+Entity SceneStore::Create(Entity parent, const Transform& local, const BoundingSphere& localBounds, RenderHandle render) {
+	Entity entity = static_cast<Entity>(slotOfEntity_.size());
+	uint32_t slot = static_cast<uint32_t>(local_.size());
+	uint32_t parentSlot = parent != INVALID_ENTITY ? slotOfEntity_[parent] : INVALID_ENTITY;
+
+	local_.push_back(local);
+	localBounds_.push_back(localBounds);
+	render_.push_back(render);
+	world_.push_back(Affine());
+	worldBounds_.push_back(BoundingSphere());
+	parent_.push_back(parentSlot);
+	depth_.push_back(parentSlot != INVALID_ENTITY ? depth_[parentSlot] + 1 : 0);
+	entityOfSlot_.push_back(entity);
+	localDirty_.push_back(1);
+	worldChanged_.push_back(0);
+	slotOfEntity_.push_back(slot);
+
+	sorted_ = false;
+	return entity;
+}
+
+void SceneStore::Clear() {
+	local_.clear();
+	localBounds_.clear();
+	render_.clear();
+	world_.clear();
+	worldBounds_.clear();
+	parent_.clear();
+	depth_.clear();
+	entityOfSlot_.clear();
+	localDirty_.clear();
+	worldChanged_.clear();
+	slotOfEntity_.clear();
+	levels_.clear();
+	sorted_ = true;
+}
+
+void SceneStore::SetLocal(Entity entity, const Transform& local) {
+	uint32_t slot = slotOfEntity_[entity];
+	local_[slot] = local;
+	localDirty_[slot] = 1;
+}
+
+void SceneStore::Update(JobSystem& jobs) {
+	if (!sorted_) this->SortByDepth();
+
+	// A level only reads the world transforms of the one before, so its chunks are independent.
+	for (size_t level = 0; level + 1 < levels_.size(); ++level) {
+		uint32_t begin = levels_[level];
+		uint32_t count = levels_[level + 1] - begin;
+
+		if (count <= CHUNK_SIZE) {
+			this->UpdateRange(begin, begin + count);
+			continue;
+		}
+
+		JobCounter counter;
+		jobs.ParallelFor(count, CHUNK_SIZE, [this, begin](uint32_t first, uint32_t last) { this->UpdateRange(begin + first, begin + last); }, counter);
+		jobs.Wait(counter);
+	}
+}
+
+void SceneStore::CollectChanges(std::vector<SceneRange>& ranges) const {
+	ranges.clear();
+
+	uint32_t count = this->Size();
+	const uint8_t* changed = worldChanged_.data();
+	uint32_t i = 0;
+
+	while (i < count) {
+		// Most instances don't move, so unchanged stretches are skipped 8 at a time.
+		if (i + 8 <= count) {
+			uint64_t word;
+			memcpy(&word, changed + i, sizeof(word));
+			if (word == 0) {
+				i += 8;
+				continue;
+			}
+		}
+		if (!changed[i]) {
+			++i;
+			continue;
+		}
+
+		uint32_t first = i;
+		while (i < count && changed[i]) ++i;
+
+		if (!ranges.empty() && first - (ranges.back().first + ranges.back().count) <= MERGE_GAP) {
+			ranges.back().count = i - ranges.back().first;
+		} else {
+			ranges.push_back({ first, i - first });
+		}
+	}
+}
+
+
+void SceneStore::SortByDepth() {
+	uint32_t count = this->Size();
+	uint32_t maxDepth = 0;
+	for (uint32_t depth : depth_) maxDepth = std::max(maxDepth, depth);
+
+	// Counting sort, stable so siblings keep their creation order.
+	levels_.assign(maxDepth + 2, 0);
+	for (uint32_t depth : depth_) ++levels_[depth + 1];
+	for (uint32_t d = 1; d < levels_.size(); ++d) levels_[d] += levels_[d - 1];
+
+	std::vector<uint32_t> newSlot(count);
+	std::vector<uint32_t> next(levels_.begin(), levels_.end() - 1);
+	for (uint32_t slot = 0; slot < count; ++slot) newSlot[slot] = next[depth_[slot]]++;
+
+	auto permute = [&](auto& column) {
+		typename std::remove_reference<decltype(column)>::type sorted(column.size());
+		for (uint32_t slot = 0; slot < count; ++slot) sorted[newSlot[slot]] = column[slot];
+		column.swap(sorted);
+	};
+	permute(local_);
+	permute(localBounds_);
+	permute(render_);
+	permute(parent_);
+	permute(depth_);
+	permute(entityOfSlot_);
+
+	for (uint32_t& parent : parent_) if (parent != INVALID_ENTITY) parent = newSlot[parent];
+	for (uint32_t slot = 0; slot < count; ++slot) slotOfEntity_[entityOfSlot_[slot]] = slot;
+
+	// Instances moved, so all of them have to be computed and uploaded again.
+	world_.assign(count, Affine());
+	worldBounds_.assign(count, BoundingSphere());
+	localDirty_.assign(count, 1);
+	worldChanged_.assign(count, 0);
+	sorted_ = true;
+}
+
+void SceneStore::UpdateRange(uint32_t first, uint32_t last) {
+	for (uint32_t i = first; i < last; ++i) {
+		uint32_t parent = parent_[i];
+		bool dirty = localDirty_[i] || (parent != INVALID_ENTITY && worldChanged_[parent]);
+		worldChanged_[i] = dirty;
+		if (!dirty) continue;
+
+		localDirty_[i] = 0;
+		Affine local = ToAffine(local_[i]);
+		world_[i] = parent != INVALID_ENTITY ? Multiply(world_[parent], local) : local;
+		worldBounds_[i] = TransformSphere(world_[i], localBounds_[i]);
+	}
+}
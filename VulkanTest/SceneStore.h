@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "JobSystem.h"
+
+
+typedef uint32_t Entity;
+const Entity INVALID_ENTITY = 0xFFFFFFFF;
+
+// Position, rotation quaternion (x, y, z, w) and uniform scale relative to the parent.
+struct Transform {
+	float position[3];
+	float rotation[4];
+	float scale;
+};
+
+// The upper three rows of an affine 4x4 matrix, row-major.
+struct Affine {
+	float rows[3][4];
+};
+
+struct BoundingSphere {
+	float center[3];
+	float radius;
+};
+
+struct RenderHandle {
+	uint32_t mesh;
+	uint32_t material;
+};
+
+// Consecutive instances [first, first + count).
+struct SceneRange {
+	uint32_t first;
+	uint32_t count;
+};
+
+
+// Data-oriented scene storage. Every component lives in its own tightly packed
+// array (structure of arrays), indexed by instance rather than by entity: the
+// instances are kept sorted by hierarchy depth, so each level is a contiguous
+// range whose parents all come before it. The world transforms are updated one
+// level at a time, each level split into parallel chunks, and only for entities
+// whose local transform or an ancestor changed. The same flags tell the renderer
+// which instances to upload.
+class SceneStore {
+public:
+	// A parent has to exist before its children.
+	Entity Create(Entity parent, const Transform& local, const BoundingSphere& localBounds, RenderHandle render);
+	void Clear();
+
+	void SetLocal(Entity entity, const Transform& local);
+	const Transform& Local(Entity entity) const { return local_[slotOfEntity_[entity]]; }
+
+	void Update(JobSystem& jobs);
+	// Ranges of instances whose world data changed in the last Update. Runs separated
+	// by small gaps are merged, since a few extra bytes cost less than a copy region.
+	void CollectChanges(std::vector<SceneRange>& ranges) const;
+
+	uint32_t Size() const { return static_cast<uint32_t>(local_.size()); }
+	uint32_t InstanceOf(Entity entity) const { return slotOfEntity_[entity]; }
+
+	const Affine* WorldTransforms() const { return world_.data(); }
+	const BoundingSphere* WorldBounds() const { return worldBounds_.data(); }
+	const RenderHandle* RenderHandles() const { return render_.data(); }
+
+private:
+	static const uint32_t CHUNK_SIZE = 1024;
+	static const uint32_t MERGE_GAP = 16;
+
+private:
+	void SortByDepth();
+	void UpdateRange(uint32_t first, uint32_t last);
+
+private:
+	// Per instance.
+	std::vector<Transform> local_;
+	std::vector<BoundingSphere> localBounds_;
+	std::vector<RenderHandle> render_;
+	std::vector<Affine> world_;
+	std::vector<BoundingSphere> worldBounds_;
+	std::vector<uint32_t> parent_;
+	std::vector<uint32_t> depth_;
+	std::vector<Entity> entityOfSlot_;
+	// Bytes rather than bits, so chunks updated in parallel never share a word.
+	std::vector<uint8_t> localDirty_;
+	std::vector<uint8_t> worldChanged_;
+
+	std::vector<uint32_t> slotOfEntity_;
+	// Instances [levels_[d], levels_[d + 1]) are at depth d.
+	std::vector<uint32_t> levels_;
+	bool sorted_ = true;
+};
@@ -0,0 +1,237 @@
+#include "ShaderBundle.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// The file layout; keep in sync with Shaders/build_bundle.py. The header is followed
+// by the module, binding and pipeline tables, the names, and then each module's
+// SPIR-V 16 byte aligned. All offsets are from the start of the file.
+static const char BUNDLE_MAGIC[4] = { 'V', 'K', 'S', 'B' };
+static const uint32_t BUNDLE_VERSION = 1;
+static const uint32_t MAX_PIPELINE_STAGES = 4;
+
+struct BundleHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t moduleCount;
+	uint32_t bindingCount;
+	uint32_t pipelineCount;
+	uint32_t modulesOffset;
+	uint32_t bindingsOffset;
+	uint32_t pipelinesOffset;
+	uint32_t stringsOffset;
+	uint32_t stringsSize;
+};
+
+struct BundleModule {
+	uint32_t nameOffset;
+	uint32_t stage;
+	uint32_t codeOffset;
+	uint32_t codeSize;
+	uint32_t firstBinding;
+	uint32_t bindingCount;
+	uint32_t pushConstantSize;
+	uint32_t localSize[3];
+};
+
+struct BundlePipeline {
+	uint32_t nameOffset;
+	uint32_t bindPoint;
+	uint32_t stageCount;
+	uint32_t modules[MAX_PIPELINE_STAGES];
+};
+
+// The binding table is used in place.
+static_assert(sizeof(ShaderBinding) == 4 * sizeof(uint32_t), "ShaderBinding has to match the bundle's binding entries");
+
+
+static const char* MapFile(const std::string& filename, size_t& size) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open shader bundle!");
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(BundleHeader))) {
+		CloseHandle(file);
+		throw std::runtime_error("Invalid shader bundle!");
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+
+	// The view keeps the mapping alive, so neither handle is needed once it exists.
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping) throw std::runtime_error("Failed to map shader bundle!");
+	const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!data) throw std::runtime_error("Failed to map shader bundle!");
+#else
+	int file = open(filename.c_str(), O_RDONLY);
+	if (file < 0) throw std::runtime_error("Failed to open shader bundle!");
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(sizeof(BundleHeader))) {
+		close(file);
+		throw std::runtime_error("Invalid shader bundle!");
+	}
+	size = static_cast<size_t>(fileStat.st_size);
+
+	void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (data == MAP_FAILED) throw std::runtime_error("Failed to map shader bundle!");
+#endif
+
+	return static_cast<const char*>(data);
+}
+
+static void UnmapFile(const char* data, size_t size) {
+#ifdef _WIN32
+	(void)size;
+	UnmapViewOfFile(data);
+#else
+	munmap(const_cast<char*>(data), size);
+#endif
+}
+
+static bool InFile(uint64_t offset, uint64_t count, uint64_t elementSize, size_t fileSize) {
+	return offset <= fileSize && count * elementSize <= fileSize - offset;
+}
+
+static VkShaderStageFlagBits ShaderStageBit(uint32_t stage) {
+	switch (stage) {
+	case VK_SHADER_STAGE_VERTEX_BIT:
+	case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
+	case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
+	case VK_SHADER_STAGE_GEOMETRY_BIT:
+	case VK_SHADER_STAGE_FRAGMENT_BIT:
+	case VK_SHADER_STAGE_COMPUTE_BIT:
+		return static_cast<VkShaderStageFlagBits>(stage);
+	default:
+		throw std::runtime_error("Invalid shader bundle!");
+	}
+}
+
+
+void ShaderBundle::Open(const std::string& filename) {
+	this->Close();
+	data_ = MapFile(filename, size_);
+
+	try {
+		this->Parse();
+	} catch (...) {
+		this->Close();
+		throw;
+	}
+}
+
+void ShaderBundle::Close() {
+	if (data_) UnmapFile(data_, size_);
+	data_ = nullptr;
+	size_ = 0;
+	modules_.clear();
+	pipelines_.clear();
+}
+
+const ShaderModuleInfo& ShaderBundle::Module(const char* name) const {
+	auto it = std::lower_bound(modules_.begin(), modules_.end(), name, [](const ShaderModuleInfo& module, const char* key) {
+		return strcmp(module.name, key) < 0;
+	});
+	if (it == modules_.end() || strcmp(it->name, name) != 0) throw std::runtime_error(std::string("Shader bundle has no module ") + name + "!");
+
+	return *it;
+}
+
+const ShaderPipelineInfo& ShaderBundle::Pipeline(const char* name) const {
+	auto it = std::lower_bound(pipelines_.begin(), pipelines_.end(), name, [](const ShaderPipelineInfo& pipeline, const char* key) {
+		return strcmp(pipeline.name, key) < 0;
+	});
+	if (it == pipelines_.end() || strcmp(it->name, name) != 0) throw std::runtime_error(std::string("Shader bundle has no pipeline ") + name + "!");
+
+	return *it;
+}
+
+const ShaderModuleInfo& ShaderBundle::PipelineStage(const char* pipeline, VkShaderStageFlagBits stage) const {
+	for (const ShaderModuleInfo* module : this->Pipeline(pipeline).stages) {
+		if (module->stage == stage) return *module;
+	}
+
+	throw std::runtime_error(std::string("Shader pipeline ") + pipeline + " has no such stage!");
+}
+
+void ShaderBundle::Parse() {
+	BundleHeader header;
+	memcpy(&header, data_, sizeof(header));
+	if (memcmp(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0) throw std::runtime_error("Invalid shader bundle!");
+	if (header.version != BUNDLE_VERSION) throw std::runtime_error("Shader bundle version mismatch, rebuild it with Shaders/build_bundle.py!");
+
+	// The tables are 4 byte aligned in a page aligned mapping, so they are read in place.
+	if (!InFile(header.modulesOffset, header.moduleCount, sizeof(BundleModule), size_) ||
+		!InFile(header.bindingsOffset, header.bindingCount, sizeof(ShaderBinding), size_) ||
+		!InFile(header.pipelinesOffset, header.pipelineCount, sizeof(BundlePipeline), size_) ||
+		!InFile(header.stringsOffset, header.stringsSize, 1, size_) ||
+		header.stringsSize == 0 || data_[header.stringsOffset + header.stringsSize - 1] != '\0' ||
+		(header.modulesOffset | header.bindingsOffset | header.pipelinesOffset) % sizeof(uint32_t) != 0) {
+		throw std::runtime_error("Invalid shader bundle!");
+	}
+
+	const BundleModule* modules = reinterpret_cast<const BundleModule*>(data_ + header.modulesOffset);
+	const ShaderBinding* bindings = reinterpret_cast<const ShaderBinding*>(data_ + header.bindingsOffset);
+	const BundlePipeline* pipelines = reinterpret_cast<const BundlePipeline*>(data_ + header.pipelinesOffset);
+	const char* strings = data_ + header.stringsOffset;
+
+	modules_.resize(header.moduleCount);
+	for (uint32_t i = 0; i < header.moduleCount; ++i) {
+		const BundleModule& entry = modules[i];
+		if (entry.nameOffset >= header.stringsSize ||
+			!InFile(entry.codeOffset, entry.codeSize, 1, size_) ||
+			entry.codeOffset % sizeof(uint32_t) != 0 || entry.codeSize == 0 || entry.codeSize % sizeof(uint32_t) != 0 ||
+			static_cast<uint64_t>(entry.firstBinding) + entry.bindingCount > header.bindingCount) {
+			throw std::runtime_error("Invalid shader bundle!");
+		}
+
+		ShaderModuleInfo& module = modules_[i];
+		module.name = strings + entry.nameOffset;
+		module.stage = ShaderStageBit(entry.stage);
+		module.code.words = reinterpret_cast<const uint32_t*>(data_ + entry.codeOffset);
+		module.code.size = entry.codeSize;
+		module.bindings = bindings + entry.firstBinding;
+		module.bindingCount = entry.bindingCount;
+		module.pushConstantSize = entry.pushConstantSize;
+		for (int axis = 0; axis < 3; ++axis) module.localSize[axis] = entry.localSize[axis];
+
+		// Lookups binary search by name.
+		if (i > 0 && strcmp(modules_[i - 1].name, module.name) >= 0) throw std::runtime_error("Invalid shader bundle!");
+	}
+
+	pipelines_.resize(header.pipelineCount);
+	for (uint32_t i = 0; i < header.pipelineCount; ++i) {
+		const BundlePipeline& entry = pipelines[i];
+		if (entry.nameOffset >= header.stringsSize || entry.stageCount == 0 || entry.stageCount > MAX_PIPELINE_STAGES ||
+			(entry.bindPoint != VK_PIPELINE_BIND_POINT_GRAPHICS && entry.bindPoint != VK_PIPELINE_BIND_POINT_COMPUTE)) {
+			throw std::runtime_error("Invalid shader bundle!");
+		}
+
+		ShaderPipelineInfo& pipeline = pipelines_[i];
+		pipeline.name = strings + entry.nameOffset;
+		pipeline.bindPoint = static_cast<VkPipelineBindPoint>(entry.bindPoint);
+		pipeline.stages.clear();
+		for (uint32_t stage = 0; stage < entry.stageCount; ++stage) {
+			if (entry.modules[stage] >= header.moduleCount) throw std::runtime_error("Invalid shader bundle!");
+			pipeline.stages.push_back(&modules_[entry.modules[stage]]);
+		}
+
+		if (i > 0 && strcmp(pipelines_[i - 1].name, pipeline.name) >= 0) throw std::runtime_error("Invalid shader bundle!");
+	}
+}
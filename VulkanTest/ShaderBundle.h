@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "GpuResources.h"
+
+
+struct ShaderBinding {
+	uint32_t set;
+	uint32_t binding;
+	VkDescriptorType type;
+	uint32_t count;
+};
+
+// A module's SPIR-V and what build_bundle.py reflected from it. Everything points
+// into the mapped bundle and stays valid until the bundle is closed.
+struct ShaderModuleInfo {
+	const char* name;
+	VkShaderStageFlagBits stage;
+	ShaderCode code;
+	const ShaderBinding* bindings;
+	uint32_t bindingCount;
+	uint32_t pushConstantSize;
+	uint32_t localSize[3];
+};
+
+// Which modules a pipeline is built from.
+struct ShaderPipelineInfo {
+	const char* name;
+	VkPipelineBindPoint bindPoint;
+	std::vector<const ShaderModuleInfo*> stages;
+};
+
+// Every compiled shader in one file, written by Shaders/build_bundle.py. The file
+// is memory mapped and its SPIR-V handed to vkCreateShaderModule in place, so
+// loading the shaders is a single open with no reads or copies.
+class ShaderBundle {
+public:
+	ShaderBundle() = default;
+	ShaderBundle(const ShaderBundle&) = delete;
+	ShaderBundle& operator=(const ShaderBundle&) = delete;
+	~ShaderBundle() { this->Close(); }
+
+	void Open(const std::string& filename);
+	void Close();
+
+	// Both throw if the bundle has no such entry.
+	const ShaderModuleInfo& Module(const char* name) const;
+	const ShaderPipelineInfo& Pipeline(const char* name) const;
+	// The pipeline's module for stage.
+	const ShaderModuleInfo& PipelineStage(const char* pipeline, VkShaderStageFlagBits stage) const;
+
+	const std::vector<ShaderModuleInfo>& Modules() const { return modules_; }
+	const std::vector<ShaderPipelineInfo>& Pipelines() const { return pipelines_; }
+	size_t Size() const { return size_; }
+
+private:
+	void Parse();
+
+private:
+	const char* data_ = nullptr;
+	size_t size_ = 0;
+	// Both sorted by name, as the file stores them.
+	std::vector<ShaderModuleInfo> modules_;
+	std::vector<ShaderPipelineInfo> pipelines_;
+};
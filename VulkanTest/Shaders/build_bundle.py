@@ -0,0 +1,347 @@
+#!/usr/bin/env python3
+"""Compiles the shaders in this directory into CompiledShaders/shaders.bundle.
+
+The bundle holds every module's SPIR-V, what the module declares (stage, descriptor
+bindings, push constant size, workgroup size) and which modules each pipeline is
+built from, in the layout ShaderBundle.cpp maps. Needs glslangValidator from the
+Vulkan SDK, found through VULKAN_SDK or on the PATH. Runs on every build, but only
+recompiles when a shader or this script changed.
+"""
+
+import argparse
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+SHADER_DIR = os.path.dirname(os.path.abspath(__file__))
+OUTPUT = os.path.join(SHADER_DIR, os.pardir, "CompiledShaders", "shaders.bundle")
+
+# Module name and source.
+MODULES = [
+    ("vert", "shader.vert"),
+    ("frag", "shader.frag"),
+    ("downsample", "downsample.comp"),
+    ("blur", "blur.comp"),
+    ("tonemap", "tonemap.comp"),
+    ("depthpyramid", "depthpyramid.comp"),
+    ("cull", "cull.comp"),
+    ("lightbin", "lightbin.comp"),
+    ("overlay_vert", "overlay.vert"),
+    ("overlay_frag", "overlay.frag"),
+]
+
+PIPELINE_BIND_POINT_GRAPHICS = 0
+PIPELINE_BIND_POINT_COMPUTE = 1
+
+# Pipeline name, bind point and the modules of its stages.
+PIPELINES = [
+    ("scene", PIPELINE_BIND_POINT_GRAPHICS, ["vert", "frag"]),
+    ("downsample", PIPELINE_BIND_POINT_COMPUTE, ["downsample"]),
+    ("blur", PIPELINE_BIND_POINT_COMPUTE, ["blur"]),
+    ("tonemap", PIPELINE_BIND_POINT_COMPUTE, ["tonemap"]),
+    ("depthpyramid", PIPELINE_BIND_POINT_COMPUTE, ["depthpyramid"]),
+    ("cull", PIPELINE_BIND_POINT_COMPUTE, ["cull"]),
+    ("lightbin", PIPELINE_BIND_POINT_COMPUTE, ["lightbin"]),
+    ("overlay", PIPELINE_BIND_POINT_GRAPHICS, ["overlay_vert", "overlay_frag"]),
+]
+
+# Keep in sync with ShaderBundle.cpp.
+BUNDLE_MAGIC = b"VKSB"
+BUNDLE_VERSION = 1
+MAX_PIPELINE_STAGES = 4
+CODE_ALIGNMENT = 16
+HEADER_FORMAT = "<4s9I"
+MODULE_FORMAT = "<10I"
+BINDING_FORMAT = "<4I"
+PIPELINE_FORMAT = "<%dI" % (3 + MAX_PIPELINE_STAGES)
+
+# VkDescriptorType
+SAMPLER = 0
+COMBINED_IMAGE_SAMPLER = 1
+SAMPLED_IMAGE = 2
+STORAGE_IMAGE = 3
+UNIFORM_TEXEL_BUFFER = 4
+STORAGE_TEXEL_BUFFER = 5
+UNIFORM_BUFFER = 6
+STORAGE_BUFFER = 7
+INPUT_ATTACHMENT = 10
+
+# SPIR-V execution model to VkShaderStageFlagBits.
+STAGES = {0: 0x1, 1: 0x2, 2: 0x4, 3: 0x8, 4: 0x10, 5: 0x20}
+
+SPIRV_MAGIC = 0x07230203
+OP_ENTRY_POINT = 15
+OP_EXECUTION_MODE = 16
+OP_TYPE_BOOL = 20
+OP_TYPE_INT = 21
+OP_TYPE_FLOAT = 22
+OP_TYPE_VECTOR = 23
+OP_TYPE_MATRIX = 24
+OP_TYPE_IMAGE = 25
+OP_TYPE_SAMPLER = 26
+OP_TYPE_SAMPLED_IMAGE = 27
+OP_TYPE_ARRAY = 28
+OP_TYPE_RUNTIME_ARRAY = 29
+OP_TYPE_STRUCT = 30
+OP_TYPE_POINTER = 32
+OP_CONSTANT = 43
+OP_VARIABLE = 59
+OP_DECORATE = 71
+OP_MEMBER_DECORATE = 72
+
+DECORATION_BLOCK = 2
+DECORATION_BUFFER_BLOCK = 3
+DECORATION_ARRAY_STRIDE = 6
+DECORATION_MATRIX_STRIDE = 7
+DECORATION_BINDING = 33
+DECORATION_DESCRIPTOR_SET = 34
+DECORATION_OFFSET = 35
+
+STORAGE_UNIFORM_CONSTANT = 0
+STORAGE_UNIFORM = 2
+STORAGE_PUSH_CONSTANT = 9
+STORAGE_STORAGE_BUFFER = 12
+
+EXECUTION_MODE_LOCAL_SIZE = 17
+DIM_BUFFER = 5
+DIM_SUBPASS_DATA = 6
+
+
+class Module:
+    def __init__(self, name, stage, code, bindings, push_constant_size, local_size):
+        self.name = name
+        self.stage = stage
+        self.code = code
+        self.bindings = bindings
+        self.push_constant_size = push_constant_size
+        self.local_size = local_size
+
+
+def find_compiler():
+    executable = "glslangValidator.exe" if os.name == "nt" else "glslangValidator"
+    sdk = os.environ.get("VULKAN_SDK")
+    if sdk:
+        for bin_dir in ("Bin", "bin"):
+            path = os.path.join(sdk, bin_dir, executable)
+            if os.path.isfile(path):
+                return path
+    path = shutil.which(executable)
+    if not path:
+        sys.exit("build_bundle.py: glslangValidator not found, set VULKAN_SDK or add it to the PATH")
+    return path
+
+
+def compile_module(compiler, source, work_dir):
+    output = os.path.join(work_dir, os.path.basename(source) + ".spv")
+    result = subprocess.run([compiler, "-V", "-o", output, source], stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    if result.returncode != 0:
+        sys.exit("build_bundle.py: failed to compile %s\n%s" % (source, result.stdout))
+    with open(output, "rb") as file:
+        return file.read()
+
+
+def reflect(name, code):
+    """Reads the stage, descriptor bindings, push constant size and workgroup size from SPIR-V."""
+    if len(code) % 4 != 0 or len(code) < 20:
+        sys.exit("build_bundle.py: %s is not SPIR-V" % name)
+    words = struct.unpack("<%dI" % (len(code) // 4), code)
+    if words[0] != SPIRV_MAGIC:
+        sys.exit("build_bundle.py: %s is not little endian SPIR-V" % name)
+
+    stage = None
+    local_size = [0, 0, 0]
+    types = {}
+    constants = {}
+    decorations = {}
+    member_decorations = {}
+    variables = []
+
+    position = 5
+    while position < len(words):
+        count = words[position] >> 16
+        opcode = words[position] & 0xFFFF
+        if count == 0:
+            sys.exit("build_bundle.py: %s has a malformed instruction" % name)
+        operands = words[position + 1:position + count]
+        position += count
+
+        if opcode == OP_ENTRY_POINT and stage is None:
+            stage = STAGES.get(operands[0])
+        elif opcode == OP_EXECUTION_MODE and operands[1] == EXECUTION_MODE_LOCAL_SIZE:
+            local_size = list(operands[2:5])
+        elif OP_TYPE_BOOL <= opcode <= OP_TYPE_POINTER:
+            types[operands[0]] = (opcode, operands[1:])
+        elif opcode == OP_CONSTANT:
+            constants[operands[1]] = operands[2]
+        elif opcode == OP_VARIABLE:
+            variables.append((operands[0], operands[1], operands[2]))
+        elif opcode == OP_DECORATE:
+            decorations.setdefault(operands[0], {})[operands[1]] = operands[2] if len(operands) > 2 else True
+        elif opcode == OP_MEMBER_DECORATE:
+            member_decorations.setdefault((operands[0], operands[1]), {})[operands[2]] = operands[3] if len(operands) > 3 else True
+
+    if stage is None:
+        sys.exit("build_bundle.py: %s has no supported entry point" % name)
+
+    def type_size(type_id, matrix_stride=None):
+        opcode, operands = types[type_id]
+        if opcode in (OP_TYPE_INT, OP_TYPE_FLOAT):
+            return operands[0] // 8
+        if opcode == OP_TYPE_BOOL:
+            return 4
+        if opcode == OP_TYPE_VECTOR:
+            return type_size(operands[0]) * operands[1]
+        if opcode == OP_TYPE_MATRIX:
+            return (matrix_stride or type_size(operands[0])) * operands[1]
+        if opcode == OP_TYPE_ARRAY:
+            stride = decorations.get(type_id, {}).get(DECORATION_ARRAY_STRIDE, type_size(operands[0]))
+            return stride * constants[operands[1]]
+        if opcode == OP_TYPE_RUNTIME_ARRAY:
+            return 0
+        if opcode == OP_TYPE_STRUCT:
+            size = 0
+            for member, member_type in enumerate(operands):
+                member_decoration = member_decorations.get((type_id, member), {})
+                offset = member_decoration.get(DECORATION_OFFSET, 0)
+                size = max(size, offset + type_size(member_type, member_decoration.get(DECORATION_MATRIX_STRIDE)))
+            return size
+        sys.exit("build_bundle.py: %s has a push constant or buffer member of unsupported type" % name)
+
+    def descriptor(type_id, storage_class):
+        count = 1
+        opcode, operands = types[type_id]
+        while opcode in (OP_TYPE_ARRAY, OP_TYPE_RUNTIME_ARRAY):
+            # Runtime arrays of descriptors are sized by the pipeline layout; record them as one.
+            if opcode == OP_TYPE_ARRAY:
+                count *= constants[operands[1]]
+            type_id = operands[0]
+            opcode, operands = types[type_id]
+
+        if storage_class == STORAGE_STORAGE_BUFFER:
+            return STORAGE_BUFFER, count
+        if storage_class == STORAGE_UNIFORM:
+            if DECORATION_BUFFER_BLOCK in decorations.get(type_id, {}):
+                return STORAGE_BUFFER, count
+            return UNIFORM_BUFFER, count
+        if opcode == OP_TYPE_SAMPLER:
+            return SAMPLER, count
+        if opcode == OP_TYPE_SAMPLED_IMAGE:
+            return COMBINED_IMAGE_SAMPLER, count
+        if opcode == OP_TYPE_IMAGE:
+            dim, sampled = operands[1], operands[5]
+            if dim == DIM_SUBPASS_DATA:
+                return INPUT_ATTACHMENT, count
+            if dim == DIM_BUFFER:
+                return (UNIFORM_TEXEL_BUFFER if sampled == 1 else STORAGE_TEXEL_BUFFER), count
+            return (SAMPLED_IMAGE if sampled == 1 else STORAGE_IMAGE), count
+        sys.exit("build_bundle.py: %s has a resource of unsupported type" % name)
+
+    bindings = []
+    push_constant_size = 0
+    for pointer_type, variable, storage_class in variables:
+        pointee = types[pointer_type][1][1]
+        if storage_class == STORAGE_PUSH_CONSTANT:
+            push_constant_size = max(push_constant_size, type_size(pointee))
+        elif storage_class in (STORAGE_UNIFORM_CONSTANT, STORAGE_UNIFORM, STORAGE_STORAGE_BUFFER):
+            decoration = decorations.get(variable, {})
+            if DECORATION_BINDING not in decoration:
+                continue
+            descriptor_type, count = descriptor(pointee, storage_class)
+            bindings.append((decoration.get(DECORATION_DESCRIPTOR_SET, 0), decoration[DECORATION_BINDING], descriptor_type, count))
+
+    return Module(name, stage, code, sorted(bindings), push_constant_size, local_size)
+
+
+def align(size, alignment):
+    return (size + alignment - 1) // alignment * alignment
+
+
+def write_bundle(modules, pipelines, path):
+    modules = sorted(modules, key=lambda module: module.name.encode())
+    pipelines = sorted(pipelines, key=lambda pipeline: pipeline[0].encode())
+    module_index = {module.name: index for index, module in enumerate(modules)}
+
+    strings = bytearray()
+    string_offsets = {}
+    for name in [module.name for module in modules] + [pipeline[0] for pipeline in pipelines]:
+        if name not in string_offsets:
+            string_offsets[name] = len(strings)
+            strings += name.encode() + b"\0"
+
+    binding_count = sum(len(module.bindings) for module in modules)
+    modules_offset = struct.calcsize(HEADER_FORMAT)
+    bindings_offset = modules_offset + len(modules) * struct.calcsize(MODULE_FORMAT)
+    pipelines_offset = bindings_offset + binding_count * struct.calcsize(BINDING_FORMAT)
+    strings_offset = pipelines_offset + len(pipelines) * struct.calcsize(PIPELINE_FORMAT)
+    code_offset = align(strings_offset + len(strings), CODE_ALIGNMENT)
+
+    header = struct.pack(HEADER_FORMAT, BUNDLE_MAGIC, BUNDLE_VERSION, len(modules), binding_count, len(pipelines), modules_offset, bindings_offset, pipelines_offset, strings_offset, len(strings))
+
+    module_table = bytearray()
+    binding_table = bytearray()
+    code = bytearray()
+    first_binding = 0
+    for module in modules:
+        offset = code_offset + len(code)
+        module_table += struct.pack(MODULE_FORMAT, string_offsets[module.name], module.stage, offset, len(module.code), first_binding, len(module.bindings), module.push_constant_size, *module.local_size)
+        for binding in module.bindings:
+            binding_table += struct.pack(BINDING_FORMAT, *binding)
+        first_binding += len(module.bindings)
+        code += module.code
+        code += b"\0" * (align(len(code), CODE_ALIGNMENT) - len(code))
+
+    pipeline_table = bytearray()
+    for name, bind_point, stages in pipelines:
+        if not 0 < len(stages) <= MAX_PIPELINE_STAGES:
+            sys.exit("build_bundle.py: pipeline %s has %d stages" % (name, len(stages)))
+        indices = [module_index[stage] for stage in stages]
+        indices += [0xFFFFFFFF] * (MAX_PIPELINE_STAGES - len(indices))
+        pipeline_table += struct.pack(PIPELINE_FORMAT, string_offsets[name], bind_point, len(stages), *indices)
+
+    data = header + module_table + binding_table + pipeline_table + strings
+    data += b"\0" * (code_offset - len(data))
+    data += code
+
+    # Written next to the old bundle and then swapped in, so a failed build never leaves half a file.
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    temporary = path + ".tmp"
+    with open(temporary, "wb") as file:
+        file.write(data)
+    os.replace(temporary, path)
+    return len(data)
+
+
+def up_to_date(path):
+    if not os.path.isfile(path):
+        return False
+    bundle_time = os.path.getmtime(path)
+    inputs = [os.path.abspath(__file__)] + [os.path.join(SHADER_DIR, source) for _, source in MODULES]
+    return all(os.path.getmtime(source) <= bundle_time for source in inputs)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compiles the shaders into one bundle.")
+    parser.add_argument("output", nargs="?", default=OUTPUT, help="where to write the bundle")
+    parser.add_argument("--force", action="store_true", help="rebuild even if the bundle is up to date")
+    args = parser.parse_args()
+
+    output = os.path.normpath(args.output)
+    if not args.force and up_to_date(output):
+        print("Shader bundle is up to date")
+        return
+
+    compiler = find_compiler()
+    modules = []
+    with tempfile.TemporaryDirectory() as work_dir:
+        for name, source in MODULES:
+            modules.append(reflect(name, compile_module(compiler, os.path.join(SHADER_DIR, source), work_dir)))
+
+    size = write_bundle(modules, PIPELINES, output)
+    print("Wrote %s: %d modules, %d pipelines, %d bytes" % (output, len(modules), len(PIPELINES), size))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,2 +0,0 @@
-%VULKAN_SDK%/Bin/glslangValidator.exe -V -o "./CompiledShaders/vert.spv" "Shaders/shader.vert"
-%VULKAN_SDK%/Bin/glslangValidator.exe -V -o "./CompiledShaders/frag.spv" "Shaders/shader.frag"
\ No newline at end of file
@@ -0,0 +1,20 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Every quad carries a 5x7 bitmap, one bit per cell, row by row from the top left.
+// Text quads carry their glyph; solid quads have every bit set.
+
+layout(location = 0) in vec2 fragCell;
+layout(location = 1) flat in vec4 fragColor;
+layout(location = 2) flat in uvec2 fragGlyph;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	uvec2 cell = min(uvec2(fragCell), uvec2(4u, 6u));
+	uint bit = cell.y * 5u + cell.x;
+	uint word = bit < 32u ? fragGlyph.x : fragGlyph.y;
+	if (((word >> (bit & 31u)) & 1u) == 0u) discard;
+
+	outColor = fragColor;
+}
@@ -0,0 +1,24 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// The performance overlay's quads, positioned in pixels from the top left corner.
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inCell;
+layout(location = 2) in vec4 inColor;
+layout(location = 3) in uvec2 inGlyph;
+
+layout(push_constant) uniform OverlayParams {
+	vec2 pixelToClip;
+} params;
+
+layout(location = 0) out vec2 fragCell;
+layout(location = 1) flat out vec4 fragColor;
+layout(location = 2) flat out uvec2 fragGlyph;
+
+void main() {
+	gl_Position = vec4(inPosition * params.pixelToClip - 1.0, 0.0, 1.0);
+	fragCell = inCell;
+	fragColor = inColor;
+	fragGlyph = inGlyph;
+}
@@ -1,9 +1,60 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// A fixed sun plus the point lights of the fragment's cluster, which lightbin.comp
+// filled this frame. Only those lights are looped over, however many there are.
+// A cluster keeps MAX_LIGHTS_PER_CLUSTER of them; past that, lights are missing from
+// it but not from its neighbours, so its bounds show.
+
+// Keep in sync with lightbin.comp and ClusteredLighting.h.
+const uvec3 CLUSTERS = uvec3(16, 16, 32);
+const uint CLUSTER_COUNT = CLUSTERS.x * CLUSTERS.y * CLUSTERS.z;
+const uint MAX_LIGHTS_PER_CLUSTER = 512;
+
+struct Light {
+	vec4 positionRadius;
+	vec4 color;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer Lights {
+	Light lights[];
+};
+
+layout(std430, set = 2, binding = 1) readonly buffer Clusters {
+	uint clusterCounts[CLUSTER_COUNT];
+	uint clusterLights[];
+};
+
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 fragNormal;
+layout(location = 2) in vec3 fragWorld;
+layout(location = 3) in vec3 clusterCoord;
+
 layout(location = 0) out vec4 outColor;
 
+const vec3 lightDirection = vec3(0.48, -0.64, 0.6);
+
 void main() {
-	outColor = vec4(fragColor, 1.0);
+	vec3 normal = normalize(fragNormal);
+	vec3 lighting = vec3(0.35 + 0.65 * max(dot(normal, lightDirection), 0.0));
+
+	uvec3 coord = min(uvec3(clamp(clusterCoord, 0.0, 1.0) * vec3(CLUSTERS)), CLUSTERS - 1u);
+	uint cluster = (coord.z * CLUSTERS.y + coord.y) * CLUSTERS.x + coord.x;
+	uint count = clusterCounts[cluster];
+
+	for (uint i = 0; i < count; ++i) {
+		Light light = lights[clusterLights[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+		vec3 toLight = light.positionRadius.xyz - fragWorld;
+		float distanceSquared = dot(toLight, toLight);
+		float radiusSquared = light.positionRadius.w * light.positionRadius.w;
+		if (distanceSquared >= radiusSquared) continue;
+
+		// Falls off smoothly to nothing at the radius, so the bounds of clusters that kept
+		// all their lights never show.
+		float falloff = 1.0 - distanceSquared / radiusSquared;
+		float diffuse = max(dot(normal, toLight * inversesqrt(max(distanceSquared, 1e-8))), 0.0);
+		lighting += light.color.rgb * (falloff * falloff * diffuse);
+	}
+
+	outColor = vec4(fragColor * lighting, 1.0);
 }
@@ -5,21 +5,65 @@ out gl_PerVertex {
 	vec4 gl_Position;
 };
 
+struct Instance {
+	vec4 world[3];
+	vec4 bounds;
+	uvec4 render;
+};
+
+// Quantized meshes store the normal as two octahedral encoded components.
+layout(constant_id = 0) const bool OCTAHEDRAL_NORMALS = false;
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+	Instance instances[];
+};
+
+// The instances that passed the culling phase being drawn, from listOffset on.
+layout(std430, set = 1, binding = 0) readonly buffer DrawLists {
+	uint drawList[];
+};
+
+// Quantized positions are relative to the mesh bounds. The orthographic camera
+// maps world space to clip space as world * cameraScale + cameraOffset.
+layout(push_constant) uniform DrawParams {
+	vec4 positionOffset;
+	vec4 positionScale;
+	vec4 cameraScale;
+	vec4 cameraOffset;
+	uint listOffset;
+} params;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec4 inColor;
+
+// The fragment shader lights in world space. clusterCoord is the position in the
+// cluster grid's [0, 1] range: clip space x and y remapped, and depth.
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragNormal;
+layout(location = 2) out vec3 fragWorld;
+layout(location = 3) out vec3 clusterCoord;
 
-vec2 positions[3] = vec2[](
-	vec2(0.0, -0.5),
-	vec2(0.5, 0.5),
-	vec2(-0.5, 0.5)
-);
+vec2 SignNotZero(vec2 v) {
+	return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
 
-vec3 colors[3] = vec3[](
-	vec3(1.0, 0.0, 0.0),
-	vec3(0.0, 1.0, 0.0),
-	vec3(0.0, 0.0, 1.0)
-);
+vec3 DecodeOctahedral(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * SignNotZero(n.xy);
+	return normalize(n);
+}
 
 void main() {
-	gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-	fragColor = colors[gl_VertexIndex];
+	Instance instance = instances[drawList[params.listOffset + gl_InstanceIndex]];
+	vec4 position = vec4(params.positionOffset.xyz + inPosition * params.positionScale.xyz, 1.0);
+	vec3 normal = OCTAHEDRAL_NORMALS ? DecodeOctahedral(inNormal.xy) : inNormal;
+	normal = normalize(vec3(dot(instance.world[0].xyz, normal), dot(instance.world[1].xyz, normal), dot(instance.world[2].xyz, normal)));
+
+	vec3 world = vec3(dot(instance.world[0], position), dot(instance.world[1], position), dot(instance.world[2], position));
+	gl_Position = vec4(world * params.cameraScale.xyz + params.cameraOffset.xyz, 1.0);
+	fragColor = inColor.rgb;
+	fragNormal = normal;
+	fragWorld = world;
+	clusterCoord = vec3(gl_Position.xy * 0.5 + 0.5, gl_Position.z);
 }
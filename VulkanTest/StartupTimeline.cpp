@@ -0,0 +1,52 @@
+#include "StartupTimeline.h"
+
+#include <algorithm>
+#include <cstdio>
+
+
+void StartupTimeline::Start() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	entries_.clear();
+	start_ = std::chrono::high_resolution_clock::now();
+}
+
+void StartupTimeline::Measure(const char* name, const std::function<void()>& step) {
+	double beginMs = this->ElapsedMs();
+	step();
+	double endMs = this->ElapsedMs();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	entries_.push_back({ name, beginMs, endMs, std::this_thread::get_id() });
+}
+
+void StartupTimeline::Mark(const char* name) {
+	double nowMs = this->ElapsedMs();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	entries_.push_back({ name, nowMs, nowMs, std::this_thread::get_id() });
+}
+
+double StartupTimeline::ElapsedMs() const {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_).count();
+}
+
+void StartupTimeline::Print(double targetMs) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	std::vector<Entry> entries = entries_;
+	std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.beginMs < b.beginMs; });
+
+	std::vector<std::thread::id> threads;
+	double totalMs = 0.0;
+
+	puts("Startup timeline (ms):");
+	for (const auto& entry : entries) {
+		auto it = std::find(threads.begin(), threads.end(), entry.thread);
+		if (it == threads.end()) it = threads.insert(threads.end(), entry.thread);
+
+		printf("\t%8.2f - %8.2f  %7.2f  [thread %d] %s\n", entry.beginMs, entry.endMs, entry.endMs - entry.beginMs, static_cast<int>(it - threads.begin()), entry.name.c_str());
+		totalMs = std::max(totalMs, entry.endMs);
+	}
+
+	printf("Time to first frame: %.2f ms (target %.2f ms)%s\n", totalMs, targetMs, totalMs > targetMs ? " -> Over budget!" : "");
+}
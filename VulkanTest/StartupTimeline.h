@@ -0,0 +1,33 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Records how long each startup step takes and on which thread it ran, so the
+// time to first frame can be broken down after the first present.
+class StartupTimeline {
+public:
+	void Start();
+	void Measure(const char* name, const std::function<void()>& step);
+	void Mark(const char* name);
+	double ElapsedMs() const;
+	void Print(double targetMs) const;
+
+private:
+	struct Entry {
+		std::string name;
+		double beginMs;
+		double endMs;
+		std::thread::id thread;
+	};
+
+private:
+	std::chrono::high_resolution_clock::time_point start_;
+	std::vector<Entry> entries_;
+	mutable std::mutex mutex_;
+};
@@ -0,0 +1,19 @@
+#include "VulkanDispatch.h"
+
+#include <stdexcept>
+#include <string>
+
+
+void InstanceDispatch::Load(VkInstance instance) {
+#define X(name) name = reinterpret_cast<PFN_vk##name>(vkGetInstanceProcAddr(instance, "vk" #name));
+	VULKAN_INSTANCE_FUNCTIONS(X)
+#undef X
+}
+
+void DeviceDispatch::Load(VkDevice device) {
+#define X(name) \
+	name = reinterpret_cast<PFN_vk##name>(vkGetDeviceProcAddr(device, "vk" #name)); \
+	if (!name) throw std::runtime_error(std::string("Failed to load device function vk" #name "!"));
+	VULKAN_DEVICE_FUNCTIONS(X)
+#undef X
+}
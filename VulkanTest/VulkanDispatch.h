@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vulkan\vulkan.h>
+
+
+// Each list expands X(Name) for the entry point vkName. The dispatch structs below
+// generate a PFN_vkName member per entry, so calls made through them go straight
+// to the driver instead of through the loader's trampolines.
+
+#define VULKAN_INSTANCE_FUNCTIONS(X) \
+	X(CreateDebugReportCallbackEXT) \
+	X(DestroyDebugReportCallbackEXT)
+
+#define VULKAN_DEVICE_FUNCTIONS(X) \
+	X(DestroyDevice) \
+	X(GetDeviceQueue) \
+	X(DeviceWaitIdle) \
+	X(QueueSubmit) \
+	X(QueueWaitIdle) \
+	X(AllocateMemory) \
+	X(FreeMemory) \
+	X(MapMemory) \
+	X(UnmapMemory) \
+	X(FlushMappedMemoryRanges) \
+	X(InvalidateMappedMemoryRanges) \
+	X(BindBufferMemory) \
+	X(BindImageMemory) \
+	X(GetBufferMemoryRequirements) \
+	X(GetImageMemoryRequirements) \
+	X(CreateFence) \
+	X(DestroyFence) \
+	X(ResetFences) \
+	X(GetFenceStatus) \
+	X(WaitForFences) \
+	X(CreateSemaphore) \
+	X(DestroySemaphore) \
+	X(CreateQueryPool) \
+	X(DestroyQueryPool) \
+	X(GetQueryPoolResults) \
+	X(CreateBuffer) \
+	X(DestroyBuffer) \
+	X(CreateImage) \
+	X(DestroyImage) \
+	X(CreateImageView) \
+	X(DestroyImageView) \
+	X(CreateShaderModule) \
+	X(DestroyShaderModule) \
+	X(CreateGraphicsPipelines) \
+	X(CreateComputePipelines) \
+	X(DestroyPipeline) \
+	X(CreatePipelineLayout) \
+	X(DestroyPipelineLayout) \
+	X(CreateSampler) \
+	X(DestroySampler) \
+	X(CreateDescriptorSetLayout) \
+	X(DestroyDescriptorSetLayout) \
+	X(CreateDescriptorPool) \
+	X(DestroyDescriptorPool) \
+	X(ResetDescriptorPool) \
+	X(AllocateDescriptorSets) \
+	X(UpdateDescriptorSets) \
+	X(CreateFramebuffer) \
+	X(DestroyFramebuffer) \
+	X(CreateRenderPass) \
+	X(DestroyRenderPass) \
+	X(CreateCommandPool) \
+	X(DestroyCommandPool) \
+	X(ResetCommandPool) \
+	X(AllocateCommandBuffers) \
+	X(FreeCommandBuffers) \
+	X(BeginCommandBuffer) \
+	X(EndCommandBuffer) \
+	X(ResetCommandBuffer) \
+	X(CmdBindPipeline) \
+	X(CmdSetViewport) \
+	X(CmdSetScissor) \
+	X(CmdBindDescriptorSets) \
+	X(CmdBindIndexBuffer) \
+	X(CmdBindVertexBuffers) \
+	X(CmdDraw) \
+	X(CmdDrawIndexed) \
+	X(CmdDrawIndirect) \
+	X(CmdDrawIndexedIndirect) \
+	X(CmdDispatch) \
+	X(CmdDispatchIndirect) \
+	X(CmdCopyBuffer) \
+	X(CmdCopyImage) \
+	X(CmdBlitImage) \
+	X(CmdCopyBufferToImage) \
+	X(CmdCopyImageToBuffer) \
+	X(CmdUpdateBuffer) \
+	X(CmdFillBuffer) \
+	X(CmdClearColorImage) \
+	X(CmdPipelineBarrier) \
+	X(CmdResetQueryPool) \
+	X(CmdWriteTimestamp) \
+	X(CmdPushConstants) \
+	X(CmdBeginRenderPass) \
+	X(CmdEndRenderPass) \
+	X(CreateSwapchainKHR) \
+	X(DestroySwapchainKHR) \
+	X(GetSwapchainImagesKHR) \
+	X(AcquireNextImageKHR) \
+	X(QueuePresentKHR)
+
+
+// Instance-level extension entry points. These are optional, so a missing one is left null.
+struct InstanceDispatch {
+#define X(name) PFN_vk##name name = nullptr;
+	VULKAN_INSTANCE_FUNCTIONS(X)
+#undef X
+
+	void Load(VkInstance instance);
+};
+
+// Device-level entry points for one VkDevice. All of them are required.
+struct DeviceDispatch {
+#define X(name) PFN_vk##name name = nullptr;
+	VULKAN_DEVICE_FUNCTIONS(X)
+#undef X
+
+	void Load(VkDevice device);
+};